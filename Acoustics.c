@@ -8,6 +8,14 @@ Refer to Acoustics.h for interface details.
 #include "Complex.h"
 #include <gsl/gsl_sf_bessel.h>
 #include <math.h>
+#include <stdlib.h>
+FrequencyContext frequencyContext(double f) {
+  FrequencyContext fc;
+  fc.f = f;
+  fc.omega = 2 * M_PI * f;
+  fc.rootf = sqrt(f);
+  return fc;
+}
 double saturationVapourPressureWater(double T) {
   double C1, C2, C3, C4;
   C1 = 1.2811805e-5;
@@ -16,35 +24,38 @@ double saturationVapourPressureWater(double T) {
   C4 = 6.3536311e3;
   return exp(C1 * pow(T, 2) - C2 * T + C3 - C4 / T);
 }
-double speedSound(double t, double p, double h, double x_c) {
-  double f, T, p_sv, x_w;
+double moleFractionWater(double t, double p, double h) {
+  double f, T, p_sv;
   /* Calculate mole fraction of water vapour using equation in Cramer
   Appendix (p. 2515) */
   f = 1.00062 + 3.14e-8 * p + 5.6e-7 * pow(t, 2);
   T = t + 273.15;
   p_sv = saturationVapourPressureWater(T);
-  x_w = h * f * p_sv / p;
-  return speedSoundCramer(t, p, x_w, x_c);
+  return h * f * p_sv / p;
+}
+double speedSound(double t, double p, double h, double x_c) {
+  return speedSoundCramer(t, p, moleFractionWater(t, p, h), x_c);
 }
 double speedSoundCramer(double t, double p, double x_w, double x_c) {
   int i;
   double c = 0;
+  double t2 = pow(t, 2);
   double a[] = {331.5024,  0.603055,  -0.000528, 51.471935,
                 0.1495874, -0.000782, -1.82e-7,  3.73e-8,
                 -2.93e-10, -85.20931, -0.228525, 5.91e-5,
                 -2.835149, -2.15e-13, 29.179762, 0.000486};
   double coeff[] = {1.0,
                     t,
-                    pow(t, 2),
+                    t2,
                     x_w,
                     t * x_w,
-                    pow(t, 2) * x_w,
+                    t2 * x_w,
                     p,
                     t * p,
-                    pow(t, 2) * p,
+                    t2 * p,
                     x_c,
                     t * x_c,
-                    pow(t, 2) * x_c,
+                    t2 * x_c,
                     pow(x_w, 2),
                     pow(p, 2),
                     pow(x_c, 2),
@@ -69,20 +80,141 @@ double densityAirIdeal(double t, double p, double h, double x_c) {
   p_a = p - p_w - p_c;
   return p_a / (R_a * T) + p_w / (R_w * T) + p_c / (R_c * T);
 }
-double densityAirGiacomo(double t, double p, double h, double x_c) {
+/* the density of air (Giacomo) given the mole fraction of water
+vapour */
+static double densityAirGiacomoMoist(double t, double p, double x_w,
+                                     double x_c) {
   double T = 273.15 + t;
   double R = 8.314472;
   double M_w = 18.015e-3;
-  double M_a, f, p_sv, x_w, Z;
+  double M_a, Z;
   M_a = (28.9635 + 12.011 * (x_c - 0.0004)) * 1e-3;
-  /* Calculate mole fraction of water vapour using equation in Cramer
-  Appendix (p. 2515) */
-  f = 1.00062 + 3.14e-8 * p + 5.6e-7 * pow(t, 2);
-  p_sv = saturationVapourPressureWater(T);
-  x_w = h * f * p_sv / p;
   Z = compressibilityAir(t, p, x_w);
   return p * M_a * (1 - x_w * (1 - M_w / M_a)) / (Z * R * T);
 }
+double densityAirGiacomo(double t, double p, double h, double x_c) {
+  return densityAirGiacomoMoist(t, p, moleFractionWater(t, p, h), x_c);
+}
+AirProperties airProperties(double t, double p, double h, double x_c) {
+  AirProperties air;
+  /* the water vapour terms are shared by both formulae */
+  double x_w = moleFractionWater(t, p, h);
+  air.c = speedSoundCramer(t, p, x_w, x_c);
+  air.rho = densityAirGiacomoMoist(t, p, x_w, x_c);
+  return air;
+}
+/* the temperature of node k of a table */
+static double airTableNode(AirTable table, int k) {
+  return table->tmin + k * table->tstep;
+}
+/* evaluates the nodes of a table with the given number of intervals */
+static void fillAirTable(AirTable table, double tmax, int intervals) {
+  AirProperties air;
+  int k;
+  table->numNodes = intervals + 1;
+  table->tstep = (intervals > 0) ? (tmax - table->tmin) / intervals : 0.0;
+  table->c = (double *)realloc(table->c,
+                               2 * table->numNodes * sizeof(double));
+  table->rho = table->c + table->numNodes;
+  for (k = 0; k < table->numNodes; k++) {
+    air = airProperties(airTableNode(table, k), table->p, table->h,
+                        table->x_c);
+    table->c[k] = air.c;
+    table->rho[k] = air.rho;
+  }
+}
+/* interpolates a table between its nodes (Lagrange interpolation
+through the four nearest nodes, or all of them in a smaller table) */
+static AirProperties interpolateAirTable(AirTable table, double t) {
+  AirProperties air = {0.0, 0.0};
+  double u = (t - table->tmin) / table->tstep;
+  double w;
+  int first, last, k, l;
+  first = (int)floor(u) - 1;
+  if (first > table->numNodes - 4)
+    first = table->numNodes - 4;
+  if (first < 0)
+    first = 0;
+  last = (first + 4 < table->numNodes) ? first + 4 : table->numNodes;
+  for (k = first; k < last; k++) {
+    w = 1.0;
+    for (l = first; l < last; l++)
+      if (l != k)
+        w *= (u - l) / (k - l);
+    air.c += w * table->c[k];
+    air.rho += w * table->rho[k];
+  }
+  return air;
+}
+/* the largest relative interpolation error at the quarter points of
+the intervals of a table (the error of the end intervals peaks away
+from their midpoints) */
+static double airTableError(AirTable table) {
+  AirProperties exact, interp;
+  double t, err, maxErr = 0.0;
+  int k, q;
+  for (k = 0; k < table->numNodes - 1; k++) {
+    for (q = 1; q <= 3; q++) {
+      t = airTableNode(table, k) + q * table->tstep / 4;
+      exact = airProperties(t, table->p, table->h, table->x_c);
+      interp = interpolateAirTable(table, t);
+      err = fabs(interp.c - exact.c) / exact.c;
+      if (err > maxErr)
+        maxErr = err;
+      err = fabs(interp.rho - exact.rho) / exact.rho;
+      if (err > maxErr)
+        maxErr = err;
+    }
+  }
+  return maxErr;
+}
+AirTable createAirTable(double tmin, double tmax, double p, double h,
+                        double x_c) {
+  AirTable table = (AirTable)malloc(sizeof(*table));
+  int intervals = (tmax > tmin) ? (int)ceil(tmax - tmin) : 0;
+  table->p = p;
+  table->h = h;
+  table->x_c = x_c;
+  table->tmin = tmin;
+  table->c = NULL;
+  /* halve the spacing until the interpolation is accurate enough */
+  while (1) {
+    fillAirTable(table, tmax, intervals);
+    if ((intervals == 0) || (airTableError(table) <= AIR_TABLE_TOLERANCE))
+      break;
+    if (2 * intervals + 1 > AIR_TABLE_MAX_NODES) {
+      table->numNodes = 0;
+      break;
+    }
+    intervals *= 2;
+  }
+  return table;
+}
+void freeAirTable(AirTable table) {
+  if (table == NULL)
+    return;
+  free(table->c);
+  free(table);
+}
+AirProperties airTableProperties(AirTable table, double t) {
+  AirProperties air;
+  int k;
+  if (table->numNodes > 0) {
+    /* exactly at a node */
+    k = (table->tstep > 0) ? (int)floor((t - table->tmin) / table->tstep + 0.5)
+                           : 0;
+    if ((k >= 0) && (k < table->numNodes) && (airTableNode(table, k) == t)) {
+      air.c = table->c[k];
+      air.rho = table->rho[k];
+      return air;
+    }
+    /* between nodes */
+    if ((table->numNodes > 1) && (t > table->tmin) &&
+        (t < airTableNode(table, table->numNodes - 1)))
+      return interpolateAirTable(table, t);
+  }
+  return airProperties(t, table->p, table->h, table->x_c);
+}
 double compressibilityAir(double t, double p, double x_w) {
   double T = 273.15 + t;
   double a_0, a_1, a_2, b_0, b_1, c_0, c_1, d, e;
@@ -102,21 +234,22 @@ double compressibilityAir(double t, double p, double x_w) {
              T +
          pow(p, 2) * (d + e * pow(x_w, 2)) / pow(T, 2);
 }
-complex waveNum(double f, double c, double a, double alphacorrection) {
+complex waveNum(FrequencyContext fc, double c, double a,
+                double alphacorrection) {
   /* implement wave number equation */
   complex z;
-  double w = 2 * M_PI * f;
-  z.Re = w / phaseVel(f, c, a);
-  z.Im = (-1) * attenCoeff(f, a, alphacorrection);
+  double w = fc.omega;
+  z.Re = w / phaseVel(fc, c, a);
+  z.Im = (-1) * attenCoeff(fc, a, alphacorrection);
   return z;
 }
-double phaseVel(double f, double c, double a) {
+double phaseVel(FrequencyContext fc, double c, double a) {
   /* implement phase velocity equation */
-  return c * (1.0 - (1.65e-3 / (a * sqrt(f))));
+  return c * (1.0 - (1.65e-3 / (a * fc.rootf)));
 }
-double attenCoeff(double f, double a, double alphacorrection) {
+double attenCoeff(FrequencyContext fc, double a, double alphacorrection) {
   /* implement attenuation coefficient equation */
-  return alphacorrection * (3.0e-5 * pow(f, 0.5)) / a;
+  return alphacorrection * (3.0e-5 * fc.rootf) / a;
 }
 complex charZ(double c, double rho, double a) {
   /* implement characteristic impedance equation */
@@ -124,20 +257,41 @@ complex charZ(double c, double rho, double a) {
   complex z = {Zo, 0};
   return z;
 }
-complex radiationZ(double f, double c, double rho, double a, double flange) {
+dualcomplex waveNumDual(FrequencyContext fc, double c, double a,
+                        double alphacorrection) {
+  complex k = waveNum(fc, c, a, alphacorrection), dk;
+  double v = phaseVel(fc, c, a);
+  /* dv/df and d(alpha)/df, both through the square root of f */
+  double dv = c * 1.65e-3 / (2 * a * fc.f * fc.rootf);
+  dk.Re = 2 * M_PI / v - fc.omega * dv / (v * v);
+  dk.Im = (-1) * alphacorrection * 3.0e-5 / (2 * a * fc.rootf);
+  return dualz(k, dk);
+}
+/* the wave number in free air, omega / c, with its derivative */
+static dualcomplex freeWaveNumDual(FrequencyContext fc, double c) {
+  return dualz(real(fc.omega / c), real(2 * M_PI / c));
+}
+/* c0 + c1 x + c2 x^2 */
+static dualcomplex quadraticDual(dualcomplex x, double c0, double c1,
+                                 double c2) {
+  return adddz(constdz(real(c0)),
+               multdz(x, adddz(constdz(real(c1)), scaledz(real(c2), x))));
+}
+complex radiationZ(FrequencyContext fc, double c, double rho, double a,
+                   double flange) {
   complex Z0, Z_u, Z_f, Z;
   complex d_u, d_f, d;
   double b, a_on_b;
-  double k = (2 * M_PI * f) / c, ka = k * a;
+  double k = fc.omega / c, ka = k * a;
   double modR_edge, phaseR_edge;
   complex R_norefl, R_edge, R;
   if (flange < 0.0)
     return inf;
   if (flange == 0.0)
-    return unflangedZ(f, c, rho, a);
+    return unflangedZ(fc, c, rho, a);
   /* calculate radiationZ for unflanged and flanged pipe */
-  Z_u = unflangedZ(f, c, rho, a);
-  Z_f = flangedZ(f, c, rho, a);
+  Z_u = unflangedZ(fc, c, rho, a);
+  Z_f = flangedZ(fc, c, rho, a);
   /* calculate the characteristic impedance */
   Z0 = charZ(c, rho, a);
   /* calculate complex end corrections for unflanged and flanged
@@ -160,8 +314,8 @@ complex radiationZ(double f, double c, double rho, double a, double flange) {
   Z = multz(Z0, divz(addz(one, R), subz(one, R)));
   return Z;
 }
-complex unflangedZ(double f, double c, double rho, double a) {
-  double k = (2 * M_PI * f) / c;
+complex unflangedZ(FrequencyContext fc, double c, double rho, double a) {
+  double k = fc.omega / c;
   double ka = k * a;
   complex d;
   double modR;
@@ -180,8 +334,8 @@ complex unflangedZ(double f, double c, double rho, double a) {
   Z = multz(j, multz(Z0, tanz(multz(real(k), d))));
   return Z;
 }
-complex flangedZ(double f, double c, double rho, double a) {
-  double k = (2 * M_PI * f) / c;
+complex flangedZ(FrequencyContext fc, double c, double rho, double a) {
+  double k = fc.omega / c;
   double ka = k * a;
   complex d;
   double modR;
@@ -199,63 +353,297 @@ complex flangedZ(double f, double c, double rho, double a) {
   Z = multz(j, multz(Z0, tanz(multz(real(k), d))));
   return Z;
 }
-TransferMatrix tubeMatrix(double f, double c, double rho, double L, double a,
-                          double alphacorrection) {
-  complex Zo, jkL, A, B, C, D;
+TransferMatrix tubeMatrix(FrequencyContext fc, double c, double rho, double L,
+                          double a, double alphacorrection) {
+  TubeElement e = compileTube(c, rho, L, a, alphacorrection);
+  return tubeElementMatrix(fc, &e);
+}
+TransferMatrix coneMatrix(FrequencyContext fc, double c, double rho, double L,
+                          double a1, double a2, double alphacorrection) {
+  ConeElement e = compileCone(c, rho, L, a1, a2, alphacorrection);
+  return coneElementMatrix(fc, &e);
+}
+dualcomplex radiationZDual(FrequencyContext fc, double c, double rho,
+                           double a, double flange) {
+  complex Z0, jZ0_inv;
+  dualcomplex Z_u, Z_f, d_u, d_f, d, k, ka, s;
+  dualcomplex R_norefl, modR_edge, phaseR_edge, R_edge, R;
+  double b, a_on_b;
+  if (flange < 0.0)
+    return constdz(inf);
+  if (flange == 0.0)
+    return unflangedZDual(fc, c, rho, a);
+  k = freeWaveNumDual(fc, c);
+  ka = scaledz(real(a), k);
+  Z_u = unflangedZDual(fc, c, rho, a);
+  Z_f = flangedZDual(fc, c, rho, a);
+  Z0 = charZ(c, rho, a);
+  jZ0_inv = divz(one, multz(j, Z0));
+  /* complex end corrections for unflanged and flanged pipe */
+  d_u = divdz(arctandz(scaledz(jZ0_inv, Z_u)), k);
+  d_f = divdz(arctandz(scaledz(jZ0_inv, Z_f)), k);
+  b = a * (1 + flange);
+  a_on_b = a / b;
+  /* the length correction */
+  d = adddz(adddz(d_f, scaledz(real(a_on_b), subdz(d_u, d_f))),
+            constdz(real(0.057 * a_on_b * (1 - pow(a_on_b, 5)) * a)));
+  /* the reflection coefficient (42) */
+  R_norefl =
+      scaledz(real(-1), expdz(scaledz(imaginary(-2), multdz(k, d))));
+  s = sindz(scaledz(real(b / (1.85 - a_on_b)), k));
+  modR_edge = scaledz(real(-0.43 * (b - a) * a / pow(b, 2)), multdz(s, s));
+  phaseR_edge = scaledz(
+      real(-b), multdz(k, quadraticDual(ka, 1 + a_on_b * (2.3 - a_on_b), 0,
+                                        -0.3 * a_on_b)));
+  R_edge = multdz(modR_edge, expdz(scaledz(j, phaseR_edge)));
+  R = adddz(R_norefl, R_edge);
+  return scaledz(Z0, divdz(adddz(constdz(one), R), subdz(constdz(one), R)));
+}
+dualcomplex unflangedZDual(FrequencyContext fc, double c, double rho,
+                           double a) {
+  dualcomplex k = freeWaveNumDual(fc, c), ka = scaledz(real(a), k);
+  dualcomplex dRe, dIm, modR, s;
+  complex Z0 = charZ(c, rho, a);
+  /* the frequency-dependent end correction (14b) */
+  s = sindz(scaledz(real(2), ka));
+  dRe = scaledz(real(0.6133 * a),
+                subdz(divdz(quadraticDual(ka, 1, 0, 0.044),
+                            quadraticDual(ka, 1, 0, 0.19)),
+                      scaledz(real(0.02), multdz(s, s))));
+  /* the modulus of the reflection coefficient (14c) */
+  modR = divdz(quadraticDual(ka, 1, 0.2, -0.084),
+               quadraticDual(ka, 1, 0.2, 0.5 - 0.084));
+  dIm = divdz(logdz(modR), scaledz(real(2), k));
+  /* the impedance (9) */
+  return scaledz(multz(j, Z0),
+                 tandz(multdz(k, adddz(dRe, scaledz(j, dIm)))));
+}
+dualcomplex flangedZDual(FrequencyContext fc, double c, double rho,
+                         double a) {
+  dualcomplex k = freeWaveNumDual(fc, c), ka = scaledz(real(a), k);
+  dualcomplex dRe, dIm, modR;
+  complex Z0 = charZ(c, rho, a);
+  /* the frequency-dependent end correction (15a) */
+  dRe = divdz(constdz(real(0.8216 * a)),
+              adddz(constdz(one), divdz(quadraticDual(ka, 0, 0, 0.77 * 0.77),
+                                        quadraticDual(ka, 1, 0.77, 0))));
+  /* the modulus of the reflection coefficient (15b) */
+  modR = divdz(quadraticDual(ka, 1, 0.323, -0.077),
+               quadraticDual(ka, 1, 0.323, 1 - 0.077));
+  dIm = divdz(logdz(modR), scaledz(real(2), k));
+  /* the impedance (9) */
+  return scaledz(multz(j, Z0),
+                 tandz(multdz(k, adddz(dRe, scaledz(j, dIm)))));
+}
+DualTransferMatrix tubeMatrixDual(FrequencyContext fc, double c, double rho,
+                                  double L, double a,
+                                  double alphacorrection) {
+  TubeElement e = compileTube(c, rho, L, a, alphacorrection);
+  return tubeElementMatrixDual(fc, &e);
+}
+DualTransferMatrix coneMatrixDual(FrequencyContext fc, double c, double rho,
+                                  double L, double a1, double a2,
+                                  double alphacorrection) {
+  ConeElement e = compileCone(c, rho, L, a1, a2, alphacorrection);
+  return coneElementMatrixDual(fc, &e);
+}
+TubeElement compileTube(double c, double rho, double L, double a,
+                        double alphacorrection) {
+  TubeElement e;
+  e.c = c;
+  e.rho = rho;
+  e.L = L;
+  e.a = a;
+  e.alphacorrection = alphacorrection;
+  e.Zo = charZ(c, rho, a);
+  return e;
+}
+GradientTubeElement compileGradientTube(double c1, double cm, double c2,
+                                        double rho1, double rho2, double L,
+                                        double a, double alphacorrection) {
+  GradientTubeElement e;
+  double Zo1 = charZ(c1, rho1, a).Re;
+  double Zo2 = charZ(c2, rho2, a).Re;
+  /* the phase follows the mean of 1 / c (Simpson's rule) */
+  e.c = 6 / (1 / c1 + 4 / cm + 1 / c2);
+  e.L = L;
+  e.a = a;
+  e.alphacorrection = alphacorrection;
+  e.Zo = sqrt(Zo1 * Zo2);
+  e.eta = 0.5 * log(Zo2 / Zo1);
+  e.ratio = sqrt(Zo2 / Zo1);
+  return e;
+}
+TransferMatrix tubeElementMatrix(FrequencyContext fc, const TubeElement *e) {
+  complex jkL, A, B, C, D;
   /* check for zero length segment */
-  if (L == 0.0)
+  if (e->L == 0.0)
     return identitym();
-  Zo = charZ(c, rho, a);
-  jkL = multz(j, multz(waveNum(f, c, a, alphacorrection), real(L)));
+  jkL = multz(j, multz(waveNum(fc, e->c, e->a, e->alphacorrection),
+                       real(e->L)));
   A = coshz(jkL);
-  B = multz(Zo, sinhz(jkL));
-  C = divz(sinhz(jkL), Zo);
+  B = multz(e->Zo, sinhz(jkL));
+  C = divz(sinhz(jkL), e->Zo);
   D = A;
-  return createTransferMatrix(A, B, C, D);
-  ;
+  return makem(A, B, C, D);
 }
-TransferMatrix coneMatrix(double f, double c, double rho, double L, double a1,
-                          double a2, double alphacorrection) {
-  complex k, kL, kx1, kx2, theta1, theta2, sintheta1, sintheta2;
-  complex A, B, C, D;
-  double S1, S2, x1, x2, a;
-  double rhoc = rho * c;
+DualTransferMatrix tubeElementMatrixDual(FrequencyContext fc,
+                                         const TubeElement *e) {
+  DualTransferMatrix m;
+  dualcomplex jkL, sinhjkL;
+  complex ejkL, ejkL_inv, coshv, sinhv;
+  /* check for zero length segment */
+  if (e->L == 0.0)
+    return identitydm();
+  jkL = scaledz(imaginary(e->L),
+                waveNumDual(fc, e->c, e->a, e->alphacorrection));
+  /* cosh and sinh from one pair of exponentials */
+  ejkL = expz(jkL.v);
+  ejkL_inv = divz(one, ejkL);
+  coshv = multz(real(0.5), addz(ejkL, ejkL_inv));
+  sinhv = multz(real(0.5), subz(ejkL, ejkL_inv));
+  sinhjkL = dualz(sinhv, multz(coshv, jkL.d));
+  m.A = dualz(coshv, multz(sinhv, jkL.d));
+  m.B = scaledz(e->Zo, sinhjkL);
+  m.C = scaledz(divz(one, e->Zo), sinhjkL);
+  m.D = m.A;
+  return m;
+}
+TransferMatrix gradientTubeElementMatrix(FrequencyContext fc,
+                                         const GradientTubeElement *e) {
+  complex phi, sinphi, cosphi, mu, coshmu, sinhmu, coshmusinphi;
   /* check for zero length segment */
-  if (L == 0.0)
+  if (e->L == 0.0)
     return identitym();
+  phi = multz(waveNum(fc, e->c, e->a, e->alphacorrection), real(e->L));
+  sinphi = sinz(phi);
+  cosphi = cosz(phi);
+  /* the reflection by the gradient of Zo, integrated along the tube */
+  mu = multz(real(e->eta), divz(sinphi, phi));
+  coshmu = coshz(mu);
+  sinhmu = sinhz(mu);
+  coshmusinphi = multz(coshmu, sinphi);
+  return makem(multz(real(1 / e->ratio), addz(multz(coshmu, cosphi), sinhmu)),
+               multz(imaginary(e->Zo), coshmusinphi),
+               multz(imaginary(1 / e->Zo), coshmusinphi),
+               multz(real(e->ratio), subz(multz(coshmu, cosphi), sinhmu)));
+}
+DualTransferMatrix gradientTubeElementMatrixDual(
+    FrequencyContext fc, const GradientTubeElement *e) {
+  DualTransferMatrix m;
+  dualcomplex phi, sinphi, cosphi, mu, coshmu, sinhmu, coshmucosphi;
+  dualcomplex coshmusinphi;
+  /* check for zero length segment */
+  if (e->L == 0.0)
+    return identitydm();
+  phi = scaledz(real(e->L), waveNumDual(fc, e->c, e->a, e->alphacorrection));
+  sinphi = sindz(phi);
+  cosphi = cosdz(phi);
+  mu = scaledz(real(e->eta), divdz(sinphi, phi));
+  coshmu = coshdz(mu);
+  sinhmu = sinhdz(mu);
+  coshmucosphi = multdz(coshmu, cosphi);
+  coshmusinphi = multdz(coshmu, sinphi);
+  m.A = scaledz(real(1 / e->ratio), adddz(coshmucosphi, sinhmu));
+  m.B = scaledz(imaginary(e->Zo), coshmusinphi);
+  m.C = scaledz(imaginary(1 / e->Zo), coshmusinphi);
+  m.D = scaledz(real(e->ratio), subdz(coshmucosphi, sinhmu));
+  return m;
+}
+ConeElement compileCone(double c, double rho, double L, double a1, double a2,
+                        double alphacorrection) {
+  ConeElement e;
+  double S1, S2;
+  double rhoc = rho * c;
+  e.c = c;
+  e.rho = rho;
+  e.L = L;
+  e.a1 = a1;
+  e.a2 = a2;
+  e.alphacorrection = alphacorrection;
   /* calculate apex distance for both ends of conical section
   based on similar triangles */
-  x1 = L / (a2 / a1 - 1.0);
-  x2 = x1 + L;
-  a2 = a1 * (1.0 + L / x1);
+  e.x1 = L / (a2 / a1 - 1.0);
+  e.x2 = e.x1 + L;
+  a2 = a1 * (1.0 + L / e.x1);
   /* calculate areas of each end based on given radii */
   S1 = M_PI * a1 * a1;
   S2 = M_PI * a2 * a2;
   /* use geometric mean of radii for attenuation purposes */
-  a = sqrt(a1 * a2);
+  e.a = sqrt(a1 * a2);
+  e.BScale = rhoc / S2;
+  e.CScale = S1 / rhoc;
+  e.DScale = S1 / S2;
+  return e;
+}
+/* the uniform air with the same mass and compliance as air varying
+along a cone (Simpson's rule for the means of rho and 1 / (rho c^2)) */
+static void equivalentAir(double c1, double cm, double c2, double rho1,
+                          double rhom, double rho2, double *c, double *rho) {
+  double mass = (rho1 + 4 * rhom + rho2) / 6;
+  double compliance = (1 / (rho1 * c1 * c1) + 4 / (rhom * cm * cm) +
+                       1 / (rho2 * c2 * c2)) /
+                      6;
+  *rho = mass;
+  *c = 1 / sqrt(mass * compliance);
+}
+ConeElement compileGradientCone(double c1, double cm, double c2, double rho1,
+                                double rhom, double rho2, double L, double a1,
+                                double a2, double alphacorrection) {
+  double c, rho;
+  equivalentAir(c1, cm, c2, rho1, rhom, rho2, &c, &rho);
+  return compileCone(c, rho, L, a1, a2, alphacorrection);
+}
+TransferMatrix coneElementMatrix(FrequencyContext fc, const ConeElement *e) {
+  complex k, kL, kx1, kx2, theta1, theta2, sintheta1, sintheta2;
+  complex A, B, C, D;
+  /* check for zero length segment */
+  if (e->L == 0.0)
+    return identitym();
   /* implement cone impedance calculation */
-  k = waveNum(f, c, a, alphacorrection);
-  kL = multz(k, real(L));
-  kx1 = multz(k, real(x1));
-  kx2 = multz(k, real(x2));
+  k = waveNum(fc, e->c, e->a, e->alphacorrection);
+  kL = multz(k, real(e->L));
+  kx1 = multz(k, real(e->x1));
+  kx2 = multz(k, real(e->x2));
   theta1 = arctanz(kx1);
   theta2 = arctanz(kx2);
   sintheta1 = sinz(theta1);
   sintheta2 = sinz(theta2);
   A = multz(real(-1), divz(sinz(subz(kL, theta2)), sintheta2));
-  B = multz(j, multz(real(rhoc / S2), sinz(kL)));
-  C = multz(imaginary(S1 / rhoc), divz(sinz(addz(kL, subz(theta1, theta2))),
+  B = multz(j, multz(real(e->BScale), sinz(kL)));
+  C = multz(imaginary(e->CScale), divz(sinz(addz(kL, subz(theta1, theta2))),
                                        multz(sintheta1, sintheta2)));
-  D = multz(real(S1 / S2), divz(sinz(addz(kL, theta1)), sintheta1));
-  return createTransferMatrix(A, B, C, D);
+  D = multz(real(e->DScale), divz(sinz(addz(kL, theta1)), sintheta1));
+  return makem(A, B, C, D);
+}
+DualTransferMatrix coneElementMatrixDual(FrequencyContext fc,
+                                         const ConeElement *e) {
+  DualTransferMatrix m;
+  dualcomplex k, kL, theta1, theta2, sintheta1, sintheta2;
+  /* check for zero length segment */
+  if (e->L == 0.0)
+    return identitydm();
+  k = waveNumDual(fc, e->c, e->a, e->alphacorrection);
+  kL = scaledz(real(e->L), k);
+  theta1 = arctandz(scaledz(real(e->x1), k));
+  theta2 = arctandz(scaledz(real(e->x2), k));
+  sintheta1 = sindz(theta1);
+  sintheta2 = sindz(theta2);
+  m.A = scaledz(real(-1), divdz(sindz(subdz(kL, theta2)), sintheta2));
+  m.B = scaledz(imaginary(e->BScale), sindz(kL));
+  m.C = scaledz(imaginary(e->CScale),
+                divdz(sindz(adddz(kL, subdz(theta1, theta2))),
+                      multdz(sintheta1, sintheta2)));
+  m.D = scaledz(real(e->DScale), divdz(sindz(adddz(kL, theta1)), sintheta1));
+  return m;
 }
-TransferMatrix discontinuityMatrix(double f, double c, double rho, double a1,
-                                   double a2) {
+TransferMatrix discontinuityMatrix(FrequencyContext fc, double c, double rho,
+                                   double a1, double a2) {
   TransferMatrix m = identitym();
   int n, N = 100;
   double F0n, gamma_n;
   double x = a1 / a2;
-  double omega = 2 * M_PI * f;
+  double omega = fc.omega;
   double S2 = M_PI * pow(a2, 2);
   complex k_squared, k, Zchar, corr = zero;
   for (n = 1; n <= N; n++) {
@@ -267,6 +655,6 @@ TransferMatrix discontinuityMatrix(double f, double c, double rho, double a1,
     Zchar = divz(real(omega * rho / S2), k);
     corr = addz(corr, multz(Zchar, real(pow(F0n, 2))));
   }
-  m->B = corr;
+  m.B = corr;
   return m;
 }
@@ -7,6 +7,90 @@ Acoustics library.
 #define ACOUSTICS_H_PROTECTOR
 #include "Complex.h"
 #include "TransferMatrix.h"
+/* Maximum relative interpolation error of an AirTable */
+#define AIR_TABLE_TOLERANCE 1e-10
+/* Maximum number of nodes in an AirTable */
+#define AIR_TABLE_MAX_NODES 4097
+/* FrequencyContext: { frequency (Hz), angular frequency (rad/s),
+square root of the frequency }, the frequency-only terms shared by
+every element at one frequency */
+typedef struct frequencycontext_str {
+  double f;
+  double omega;
+  double rootf;
+} FrequencyContext;
+/* TubeElement: { speed of sound, density, length, radius, attenuation
+correction, characteristic impedance }, the frequency-independent
+constants of a cylindrical tube */
+typedef struct tubeelement_str {
+  double c;
+  double rho;
+  double L;
+  double a;
+  double alphacorrection;
+  complex Zo;
+} TubeElement;
+/* GradientTubeElement: { speed of sound of the mean slowness, length,
+radius, attenuation correction, geometric mean of the characteristic
+impedances at the ends, half the log of their ratio (output over
+input), the square root of their ratio }, the frequency-independent
+constants of a cylindrical tube along which the air varies */
+typedef struct gradienttubeelement_str {
+  double c;
+  double L;
+  double a;
+  double alphacorrection;
+  double Zo;
+  double eta;
+  double ratio;
+} GradientTubeElement;
+/* ConeElement: { speed of sound, density, length, input and output
+radii, attenuation correction, apex distances of each end, geometric
+mean radius, rho c / S2, S1 / rho c, S1 / S2 }, the
+frequency-independent constants of a truncated cone */
+typedef struct coneelement_str {
+  double c;
+  double rho;
+  double L;
+  double a1;
+  double a2;
+  double alphacorrection;
+  double x1;
+  double x2;
+  double a;
+  double BScale;
+  double CScale;
+  double DScale;
+} ConeElement;
+/* AirProperties: { speed of sound (m/s), density (kg/m3) } */
+typedef struct airproperties_str {
+  double c;
+  double rho;
+} AirProperties;
+/* AirTable: { pressure, relative humidity, CO2 mole fraction, lowest
+temperature, node spacing, number of nodes, speed of sound and
+density at each node }, the air properties over a range of
+temperatures for one atmosphere. A table with no nodes evaluates
+every temperature directly. */
+typedef struct airtable_str {
+  double p;
+  double h;
+  double x_c;
+  double tmin;
+  double tstep;
+  int numNodes;
+  double *c;
+  double *rho;
+} * AirTable;
+FrequencyContext frequencyContext(double f);
+/*
+Calculates the frequency-only terms for a frequency once, to be
+passed to every element evaluated at that frequency.
+Parameters:
+f: the frequency in Hz
+Returns:
+the FrequencyContext for f
+*/
 double saturationVapourPressureWater(double T);
 /*
 Calculates the saturation vapour pressure of water.
@@ -15,6 +99,18 @@ T: the temperature in Kelvin.
 Returns:
 The vapour pressure in Pa.
 */
+double moleFractionWater(double t, double p, double h);
+/*
+Calculates the mole fraction of water vapour in air.
+Based on Owen Cramer (1993) J. Acoust. Soc. Am. 93(5) p2510-2616;
+Appendix (p. 2515)
+Parameters:
+t: the temperature in Celsius.
+p: the pressure in Pa.
+h: the relative humidity (between 0 and 1).
+Returns:
+The mole fraction of water vapour.
+*/
 double speedSound(double t, double p, double h, double x_c);
 /*
 Calculates the speed of sound.
@@ -69,6 +165,53 @@ x_c: the mole fraction of carbon dioxide.
 Returns:
 The density of air in kg/m3.
 */
+AirProperties airProperties(double t, double p, double h, double x_c);
+/*
+Calculates the speed of sound (as speedSound) and the density of air
+(as densityAirGiacomo) together, sharing the water vapour terms.
+Parameters:
+t: the temperature in Celsius.
+p: the pressure in Pa.
+h: the relative humidity (between 0 and 1).
+x_c: the mole fraction of carbon dioxide.
+Returns:
+The speed of sound and density of air.
+*/
+AirTable createAirTable(double tmin, double tmax, double p, double h,
+                        double x_c);
+/*
+Tabulates the air properties between two temperatures for
+interpolation. The node spacing is halved from 1 degree C until cubic
+interpolation agrees with airProperties to a relative error of
+AIR_TABLE_TOLERANCE at the quarter points of every interval; if that
+needs more than AIR_TABLE_MAX_NODES nodes, the table evaluates every
+temperature directly instead.
+Parameters:
+tmin: the lowest temperature in Celsius.
+tmax: the highest temperature in Celsius.
+p: the pressure in Pa.
+h: the relative humidity (between 0 and 1).
+x_c: the mole fraction of carbon dioxide.
+Returns:
+A new AirTable.
+*/
+void freeAirTable(AirTable table);
+/*
+Frees an AirTable.
+Parameters:
+table: the AirTable (may be NULL).
+*/
+AirProperties airTableProperties(AirTable table, double t);
+/*
+Returns the air properties at a temperature, exactly at a node of the
+table, interpolated between nodes and calculated directly outside the
+table.
+Parameters:
+table: the AirTable.
+t: the temperature in Celsius.
+Returns:
+The speed of sound and density of air.
+*/
 double compressibilityAir(double t, double p, double x_w);
 /*
 Calculates the compressibility of air.
@@ -80,7 +223,8 @@ x_w: the mole fraction of water vapour.
 Returns:
 The compressibility of air.
 */
-complex waveNum(double f, double c, double a, double alphacorrection);
+complex waveNum(FrequencyContext fc, double c, double a,
+                double alphacorrection);
 /*
 Calculates k, the complex wave number for a given segment which
 includes wall losses. Refer to Fletcher and Rossing (1998).
@@ -93,7 +237,7 @@ factor.
 Returns:
 The complex wave number k, including wall losses.
 */
-double phaseVel(double f, double c, double a);
+double phaseVel(FrequencyContext fc, double c, double a);
 /*
 Calculates the phase velocity of a given pipe, part of the wave
 number.
@@ -104,7 +248,7 @@ a: the radius of the tube in metres.
 Returns:
 The phase velocity.
 */
-double attenCoeff(double f, double a, double alphacorrection);
+double attenCoeff(FrequencyContext fc, double a, double alphacorrection);
 /*
 Calculates the attentuation coefficient (alpha) of a given segment,
 part of the wave number. A multiplicative factor alphacorrection is
@@ -117,6 +261,20 @@ factor.
 Returns:
 The attenuation coefficient.
 */
+dualcomplex waveNumDual(FrequencyContext fc, double c, double a,
+                        double alphacorrection);
+/*
+Calculates the complex wave number of a given segment (as waveNum)
+together with its derivative with respect to frequency.
+Parameters:
+fc: the FrequencyContext of the frequency.
+c: the speed of sound
+a: the radius of the tube in metres.
+alphacorrection: the multiplicative attenuation coefficient
+factor.
+Returns:
+k and dk/df.
+*/
 complex charZ(double c, double rho, double a);
 /*
 Calculates the characteristic impedance of a given cylindrical pipe.
@@ -128,7 +286,8 @@ a: the radius of the tube in metres.
 Returns:
 The complex characteristic impedance of the tube.
 */
-complex radiationZ(double f, double c, double rho, double a, double flange);
+complex radiationZ(FrequencyContext fc, double c, double rho, double a,
+                   double flange);
 /*
 Calculates the radiation impedance of a termination.
 Refer to Dalmont (2001) JSV 244, 505-34.
@@ -142,7 +301,7 @@ thickness to a.
 Returns:
 The complex radiation impedance.
 */
-complex unflangedZ(double f, double c, double rho, double a);
+complex unflangedZ(FrequencyContext fc, double c, double rho, double a);
 /*
 Calculates the radiation impedance of an unflanged pipe.
 Refer to Dalmont (2001) JSV 244, 505-34.
@@ -154,7 +313,7 @@ a: the radius of the tube in metres.
 Returns:
 The complex radiation impedance.
 */
-complex flangedZ(double f, double c, double rho, double a);
+complex flangedZ(FrequencyContext fc, double c, double rho, double a);
 /*
 Calculates the radiation impedance of a flanged pipe.
 Refer to Dalmont (2001) JSV 244, 505-34.
@@ -166,15 +325,56 @@ a: the radius of the tube in metres.
 Returns:
 The complex radiation impedance.
 */
-TransferMatrix tubeMatrix(double f, double c, double rho, double L, double a,
-                          double alphacorrection);
+dualcomplex radiationZDual(FrequencyContext fc, double c, double rho,
+                           double a, double flange);
+/*
+Calculates the radiation impedance of a termination (as radiationZ)
+together with its derivative with respect to frequency.
+Parameters:
+fc: the FrequencyContext of the frequency.
+c: the speed of sound.
+rho: the density of air.
+a: the radius of the tube in metres.
+flange: -1 for a stopped termination, otherwise ratio of annulus
+thickness to a.
+Returns:
+Z and dZ/df (inf with derivative 0 if stopped).
+*/
+dualcomplex unflangedZDual(FrequencyContext fc, double c, double rho,
+                           double a);
+/*
+Calculates the radiation impedance of an unflanged pipe (as
+unflangedZ) together with its derivative with respect to frequency.
+Parameters:
+fc: the FrequencyContext of the frequency.
+c: the speed of sound.
+rho: the density of air.
+a: the radius of the tube in metres.
+Returns:
+Z and dZ/df.
+*/
+dualcomplex flangedZDual(FrequencyContext fc, double c, double rho,
+                         double a);
+/*
+Calculates the radiation impedance of a flanged pipe (as flangedZ)
+together with its derivative with respect to frequency.
+Parameters:
+fc: the FrequencyContext of the frequency.
+c: the speed of sound.
+rho: the density of air.
+a: the radius of the tube in metres.
+Returns:
+Z and dZ/df.
+*/
+TransferMatrix tubeMatrix(FrequencyContext fc, double c, double rho, double L,
+                          double a, double alphacorrection);
 /*
 Calculates the transfer matrix of a cylindrical tube.
 The transfer matrix T relates pressure and flow at the input
 to the pressure and flow at the output. Flow is positive
 into the input and out of the output.
 Parameters:
-f: the frequency.
+fc: the FrequencyContext of the frequency.
 c: the speed of sound.
 rho: the density of air.
 L: the length of the tube in metres.
@@ -184,15 +384,15 @@ factor.
 Returns:
 The transfer matrix of the tube.
 */
-TransferMatrix coneMatrix(double f, double c, double rho, double L, double a1,
-                          double a2, double alphacorrection);
+TransferMatrix coneMatrix(FrequencyContext fc, double c, double rho, double L,
+                          double a1, double a2, double alphacorrection);
 /*
 Calculates the transfer matrix of a truncated cone.
 The transfer matrix T relates pressure and flow at the input
 to the pressure and flow at the output. Flow is positive
 into the input and out of the output.
 Parameters:
-f: the frequency.
+fc: the FrequencyContext of the frequency.
 c: the speed of sound.
 rho: the density of air.
 L: the length of the pipe in metres.
@@ -203,8 +403,190 @@ factor.
 Returns:
 The transfer matrix of the pipe.
 */
-TransferMatrix discontinuityMatrix(double f, double c, double rho, double a1,
-                                   double a2);
+DualTransferMatrix tubeMatrixDual(FrequencyContext fc, double c, double rho,
+                                  double L, double a,
+                                  double alphacorrection);
+/*
+Calculates the transfer matrix of a cylindrical tube (as tubeMatrix)
+together with its derivative with respect to frequency.
+Parameters:
+as tubeMatrix.
+Returns:
+The transfer matrix of the tube and its derivative.
+*/
+DualTransferMatrix coneMatrixDual(FrequencyContext fc, double c, double rho,
+                                  double L, double a1, double a2,
+                                  double alphacorrection);
+/*
+Calculates the transfer matrix of a truncated cone (as coneMatrix)
+together with its derivative with respect to frequency.
+Parameters:
+as coneMatrix.
+Returns:
+The transfer matrix of the pipe and its derivative.
+*/
+TubeElement compileTube(double c, double rho, double L, double a,
+                        double alphacorrection);
+/*
+Calculates the frequency-independent constants of a cylindrical tube.
+Parameters:
+c: the speed of sound.
+rho: the density of air.
+L: the length of the tube in metres.
+a: the radius of the tube in metres.
+alphacorrection: the multiplicative attenuation coefficient
+factor.
+Returns:
+The TubeElement of the tube.
+*/
+GradientTubeElement compileGradientTube(double c1, double cm, double c2,
+                                        double rho1, double rho2, double L,
+                                        double a, double alphacorrection);
+/*
+Calculates the frequency-independent constants of a cylindrical tube
+along which the speed of sound and density vary smoothly (e.g. with a
+temperature gradient). The phase is that of the mean slowness 1 / c
+(by Simpson's rule), and the characteristic impedance is taken to vary
+exponentially between its values at the ends (refer to
+gradientTubeElementMatrix).
+Parameters:
+c1: the speed of sound at the input.
+cm: the speed of sound at the middle.
+c2: the speed of sound at the output.
+rho1: the density of air at the input.
+rho2: the density of air at the output.
+L: the length of the tube in metres.
+a: the radius of the tube in metres.
+alphacorrection: the multiplicative attenuation coefficient
+factor.
+Returns:
+The GradientTubeElement of the tube.
+*/
+TransferMatrix gradientTubeElementMatrix(FrequencyContext fc,
+                                         const GradientTubeElement *e);
+/*
+Calculates the transfer matrix of a compiled cylindrical tube along
+which the air varies. The pressure and flow are split into forward and
+backward waves, each carried with the phase of the wave number and the
+WKB amplitude sqrt(Zo), and coupled by the reflection which the
+gradient of Zo causes along the tube, integrated analytically to first
+order in the gradient. With phi = kL, eta = ln(Zo2 / Zo1) / 2, mu = eta
+sin(phi) / phi and Zo = sqrt(Zo1 Zo2):
+A = (cosh(mu) cos(phi) + sinh(mu)) / e^eta
+B = j Zo cosh(mu) sin(phi)
+C = j cosh(mu) sin(phi) / Zo
+D = (cosh(mu) cos(phi) - sinh(mu)) e^eta
+so that AD - BC = 1, the matrix is the identity at zero frequency and
+that of tubeElementMatrix with uniform air, and the error is second
+order in the change of the air along the tube, at any kL. A tube of
+this kind therefore need not be cut up to follow the gradient.
+Parameters:
+fc: the FrequencyContext of the frequency.
+e: the GradientTubeElement of the tube.
+Returns:
+The transfer matrix of the tube.
+*/
+DualTransferMatrix gradientTubeElementMatrixDual(
+    FrequencyContext fc, const GradientTubeElement *e);
+/*
+Calculates the transfer matrix of a compiled cylindrical tube along
+which the air varies, as gradientTubeElementMatrix, together with its
+derivative with respect to frequency.
+Parameters:
+fc: the FrequencyContext of the frequency.
+e: the GradientTubeElement of the tube.
+Returns:
+The transfer matrix of the tube and its derivative.
+*/
+TransferMatrix tubeElementMatrix(FrequencyContext fc, const TubeElement *e);
+/*
+Calculates the transfer matrix of a compiled cylindrical tube.
+Equivalent to tubeMatrix.
+Parameters:
+fc: the FrequencyContext of the frequency.
+e: the TubeElement of the tube.
+Returns:
+The transfer matrix of the tube.
+*/
+DualTransferMatrix tubeElementMatrixDual(FrequencyContext fc,
+                                         const TubeElement *e);
+/*
+Calculates the transfer matrix of a compiled cylindrical tube together
+with its derivative with respect to frequency. Equivalent to
+tubeMatrixDual.
+Parameters:
+fc: the FrequencyContext of the frequency.
+e: the TubeElement of the tube.
+Returns:
+The transfer matrix of the tube and its derivative.
+*/
+ConeElement compileCone(double c, double rho, double L, double a1, double a2,
+                        double alphacorrection);
+/*
+Calculates the frequency-independent constants of a truncated cone.
+Parameters:
+c: the speed of sound.
+rho: the density of air.
+L: the length of the pipe in metres.
+a1: the radius of the pipe at input in metres.
+a2: the radius of the pipe at output in metres.
+alphacorrection: the multiplicative attenuation coefficient
+factor.
+Returns:
+The ConeElement of the pipe.
+*/
+ConeElement compileGradientCone(double c1, double cm, double c2, double rho1,
+                                double rhom, double rho2, double L, double a1,
+                                double a2, double alphacorrection);
+/*
+Calculates the frequency-independent constants of a truncated cone
+along which the speed of sound and density vary smoothly. The cone is
+replaced by one of uniform air with the same mass (mean of rho) and
+compliance (mean of 1 / (rho c^2)), the means taken with Simpson's
+rule, which is exact at low frequencies and accurate to second order
+in the change of the air along the cone. Unlike compileGradientTube,
+it does not follow the reflection caused by the gradient, so long
+cones are still cut up (as they are anyway for the attenuation, which
+is taken at a single radius).
+Parameters:
+c1: the speed of sound at the input.
+cm: the speed of sound at the middle.
+c2: the speed of sound at the output.
+rho1: the density of air at the input.
+rhom: the density of air at the middle.
+rho2: the density of air at the output.
+L: the length of the pipe in metres.
+a1: the radius of the pipe at input in metres.
+a2: the radius of the pipe at output in metres.
+alphacorrection: the multiplicative attenuation coefficient
+factor.
+Returns:
+The ConeElement of the pipe.
+*/
+TransferMatrix coneElementMatrix(FrequencyContext fc, const ConeElement *e);
+/*
+Calculates the transfer matrix of a compiled truncated cone.
+Equivalent to coneMatrix.
+Parameters:
+fc: the FrequencyContext of the frequency.
+e: the ConeElement of the pipe.
+Returns:
+The transfer matrix of the pipe.
+*/
+DualTransferMatrix coneElementMatrixDual(FrequencyContext fc,
+                                         const ConeElement *e);
+/*
+Calculates the transfer matrix of a compiled truncated cone together
+with its derivative with respect to frequency. Equivalent to
+coneMatrixDual.
+Parameters:
+fc: the FrequencyContext of the frequency.
+e: the ConeElement of the pipe.
+Returns:
+The transfer matrix of the pipe and its derivative.
+*/
+TransferMatrix discontinuityMatrix(FrequencyContext fc, double c, double rho,
+                                   double a1, double a2);
 /*
 Calculates the transfer matrix at a discontinuity.
 Based on Pagneux et al. (1996) J. Acoust. Soc. Am. 100 p2034-48;
@@ -0,0 +1,88 @@
+/*
+AcousticsBatch.c
+Frequency-batched versions of the bore element matrices in the
+Acoustics library.
+Refer to AcousticsBatch.h for interface details.
+*/
+#include "AcousticsBatch.h"
+#include "Acoustics.h"
+#include "BatchDispatch.h"
+#include <math.h>
+#ifdef BATCH_DISPATCH
+#pragma GCC push_options
+#pragma GCC target("avx512f,avx2,fma")
+#define KERNEL_WIDTH 8
+#define KERNEL_SUFFIX _avx512
+#include "AcousticsKernel.h"
+#undef KERNEL_WIDTH
+#undef KERNEL_SUFFIX
+#pragma GCC pop_options
+#pragma GCC push_options
+#pragma GCC target("avx2,fma")
+#define KERNEL_WIDTH 4
+#define KERNEL_SUFFIX _avx2
+#include "AcousticsKernel.h"
+#undef KERNEL_WIDTH
+#undef KERNEL_SUFFIX
+#pragma GCC pop_options
+#endif
+#define KERNEL_WIDTH 1
+#define KERNEL_SUFFIX _scalar
+#include "AcousticsKernel.h"
+#undef KERNEL_WIDTH
+#undef KERNEL_SUFFIX
+void tubeMatrixBatch(const double *f, int n, double c, double rho, double L,
+                     double a, double alphacorrection, TransferMatrixBatch m) {
+  TubeElement e = compileTube(c, rho, L, a, alphacorrection);
+  tubeElementBatch(f, n, &e, m);
+}
+void coneMatrixBatch(const double *f, int n, double c, double rho, double L,
+                     double a1, double a2, double alphacorrection,
+                     TransferMatrixBatch m) {
+  ConeElement e = compileCone(c, rho, L, a1, a2, alphacorrection);
+  coneElementBatch(f, n, &e, m);
+}
+void tubeElementBatch(const double *f, int n, const TubeElement *e,
+                      TransferMatrixBatch m) {
+  int i;
+  /* check for zero length segment */
+  if (e->L == 0.0) {
+    for (i = 0; i < n; i++)
+      setBatchMatrix(m, i, identitym());
+    return;
+  }
+  switch (batchLevel()) {
+#ifdef BATCH_DISPATCH
+  case BATCH_AVX512:
+    tubeKernel_avx512(f, n, e, m);
+    break;
+  case BATCH_AVX2:
+    tubeKernel_avx2(f, n, e, m);
+    break;
+#endif
+  default:
+    tubeKernel_scalar(f, n, e, m);
+  }
+}
+void coneElementBatch(const double *f, int n, const ConeElement *e,
+                      TransferMatrixBatch m) {
+  int i;
+  /* check for zero length segment */
+  if (e->L == 0.0) {
+    for (i = 0; i < n; i++)
+      setBatchMatrix(m, i, identitym());
+    return;
+  }
+  switch (batchLevel()) {
+#ifdef BATCH_DISPATCH
+  case BATCH_AVX512:
+    coneKernel_avx512(f, n, e, m);
+    break;
+  case BATCH_AVX2:
+    coneKernel_avx2(f, n, e, m);
+    break;
+#endif
+  default:
+    coneKernel_scalar(f, n, e, m);
+  }
+}
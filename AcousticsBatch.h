@@ -0,0 +1,68 @@
+/*
+AcousticsBatch.h
+Frequency-batched versions of the bore element matrices in the
+Acoustics library. The matrices for a whole array of frequencies are
+calculated at once, several frequencies per instruction where the
+processor supports it (AVX2 or AVX-512, selected at run time).
+*/
+#ifndef ACOUSTICSBATCH_H_PROTECTOR
+#define ACOUSTICSBATCH_H_PROTECTOR
+#include "Acoustics.h"
+#include "TransferMatrix.h"
+void tubeMatrixBatch(const double *f, int n, double c, double rho, double L,
+                     double a, double alphacorrection, TransferMatrixBatch m);
+/*
+Calculates the transfer matrices for a cylindrical tube at n
+frequencies. Equivalent to tubeMatrix.
+Parameters:
+f: the frequencies in Hz
+n: the number of frequencies
+c: the speed of sound in m/s
+rho: the density of air in kg/m3
+L: the length of the tube in m
+a: the radius of the tube in m
+alphacorrection: the factor applied to the attenuation coefficient
+m: the return batch (of at least n matrices)
+*/
+void coneMatrixBatch(const double *f, int n, double c, double rho, double L,
+                     double a1, double a2, double alphacorrection,
+                     TransferMatrixBatch m);
+/*
+Calculates the transfer matrices for a conical section at n
+frequencies. Equivalent to coneMatrix, but using sin(arctan z) =
+z / sqrt(1 + z^2) and cos(arctan z) = 1 / sqrt(1 + z^2) to reduce
+the matrix elements to sin(kL), cos(kL) and 1/(kx).
+Parameters:
+f: the frequencies in Hz
+n: the number of frequencies
+c: the speed of sound in m/s
+rho: the density of air in kg/m3
+L: the length of the section in m
+a1: the input radius in m
+a2: the output radius in m
+alphacorrection: the factor applied to the attenuation coefficient
+m: the return batch (of at least n matrices)
+*/
+void tubeElementBatch(const double *f, int n, const TubeElement *e,
+                      TransferMatrixBatch m);
+/*
+Calculates the transfer matrices for a compiled cylindrical tube at n
+frequencies. Equivalent to tubeElementMatrix.
+Parameters:
+f: the frequencies in Hz
+n: the number of frequencies
+e: the TubeElement of the tube
+m: the return batch (of at least n matrices)
+*/
+void coneElementBatch(const double *f, int n, const ConeElement *e,
+                      TransferMatrixBatch m);
+/*
+Calculates the transfer matrices for a compiled conical section at n
+frequencies. Equivalent to coneMatrixBatch.
+Parameters:
+f: the frequencies in Hz
+n: the number of frequencies
+e: the ConeElement of the section
+m: the return batch (of at least n matrices)
+*/
+#endif
@@ -0,0 +1,163 @@
+/*
+AcousticsKernel.h
+The frequency-batched tube and cone kernels used by AcousticsBatch.c.
+This file is included once for each vector width, with KERNEL_WIDTH
+(the number of frequencies per vector) and KERNEL_SUFFIX (appended to
+every name) defined, and with the matching target options in force
+(refer to KernelVector.h).
+*/
+#include "Acoustics.h"
+#include "KernelVector.h"
+#include "TransferMatrix.h"
+#include <math.h>
+/* pi/2 split into three parts for exact argument reduction */
+#define PIO2_1 1.57079625129699707031E0
+#define PIO2_2 7.54978941586159635335E-8
+#define PIO2_3 5.39030285815811905290E-15
+/* ln 2 split into two parts */
+#define LN2_1 6.93145751953125E-1
+#define LN2_2 1.42860682030941723212E-6
+/* sine and cosine (Cody-Waite reduction to [-pi/4, pi/4] and the
+Cephes minimax polynomials) */
+static inline void KERNEL(sincosv)(vdouble x, vdouble *s, vdouble *c) {
+  vdouble t = x * M_2_PI + ROUND_MAGIC;
+  vdouble q = t - ROUND_MAGIC;
+  vlong quadrant = (vlong)t;
+  vdouble r = ((x - q * PIO2_1) - q * PIO2_2) - q * PIO2_3;
+  vdouble z = r * r;
+  vdouble sr, cr;
+  vlong swap;
+  sr = 1.58962301576546568060E-10 * z - 2.50507477628578072866E-8;
+  sr = sr * z + 2.75573136213857245213E-6;
+  sr = sr * z - 1.98412698295895385996E-4;
+  sr = sr * z + 8.33333333332211858878E-3;
+  sr = sr * z - 1.66666666666666307295E-1;
+  sr = r + r * z * sr;
+  cr = -1.13585365213876817300E-11 * z + 2.08757008419747316778E-9;
+  cr = cr * z - 2.75573141792967388112E-7;
+  cr = cr * z + 2.48015872888517045348E-5;
+  cr = cr * z - 1.38888888888730564116E-3;
+  cr = cr * z + 4.16666666666665929218E-2;
+  cr = 1.0 - 0.5 * z + z * z * cr;
+  /* odd quadrants swap sine and cosine; the sign comes from bit 1 */
+  swap = -(quadrant & 1);
+  *s = KERNEL(selectv)(swap, cr, sr);
+  *c = KERNEL(selectv)(swap, sr, cr);
+  *s = (vdouble)((vlong)*s ^ ((quadrant & 2) << 62));
+  *c = (vdouble)((vlong)*c ^ (((quadrant + 1) & 2) << 62));
+}
+/* exponential (Cephes Pade approximation, for |x| < 700) */
+static inline vdouble KERNEL(expv)(vdouble x) {
+  vdouble magic = x * 0.0 + ROUND_MAGIC;
+  vdouble t = x * M_LOG2E + magic;
+  vdouble n = t - magic;
+  vlong scale = ((vlong)t - (vlong)magic + 1023) << 52;
+  vdouble xx, px, qx;
+  x = (x - n * LN2_1) - n * LN2_2;
+  xx = x * x;
+  px = 1.26177193074810590878E-4 * xx + 3.02994407707441961300E-2;
+  px = (px * xx + 9.99999999999999999910E-1) * x;
+  qx = 3.00198505138664455042E-6 * xx + 2.52448340349684104192E-3;
+  qx = qx * xx + 2.27265548208155028766E-1;
+  qx = qx * xx + 2.00000000000000000009E0;
+  x = 1.0 + 2.0 * px / (qx - px);
+  return x * (vdouble)scale;
+}
+/* wave number k (as in waveNum) given f and sqrt(f) */
+static inline void KERNEL(waveNumv)(vdouble f, vdouble sf, double c, double a,
+                                    double alphacorrection, vdouble *kRe,
+                                    vdouble *kIm) {
+  *kRe = (2 * M_PI * f) / (c * (1.0 - 1.65e-3 / (a * sf)));
+  *kIm = -(alphacorrection * (3.0e-5 * sf) / a);
+}
+static void KERNEL(tubeKernel)(const double *f, int n, const TubeElement *e,
+                               TransferMatrixBatch m) {
+  double c = e->c, L = e->L, a = e->a, alphacorrection = e->alphacorrection;
+  complex Zo = e->Zo;
+  complex Yo = divz(one, Zo);
+  double rootf[KERNEL_WIDTH];
+  vdouble vf, sf, kRe, kIm, X, Y, E, chX, shX, sinY, cosY, shRe, shIm;
+  int i, l, lanes;
+  for (i = 0; i < n; i += KERNEL_WIDTH) {
+    lanes = (n - i < KERNEL_WIDTH) ? n - i : KERNEL_WIDTH;
+    vf = KERNEL(loadv)(f + i, lanes);
+    for (l = 0; l < KERNEL_WIDTH; l++)
+      rootf[l] = sqrt(vf[l]);
+    sf = KERNEL(loadv)(rootf, KERNEL_WIDTH);
+    KERNEL(waveNumv)(vf, sf, c, a, alphacorrection, &kRe, &kIm);
+    /* jkL = X + jY */
+    X = -kIm * L;
+    Y = kRe * L;
+    E = KERNEL(expv)(X);
+    chX = (E + 1.0 / E) * 0.5;
+    shX = (E - 1.0 / E) * 0.5;
+    KERNEL(sincosv)(Y, &sinY, &cosY);
+    /* A = D = cosh(jkL), sinh(jkL) = shRe + j shIm */
+    shRe = shX * cosY;
+    shIm = chX * sinY;
+    KERNEL(storev)(m->ARe + i, chX * cosY, lanes);
+    KERNEL(storev)(m->AIm + i, shX * sinY, lanes);
+    KERNEL(storev)(m->DRe + i, chX * cosY, lanes);
+    KERNEL(storev)(m->DIm + i, shX * sinY, lanes);
+    KERNEL(storev)(m->BRe + i, Zo.Re * shRe - Zo.Im * shIm, lanes);
+    KERNEL(storev)(m->BIm + i, Zo.Re * shIm + Zo.Im * shRe, lanes);
+    KERNEL(storev)(m->CRe + i, Yo.Re * shRe - Yo.Im * shIm, lanes);
+    KERNEL(storev)(m->CIm + i, Yo.Re * shIm + Yo.Im * shRe, lanes);
+  }
+}
+static void KERNEL(coneKernel)(const double *f, int n, const ConeElement *e,
+                               TransferMatrixBatch m) {
+  double c = e->c, L = e->L, a = e->a, alphacorrection = e->alphacorrection;
+  double x1 = e->x1, x2 = e->x2;
+  double rootf[KERNEL_WIDTH];
+  vdouble vf, sf, kRe, kIm, E, chq, shq, sinp, cosp;
+  vdouble sinRe, sinIm, cosRe, cosIm, k2, i1Re, i1Im, i2Re, i2Im;
+  vdouble gRe, gIm, uRe, uIm, tRe, tIm;
+  int i, l, lanes;
+  for (i = 0; i < n; i += KERNEL_WIDTH) {
+    lanes = (n - i < KERNEL_WIDTH) ? n - i : KERNEL_WIDTH;
+    vf = KERNEL(loadv)(f + i, lanes);
+    for (l = 0; l < KERNEL_WIDTH; l++)
+      rootf[l] = sqrt(vf[l]);
+    sf = KERNEL(loadv)(rootf, KERNEL_WIDTH);
+    KERNEL(waveNumv)(vf, sf, c, a, alphacorrection, &kRe, &kIm);
+    /* sin(kL) and cos(kL), with kL = p + jq */
+    E = KERNEL(expv)(kIm * L);
+    chq = (E + 1.0 / E) * 0.5;
+    shq = (E - 1.0 / E) * 0.5;
+    KERNEL(sincosv)(kRe * L, &sinp, &cosp);
+    sinRe = sinp * chq;
+    sinIm = cosp * shq;
+    cosRe = cosp * chq;
+    cosIm = -sinp * shq;
+    /* cot(theta1) = 1/(k x1) and cot(theta2) = 1/(k x2) */
+    k2 = kRe * kRe + kIm * kIm;
+    i1Re = kRe / (k2 * x1);
+    i1Im = -kIm / (k2 * x1);
+    i2Re = kRe / (k2 * x2);
+    i2Im = -kIm / (k2 * x2);
+    /* A = cos(kL) - sin(kL) cot(theta2) */
+    KERNEL(storev)(m->ARe + i, cosRe - (sinRe * i2Re - sinIm * i2Im), lanes);
+    KERNEL(storev)(m->AIm + i, cosIm - (sinRe * i2Im + sinIm * i2Re), lanes);
+    /* B = j (rho c / S2) sin(kL) */
+    KERNEL(storev)(m->BRe + i, -e->BScale * sinIm, lanes);
+    KERNEL(storev)(m->BIm + i, e->BScale * sinRe, lanes);
+    /* C = j (S1 / rho c) (sin(kL) (1 + cot(theta1) cot(theta2)) +
+    cos(kL) (cot(theta2) - cot(theta1))) */
+    gRe = 1.0 + i1Re * i2Re - i1Im * i2Im;
+    gIm = i1Re * i2Im + i1Im * i2Re;
+    uRe = i2Re - i1Re;
+    uIm = i2Im - i1Im;
+    tRe = sinRe * gRe - sinIm * gIm + cosRe * uRe - cosIm * uIm;
+    tIm = sinRe * gIm + sinIm * gRe + cosRe * uIm + cosIm * uRe;
+    KERNEL(storev)(m->CRe + i, -e->CScale * tIm, lanes);
+    KERNEL(storev)(m->CIm + i, e->CScale * tRe, lanes);
+    /* D = (S1 / S2) (cos(kL) + sin(kL) cot(theta1)) */
+    KERNEL(storev)(m->DRe + i,
+                   e->DScale * (cosRe + sinRe * i1Re - sinIm * i1Im), lanes);
+    KERNEL(storev)(m->DIm + i,
+                   e->DScale * (cosIm + sinRe * i1Im + sinIm * i1Re), lanes);
+  }
+}
+#undef vdouble
+#undef vlong
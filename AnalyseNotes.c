@@ -19,6 +19,9 @@ int main(int argc, char **argv) {
     fprintf(stdout, "Usage: AnalyseNotes [OPTIONS] <filename>\n\n");
     fprintf(stderr, " Options:\n");
     fprintf(stderr, "\t-h (Displays harmonicity data)\n\n");
+    fprintf(stderr, " <filename>:\n");
+    fprintf(stderr, "\t- An impedance table, or - to read it from the\n");
+    fprintf(stderr, "\t standard input.\n\n");
     return -1;
   }
   /* perform analysis on impedance data file */
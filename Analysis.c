@@ -11,43 +11,88 @@ notes. See Analysis.h for interface details.
 #include "ParseImpedance.h"
 #include "Point.h"
 #include "Vector.h"
+#include <limits.h>
 #include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 void Analysis(char *filename, int applypitchcorrection, int displayharmonicity,
               AnalysisType at) {
-  Vector fileData = createVector(), seriesData, minv;
-  int midi;
-  Minimum m;
-  int i;
-  int series;
-  /* read and parse data file into a Vector of Vectors of Points */
-  if (!parseImpedanceFile(fileData, filename)) {
+  ImpedanceStream stream;
+  ExtremaDetector *detectors;
+  double x, *y;
+  int series, n;
+  /* open the data file and read its midi numbers */
+  if ((stream = openImpedanceStream(filename)) == NULL) {
     fprintf(stderr, "AnalyseNotes error: ");
     fprintf(stderr, "AnalyseNotes failed to parse impedance file.\n");
     return;
   }
-  for (series = 0; series < sizeVector(fileData); series++) {
-    seriesData = (Vector)elementAt(fileData, series);
-    midi = *((int *)elementAt(seriesData, 0));
-    popFront(seriesData);
-    /* evaluate all minima in the data */
-    minv = minima(seriesData);
-    /* print MIDI number */
-    printf("%d\t", midi);
-    /* determine playable minima */
-    for (i = 0; i < sizeVector(minv); i++) {
-      m = (Minimum)elementAt(minv, i);
-      /* evaluate musical note from frequency (do not round) */
-      m->note = note(m->f, 0);
-      if (m->note->midi == midi)
-        analyseNote(m, applypitchcorrection, displayharmonicity, at == NOTES);
-    }
-    printf("\n");
+  /* one extremum detector per series, fed as each row is read, so that
+  only a window of each spectrum is held in memory */
+  detectors = (ExtremaDetector *)malloc(
+      (stream->numSeries > 0 ? stream->numSeries : 1) *
+      sizeof(ExtremaDetector));
+  y = (double *)malloc((stream->numSeries > 0 ? stream->numSeries : 1) *
+                       sizeof(double));
+  for (series = 0; series < stream->numSeries; series++)
+    detectors[series] = createExtremaDetector();
+  while ((n = readImpedanceRow(stream, &x, y)) >= 0) {
+    for (series = 0; series < n; series++)
+      detectExtrema(detectors[series], x, y[series]);
+  }
+  if (n == -2) {
+    fprintf(stderr, "File %s is invalid\n", filename);
+    fprintf(stderr, "AnalyseNotes error: ");
+    fprintf(stderr, "AnalyseNotes failed to parse impedance file.\n");
+  }
+  /* analyse each series from its extrema */
+  for (series = 0; series < stream->numSeries; series++) {
+    if (n != -2)
+      analyseExtrema(stream->midi[series],
+                     detectedExtrema(detectors[series]),
+                     applypitchcorrection, displayharmonicity, at);
+    freeExtremaDetector(detectors[series]);
   }
+  free(detectors);
+  free(y);
+  closeImpedanceStream(stream);
   return;
 }
+void analyseSpectrum(int midi, Vector points, int applypitchcorrection,
+                     int displayharmonicity, AnalysisType at) {
+  analyseExtrema(midi, extrema(points), applypitchcorrection,
+                 displayharmonicity, at);
+}
+void analyseExtrema(int midi, Vector extv, int applypitchcorrection,
+                    int displayharmonicity, AnalysisType at) {
+  Vector minv;
+  Minimum m;
+  double *f;
+  Note *notes;
+  int i, n;
+  /* evaluate all minima in the data */
+  minv = extremaMinima(extv);
+  n = sizeVector(minv);
+  /* evaluate musical notes from frequencies (do not round) */
+  f = (double *)malloc((n > 0 ? n : 1) * sizeof(double));
+  notes = (Note *)malloc((n > 0 ? n : 1) * sizeof(Note));
+  for (i = 0; i < n; i++)
+    f[i] = ((Minimum)elementAt(minv, i))->f;
+  notesBatch(f, n, 0, notes);
+  /* print MIDI number */
+  printf("%d\t", midi);
+  /* determine playable minima */
+  for (i = 0; i < n; i++) {
+    m = (Minimum)elementAt(minv, i);
+    m->note = notes[i];
+    if ((m->note.name != NULL) && (m->note.midi == midi))
+      analyseNote(m, applypitchcorrection, displayharmonicity, at == NOTES);
+  }
+  printf("\n");
+  free(f);
+  free(notes);
+}
 int analyseNote(Minimum m, int applypitchcorrection, int displayharmonicity,
                 int output) {
   /* determine if Minimum is playable */
@@ -61,17 +106,17 @@ int analyseNote(Minimum m, int applypitchcorrection, int displayharmonicity,
     pitchCorrection(m);
   /* evaluate musical note from frequency (do not round) */
   m->note = note(m->f, 0);
-  if (m->note == NULL)
+  if (m->note.name == NULL)
     return 0;
   else {
     if (output) {
       /* output notes */
       if (displayharmonicity)
         printf("%.1f\t%.1f\t%.1f\t%d\t%.1f\t%.0f\t%.1f", playability, strength,
-               m->f, m->note->cents, m->Z, m->numharm, m->meanharmZ);
+               m->f, m->note.cents, m->Z, m->numharm, m->meanharmZ);
       else
         printf("%.1f\t%.1f\t%.1f\t%d\t%.1f", playability, strength, m->f,
-               m->note->cents, m->Z);
+               m->note.cents, m->Z);
     }
     return 1;
   }
@@ -260,55 +305,191 @@ void pitchCorrection(Minimum m) {
     f = fcalc * pow(2.0, -125.0 / 1200.0) * pow(fcalc / 233.0, 2.6 / 100.0);
   m->f = f;
 }
-void analyseMultiphonics2(Vector playableminv) {
-  int i, j;
+/* the number of bits in a word of a bitset */
+#define WORD_BITS ((int)(CHAR_BIT * sizeof(unsigned long)))
+/* the number of words of a bitset of n bits */
+#define BITSET_WORDS(n) (((n) + WORD_BITS - 1) / WORD_BITS)
+/* the range of midi numbers of the presence bitmap */
+#define MIDI_RANGE 128
+static int testBit(const unsigned long *set, int bit) {
+  return (set[bit / WORD_BITS] >> (bit % WORD_BITS)) & 1UL;
+}
+static void setBit(unsigned long *set, int bit) {
+  set[bit / WORD_BITS] |= 1UL << (bit % WORD_BITS);
+}
+/* the index of the lowest bit set in a nonzero word */
+static int lowestBit(unsigned long w) {
+  int bit = 0;
+  while (!(w & 1UL)) {
+    w >>= 1;
+    bit++;
+  }
+  return bit;
+}
+/* sets the bitmap of the midi numbers of the playable minima */
+static void midiPresence(Vector playableminv,
+                         unsigned long present[BITSET_WORDS(MIDI_RANGE)]) {
+  int i, midi;
+  for (i = 0; i < BITSET_WORDS(MIDI_RANGE); i++)
+    present[i] = 0UL;
+  for (i = 0; i < sizeVector(playableminv); i++) {
+    midi = ((Minimum)elementAt(playableminv, i))->note.midi;
+    if ((midi >= 0) && (midi < MIDI_RANGE))
+      setBit(present, midi);
+  }
+}
+/* whether a midi number is in the presence bitmap */
+static int midiPresent(const unsigned long *present, int midi) {
+  return (midi >= 0) && (midi < MIDI_RANGE) && testBit(present, midi);
+}
+/* whether two notes are harmonic, given the bitmap of the midi numbers
+of the playable notes */
+static int harmonicMidis(int midi1, int midi2, const unsigned long *present) {
+  int dmidi;
+  int num_harmonic_midis = 11;
+  int harmonic_midis[] = {0, 12, 19, 24, 28, 31, 33, 34, 36, 38, 40};
+  /* calculate number of semitones between two minima */
+  dmidi = midi2 - midi1;
+  /* if the minima are directly harmonically related (integer
+  frequency ratio) */
+  if (inArray(harmonic_midis, num_harmonic_midis, dmidi))
+    return 1;
+  /* if the minima have a common playable fundamental */
+  if ((dmidi == 7 || dmidi == 16 || dmidi == 21 || dmidi == 22 ||
+       dmidi == 26) &&
+      midiPresent(present, midi1 - 12))
+    return 1;
+  if ((dmidi == 5 || dmidi == 9 || dmidi == 14 || dmidi == 15 || dmidi == 17 ||
+       dmidi == 21) &&
+      midiPresent(present, midi1 - 19))
+    return 1;
+  if ((dmidi == 4 || dmidi == 7 || dmidi == 9 || dmidi == 10 || dmidi == 14 ||
+       dmidi == 16) &&
+      midiPresent(present, midi1 - 24))
+    return 1;
+  if ((dmidi == 3 || dmidi == 5 || dmidi == 6 || dmidi == 8 || dmidi == 10) &&
+      midiPresent(present, midi1 - 28))
+    return 1;
+  if ((dmidi == 2 || dmidi == 3 || dmidi == 5 || dmidi == 7 || dmidi == 9) &&
+      midiPresent(present, midi1 - 31))
+    return 1;
+  if ((dmidi == 3 || dmidi == 5 || dmidi == 7) &&
+      midiPresent(present, midi1 - 33))
+    return 1;
+  if ((dmidi == 2 || dmidi == 4 || dmidi == 6) &&
+      midiPresent(present, midi1 - 34))
+    return 1;
+  if ((dmidi == 2 || dmidi == 4) && midiPresent(present, midi1 - 36))
+    return 1;
+  if (dmidi == 2 && midiPresent(present, midi1 - 38))
+    return 1;
+  /* otherwise, not harmonic */
+  return 0;
+}
+/* computes the harmonic relation of the playable minima of a fingering
+once: row i of the returned matrix, of the given number of words per
+row, has bit j set if j > i and minima i and j are harmonic */
+static unsigned long *harmonicRelation(Vector playableminv, int *words) {
+  int n = sizeVector(playableminv);
+  unsigned long present[BITSET_WORDS(MIDI_RANGE)];
+  unsigned long *relation;
   Minimum m1, m2;
-  Vector minv;
-  /* for each possible pair of playable notes */
-  for (i = 0; i < sizeVector(playableminv) - 1; i++) {
+  int i, j;
+  *words = BITSET_WORDS(n > 0 ? n : 1);
+  relation = (unsigned long *)calloc((n > 0 ? n : 1) * *words,
+                                     sizeof(unsigned long));
+  midiPresence(playableminv, present);
+  for (i = 0; i < n; i++) {
     m1 = (Minimum)elementAt(playableminv, i);
-    for (j = i + 1; j < sizeVector(playableminv); j++) {
+    for (j = i + 1; j < n; j++) {
       m2 = (Minimum)elementAt(playableminv, j);
-      /* if the notes are not harmonic, output */
-      if (!harmonic(m1, m2, playableminv)) {
-        minv = createVector();
-        addElement(minv, m1);
-        addElement(minv, m2);
-        printf("%s\t%d\t%s\t%d\t%d\t%d\t%s\n", m1->note->name, m1->note->midi,
-               m2->note->name, m2->note->midi,
-               noteDistance(m1, m2, playableminv), pitchIndex(minv),
-               allNotes(playableminv));
+      if (harmonicMidis(m1->note.midi, m2->note.midi, present))
+        setBit(relation + i * *words, j);
+    }
+  }
+  return relation;
+}
+void analyseMultiphonics2(Vector playableminv) {
+  int n = sizeVector(playableminv);
+  int words, w, i, j;
+  unsigned long *relation = harmonicRelation(playableminv, &words);
+  unsigned long pairs;
+  char *all_notes = allNotes(playableminv);
+  Minimum m1, m2;
+  Vector minv = createVector();
+  /* the pair, for pitchIndex */
+  addElement(minv, NULL);
+  addElement(minv, NULL);
+  /* for each possible pair of playable notes that are not harmonic,
+  output */
+  for (i = 0; i < n - 1; i++) {
+    m1 = (Minimum)elementAt(playableminv, i);
+    for (w = (i + 1) / WORD_BITS; w < words; w++) {
+      pairs = ~relation[i * words + w];
+      /* the notes after i and before the end */
+      if (w == (i + 1) / WORD_BITS)
+        pairs &= ~0UL << ((i + 1) % WORD_BITS);
+      if ((w == words - 1) && (n % WORD_BITS != 0))
+        pairs &= ~(~0UL << (n % WORD_BITS));
+      for (; pairs != 0UL; pairs &= pairs - 1UL) {
+        j = w * WORD_BITS + lowestBit(pairs);
+        m2 = (Minimum)elementAt(playableminv, j);
+        setAt(minv, m1, 0);
+        setAt(minv, m2, 1);
+        printf("%s\t%d\t%s\t%d\t%d\t%d\t%s\n", m1->note.name, m1->note.midi,
+               m2->note.name, m2->note.midi, j - i, pitchIndex(minv),
+               all_notes);
       }
     }
   }
+  freeVector(minv);
+  free(all_notes);
+  free(relation);
 }
 void analyseMultiphonics3(Vector playableminv) {
-  int i, j, k;
+  int n = sizeVector(playableminv);
+  int words, w, i, j, k;
+  unsigned long *relation = harmonicRelation(playableminv, &words);
+  unsigned long trios;
+  char *all_notes = allNotes(playableminv);
   Minimum m1, m2, m3;
-  Vector minv;
-  /* for each possible trio of playable notes */
-  for (i = 0; i < sizeVector(playableminv) - 2; i++) {
+  Vector minv = createVector();
+  /* the trio, for pitchIndex */
+  addElement(minv, NULL);
+  addElement(minv, NULL);
+  addElement(minv, NULL);
+  /* for each possible pair of playable notes that are not harmonic... */
+  for (i = 0; i < n - 2; i++) {
     m1 = (Minimum)elementAt(playableminv, i);
-    for (j = i + 1; j < sizeVector(playableminv) - 1; j++) {
+    for (j = i + 1; j < n - 1; j++) {
+      if (testBit(relation + i * words, j))
+        continue;
       m2 = (Minimum)elementAt(playableminv, j);
-      for (k = j + 1; k < sizeVector(playableminv); k++) {
-        m3 = (Minimum)elementAt(playableminv, k);
-        /* if all pairs of the trio are not harmonic, output */
-        if (!harmonic(m1, m2, playableminv) &&
-            !harmonic(m2, m3, playableminv) &&
-            !harmonic(m1, m3, playableminv)) {
-          minv = createVector();
-          addElement(minv, m1);
-          addElement(minv, m2);
-          addElement(minv, m3);
-          printf("%s\t%d\t%s\t%d\t%s\t%d\t%d\t%d\t%s\n", m1->note->name,
-                 m1->note->midi, m2->note->name, m2->note->midi, m3->note->name,
-                 m3->note->midi, noteDistance(m1, m3, playableminv),
-                 pitchIndex(minv), allNotes(playableminv));
+      /* ...the third notes harmonic with neither of them, a word of
+      candidates at a time */
+      for (w = (j + 1) / WORD_BITS; w < words; w++) {
+        trios = ~(relation[i * words + w] | relation[j * words + w]);
+        if (w == (j + 1) / WORD_BITS)
+          trios &= ~0UL << ((j + 1) % WORD_BITS);
+        if ((w == words - 1) && (n % WORD_BITS != 0))
+          trios &= ~(~0UL << (n % WORD_BITS));
+        for (; trios != 0UL; trios &= trios - 1UL) {
+          k = w * WORD_BITS + lowestBit(trios);
+          m3 = (Minimum)elementAt(playableminv, k);
+          setAt(minv, m1, 0);
+          setAt(minv, m2, 1);
+          setAt(minv, m3, 2);
+          printf("%s\t%d\t%s\t%d\t%s\t%d\t%d\t%d\t%s\n", m1->note.name,
+                 m1->note.midi, m2->note.name, m2->note.midi,
+                 m3->note.name, m3->note.midi, k - i, pitchIndex(minv),
+                 all_notes);
         }
       }
     }
   }
+  freeVector(minv);
+  free(all_notes);
+  free(relation);
 }
 int noteDistance(Minimum m1, Minimum m2, Vector playableminv) {
   int i;
@@ -335,7 +516,7 @@ int pitchIndex(Vector minv) {
   /* calculate sum of squares of cents */
   for (i = 0; i < sizeVector(minv); i++) {
     m = (Minimum)elementAt(minv, i);
-    index = index + (m->note->cents) * (m->note->cents);
+    index = index + (m->note.cents) * (m->note.cents);
   }
   return index;
 }
@@ -343,72 +524,30 @@ char *allNotes(Vector playableminv) {
   int i;
   Minimum m;
   char *all_notes = (char *)malloc(BUFSIZ * sizeof(char));
+  char *note_string;
   /* for each note that is playable, concatenate into
   one string delimited by a ';' */
   for (i = 0; i < sizeVector(playableminv); i++) {
     m = (Minimum)elementAt(playableminv, i);
+    note_string = noteString(m->note);
     if (i == 0)
-      sprintf(all_notes, noteString(m->note));
+      strcpy(all_notes, note_string);
     else {
       strcat(all_notes, ";");
-      strcat(all_notes, noteString(m->note));
+      strcat(all_notes, note_string);
     }
+    free(note_string);
   }
   /* return concatenated string */
   return all_notes;
 }
 int harmonic(Minimum m1, Minimum m2, Vector playableminv) {
-  int i;
-  Minimum m;
-  int n = sizeVector(playableminv);
-  int midis[n];
-  int dmidi;
-  int num_harmonic_midis = 11;
-  int harmonic_midis[] = {0, 12, 19, 24, 28, 31, 33, 34, 36, 38, 40};
+  unsigned long present[BITSET_WORDS(MIDI_RANGE)];
   /* get the midi numbers of all playable minima. The difference in
   midi number of two notes is the number of semitones between
   them. */
-  for (i = 0; i < n; i++) {
-    m = (Minimum)elementAt(playableminv, i);
-    midis[i] = m->note->midi;
-  }
-  /* calculate number of semitones between two minima */
-  dmidi = m2->note->midi - m1->note->midi;
-  /* if the minima are directly harmonically related (integer
-  frequency ratio) */
-  if (inArray(harmonic_midis, num_harmonic_midis, dmidi))
-    return 1;
-  /* if the minima have a common playable fundamental */
-  if ((dmidi == 7 || dmidi == 16 || dmidi == 21 || dmidi == 22 ||
-       dmidi == 26) &&
-      inArray(midis, n, m1->note->midi - 12))
-    return 1;
-  if ((dmidi == 5 || dmidi == 9 || dmidi == 14 || dmidi == 15 || dmidi == 17 ||
-       dmidi == 21) &&
-      inArray(midis, n, m1->note->midi - 19))
-    return 1;
-  if ((dmidi == 4 || dmidi == 7 || dmidi == 9 || dmidi == 10 || dmidi == 14 ||
-       dmidi == 16) &&
-      inArray(midis, n, m1->note->midi - 24))
-    return 1;
-  if ((dmidi == 3 || dmidi == 5 || dmidi == 6 || dmidi == 8 || dmidi == 10) &&
-      inArray(midis, n, m1->note->midi - 28))
-    return 1;
-  if ((dmidi == 2 || dmidi == 3 || dmidi == 5 || dmidi == 7 || dmidi == 9) &&
-      inArray(midis, n, m1->note->midi - 31))
-    return 1;
-  if ((dmidi == 3 || dmidi == 5 || dmidi == 7) &&
-      inArray(midis, n, m1->note->midi - 33))
-    return 1;
-  if ((dmidi == 2 || dmidi == 4 || dmidi == 6) &&
-      inArray(midis, n, m1->note->midi - 34))
-    return 1;
-  if ((dmidi == 2 || dmidi == 4) && inArray(midis, n, m1->note->midi - 36))
-    return 1;
-  if (dmidi == 2 && inArray(midis, n, m1->note->midi - 38))
-    return 1;
-  /* otherwise, not harmonic */
-  return 0;
+  midiPresence(playableminv, present);
+  return harmonicMidis(m1->note.midi, m2->note.midi, present);
 }
 int inArray(int *array, int size, int num) {
   int i;
@@ -14,9 +14,42 @@ void Analysis(char *filename, int applypitchcorrection, int displayharmonicity,
               AnalysisType at);
 /*
 Performs an analysis of the given impedance data file, sending
-the required analysis results to stdout.
+the required analysis results to stdout. The file is read one row at a
+time, each series feeding its own ExtremaDetector, so that the memory
+used grows with the number of series but not with their length; the
+results are sent at the end of the file.
 Parameters:
-filename: the filename of the impedance data file
+filename: the filename of the impedance data file ("-" for the
+standard input)
+applypitchcorrection: boolean to flag the use of pitch correction
+displayharmonicity: boolean to flag output of harmonicity data
+at: the type of analysis (notes, two note multiphonics or
+three note multiphonics)
+*/
+void analyseSpectrum(int midi, Vector points, int applypitchcorrection,
+                     int displayharmonicity, AnalysisType at);
+/*
+Performs the analysis of a single impedance spectrum held in memory,
+sending the results for the fingering to stdout in the same format as
+Analysis.
+Parameters:
+midi: the MIDI number of the fingering
+points: a Vector of Points (frequency in Hz, impedance in dB) in
+increasing order of frequency
+applypitchcorrection: boolean to flag the use of pitch correction
+displayharmonicity: boolean to flag output of harmonicity data
+at: the type of analysis (notes, two note multiphonics or
+three note multiphonics)
+*/
+void analyseExtrema(int midi, Vector extv, int applypitchcorrection,
+                    int displayharmonicity, AnalysisType at);
+/*
+Performs the analysis of a single impedance spectrum from its extrema,
+as found by extrema or an ExtremaDetector, sending the results for the
+fingering to stdout in the same format as Analysis.
+Parameters:
+midi: the MIDI number of the fingering
+extv: a Vector of Extremum structs
 applypitchcorrection: boolean to flag the use of pitch correction
 displayharmonicity: boolean to flag output of harmonicity data
 at: the type of analysis (notes, two note multiphonics or
@@ -89,7 +122,8 @@ void analyseMultiphonics2(Vector playableminv);
 Determines if any two note multiphonics are playable in a set of
 playable notes for a fingering. Multiphonics are defined as notes
 which are "not harmonically related" (see code for details).
-Ouputs the multiphonic if so.
+Ouputs the multiphonic if so. The harmonic relation of every pair of
+notes is computed once into a bitset matrix.
 Parameters:
 playableminv: the set of playable minima for a fingering
 */
@@ -98,7 +132,9 @@ void analyseMultiphonics3(Vector playableminv);
 Determines if any three note multiphonics are playable in a set of
 playable notes for a fingering. Multiphonics are defined as notes
 which are "not harmonically related" (see code for details).
-Ouputs the multiphonic if so.
+Ouputs the multiphonic if so. The harmonic relation of every pair of
+notes is computed once into a bitset matrix, and the third notes of
+each pair are found a word of the matrix at a time.
 Parameters:
 playableminv: the set of playable minima for a fingering
 */
@@ -0,0 +1,26 @@
+/*
+BatchDispatch.h
+The run time choice between the AVX-512, AVX2 and scalar versions of
+the batched kernels (refer to KernelVector.h).
+*/
+#ifndef BATCHDISPATCH_H_PROTECTOR
+#define BATCHDISPATCH_H_PROTECTOR
+/* on x86 the kernels are also compiled for AVX-512 and AVX2 and chosen
+at run time */
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define BATCH_DISPATCH
+#endif
+enum { BATCH_SCALAR, BATCH_AVX2, BATCH_AVX512 };
+/* the widest kernel set supported by this processor (only reads the
+processor model, so is safe to call from several threads) */
+static inline int batchLevel(void) {
+#ifdef BATCH_DISPATCH
+  if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+    if (__builtin_cpu_supports("avx512f"))
+      return BATCH_AVX512;
+    return BATCH_AVX2;
+  }
+#endif
+  return BATCH_SCALAR;
+}
+#endif
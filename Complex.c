@@ -4,6 +4,8 @@ By Andrew Botros, 2000-2004
 Hyperbolic trig fns and expz added by Paul Dickens, 2005
 Complex arithmetic library.
 Refer to Complex.h for interface details.
+The dual functions differentiate by the chain rule, sharing the
+transcendental functions between the value and the derivative.
 Refer to the following for algebraic expressions:
 Brown, J.W., Churchill, R.W., 1996.
 Complex Variables and Applications.
@@ -100,4 +102,76 @@ complex sqrtz(complex z1) {
   theta = theta / 2;
   return multz(real(A), expjz(real(theta)));
 }
+dualcomplex dualz(complex v, complex d) {
+  dualcomplex u;
+  u.v = v;
+  u.d = d;
+  return u;
+}
+dualcomplex constdz(complex z) { return dualz(z, zero); }
+dualcomplex adddz(dualcomplex u1, dualcomplex u2) {
+  return dualz(addz(u1.v, u2.v), addz(u1.d, u2.d));
+}
+dualcomplex subdz(dualcomplex u1, dualcomplex u2) {
+  return dualz(subz(u1.v, u2.v), subz(u1.d, u2.d));
+}
+dualcomplex multdz(dualcomplex u1, dualcomplex u2) {
+  return dualz(multz(u1.v, u2.v),
+               addz(multz(u1.d, u2.v), multz(u1.v, u2.d)));
+}
+dualcomplex scaledz(complex z, dualcomplex u1) {
+  return dualz(multz(z, u1.v), multz(z, u1.d));
+}
+dualcomplex divdz(dualcomplex u1, dualcomplex u2) {
+  /* (u1 / u2)' = (u1' - (u1 / u2) u2') / u2 */
+  complex q = divz(u1.v, u2.v);
+  return dualz(q, divz(subz(u1.d, multz(q, u2.d)), u2.v));
+}
+dualcomplex expdz(dualcomplex u1) {
+  complex e = expz(u1.v);
+  return dualz(e, multz(e, u1.d));
+}
+/* sets cosh and sinh of z from a single pair of exponentials */
+static void coshsinhz(complex z, complex *c, complex *s) {
+  complex e = expz(z), e_inv = divz(one, e);
+  *c = multz(real(0.5), addz(e, e_inv));
+  *s = multz(real(0.5), subz(e, e_inv));
+}
+dualcomplex coshdz(dualcomplex u1) {
+  complex c, s;
+  coshsinhz(u1.v, &c, &s);
+  return dualz(c, multz(s, u1.d));
+}
+dualcomplex sinhdz(dualcomplex u1) {
+  complex c, s;
+  coshsinhz(u1.v, &c, &s);
+  return dualz(s, multz(c, u1.d));
+}
+dualcomplex cosdz(dualcomplex u1) {
+  complex c, s;
+  /* cos z = cosh jz, sin z = -j sinh jz */
+  coshsinhz(multz(j, u1.v), &c, &s);
+  s = multz(imaginary(-1.0), s);
+  return dualz(c, multz(real(-1.0), multz(s, u1.d)));
+}
+dualcomplex sindz(dualcomplex u1) {
+  complex c, s;
+  coshsinhz(multz(j, u1.v), &c, &s);
+  s = multz(imaginary(-1.0), s);
+  return dualz(s, multz(c, u1.d));
+}
+dualcomplex tandz(dualcomplex u1) {
+  complex c, s, t;
+  coshsinhz(multz(j, u1.v), &c, &s);
+  t = divz(multz(imaginary(-1.0), s), c);
+  /* (tan z)' = 1 + tan^2 z */
+  return dualz(t, multz(addz(one, multz(t, t)), u1.d));
+}
+dualcomplex logdz(dualcomplex u1) {
+  return dualz(logz(u1.v), divz(u1.d, u1.v));
+}
+dualcomplex arctandz(dualcomplex u1) {
+  return dualz(arctanz(u1.v),
+               divz(u1.d, addz(one, multz(u1.v, u1.v))));
+}
 void printComplex(complex z) { printf("%e%+ei", z.Re, z.Im); }
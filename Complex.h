@@ -11,6 +11,13 @@ typedef struct complex_str {
   double Re;
   double Im;
 } complex;
+/* dualcomplex: { value, derivative }, a complex function of a real
+variable together with its derivative, which the dual functions
+propagate by the chain rule */
+typedef struct dualcomplex_str {
+  complex v;
+  complex d;
+} dualcomplex;
 /* externally defined complex numbers zero, one, j and inf for
 convenience */
 extern complex zero;
@@ -170,6 +177,117 @@ z1: given complex number.
 Returns:
 The square root of z1.
 */
+dualcomplex dualz(complex v, complex d);
+/*
+Parameters:
+v: given value.
+d: given derivative.
+Returns:
+A dualcomplex struct with value v and derivative d
+*/
+dualcomplex constdz(complex z);
+/*
+Parameters:
+z: given complex number.
+Returns:
+A dualcomplex struct with value z and derivative 0
+*/
+dualcomplex adddz(dualcomplex u1, dualcomplex u2);
+/*
+Parameters:
+u1: given dualcomplex number.
+u2: given dualcomplex number.
+Returns:
+u1 + u2 ... The sum of u1 and u2
+*/
+dualcomplex subdz(dualcomplex u1, dualcomplex u2);
+/*
+Parameters:
+u1: given dualcomplex number.
+u2: given dualcomplex number.
+Returns:
+u1 - u2 ... u2 subtracted from u1
+*/
+dualcomplex multdz(dualcomplex u1, dualcomplex u2);
+/*
+Parameters:
+u1: given dualcomplex number.
+u2: given dualcomplex number.
+Returns:
+u1 x u2 ... The product of u1 and u2
+*/
+dualcomplex scaledz(complex z, dualcomplex u1);
+/*
+Parameters:
+z: given complex constant.
+u1: given dualcomplex number.
+Returns:
+z x u1 ... The product of the constant z and u1
+*/
+dualcomplex divdz(dualcomplex u1, dualcomplex u2);
+/*
+Parameters:
+u1: given dualcomplex number.
+u2: given dualcomplex number.
+Returns:
+u1 / u2 ... u1 divided by u2
+*/
+dualcomplex expdz(dualcomplex u1);
+/*
+Parameters:
+u1: given dualcomplex number.
+Returns:
+exp(u1) ... The complex exponential of u1
+*/
+dualcomplex coshdz(dualcomplex u1);
+/*
+Parameters:
+u1: given dualcomplex number.
+Returns:
+cosh u1 ... The complex hyperbolic cosine of u1
+*/
+dualcomplex sinhdz(dualcomplex u1);
+/*
+Parameters:
+u1: given dualcomplex number.
+Returns:
+sinh u1 ... The complex hyperbolic sine of u1
+*/
+dualcomplex cosdz(dualcomplex u1);
+/*
+Parameters:
+u1: given dualcomplex number.
+Returns:
+cos u1 ... The complex cosine of u1
+*/
+dualcomplex sindz(dualcomplex u1);
+/*
+Parameters:
+u1: given dualcomplex number.
+Returns:
+sin u1 ... The complex sine of u1
+*/
+dualcomplex tandz(dualcomplex u1);
+/*
+Parameters:
+u1: given dualcomplex number.
+Returns:
+tan u1 ... The complex tan of u1
+*/
+dualcomplex logdz(dualcomplex u1);
+/*
+Parameters:
+u1: given dualcomplex number.
+Returns:
+log u1 ... The complex principal logarithm of u1
+*/
+dualcomplex arctandz(dualcomplex u1);
+/*
+Parameters:
+u1: given dualcomplex number.
+Returns:
+arctan u1 ... The complex inverse tan of u1
+*/
 void printComplex(complex z);
 /*
 Prints a complex struct to stdout.
@@ -0,0 +1,71 @@
+/*
+FrequencyGrid.c
+A uniform frequency grid addressed by integer bin indices, and dense
+per-bin caches of transfer matrices computed on such a grid.
+Refer to FrequencyGrid.h for interface details.
+*/
+#include "FrequencyGrid.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+/* fraction of fres within which a frequency lies on a bin */
+#define BIN_TOLERANCE 1.0e-6
+FrequencyGrid createFrequencyGrid(double flo, double fhi, double fres) {
+  FrequencyGrid g = (FrequencyGrid)malloc(sizeof(*g));
+  double f;
+  int bin;
+  g->flo = flo;
+  g->fres = fres;
+  /* step exactly as the sweep loops always have, rounding included */
+  g->numBins = 0;
+  for (f = flo; f <= fhi; f += fres)
+    g->numBins++;
+  g->f = (double *)malloc((g->numBins > 0 ? g->numBins : 1) * sizeof(double));
+  for (f = flo, bin = 0; bin < g->numBins; f += fres, bin++)
+    g->f[bin] = f;
+  return g;
+}
+double gridFrequency(FrequencyGrid g, int bin) {
+  return g->f[bin];
+}
+int frequencyBin(FrequencyGrid g, double f) {
+  double position = (f - g->flo) / g->fres;
+  int bin = (int)floor(position + 0.5);
+  if ((bin < 0) || (bin >= g->numBins) ||
+      (fabs(f - g->f[bin]) > BIN_TOLERANCE * g->fres))
+    return -1;
+  return bin;
+}
+void freeFrequencyGrid(FrequencyGrid g) {
+  if (g == NULL)
+    return;
+  free(g->f);
+  free(g);
+}
+SpectralCache createSpectralCache(FrequencyGrid g) {
+  SpectralCache c = (SpectralCache)malloc(sizeof(*c));
+  c->numBins = g->numBins;
+  c->matrix = (TransferMatrix *)malloc(g->numBins * sizeof(TransferMatrix));
+  c->cached = (char *)calloc(g->numBins, sizeof(char));
+  return c;
+}
+int getCachedMatrix(SpectralCache c, int bin, TransferMatrix *m) {
+  if (!c->cached[bin])
+    return 0;
+  *m = c->matrix[bin];
+  return 1;
+}
+void putCachedMatrix(SpectralCache c, int bin, TransferMatrix m) {
+  c->matrix[bin] = m;
+  c->cached[bin] = 1;
+}
+void clearSpectralCache(SpectralCache c) {
+  memset(c->cached, 0, c->numBins * sizeof(char));
+}
+void freeSpectralCache(SpectralCache c) {
+  if (c == NULL)
+    return;
+  free(c->matrix);
+  free(c->cached);
+  free(c);
+}
@@ -0,0 +1,105 @@
+/*
+FrequencyGrid.h
+A uniform frequency grid addressed by integer bin indices, and dense
+per-bin caches of transfer matrices computed on such a grid.
+*/
+#ifndef FREQUENCYGRID_H_PROTECTOR
+#define FREQUENCYGRID_H_PROTECTOR
+#include "TransferMatrix.h"
+/* FrequencyGrid: { lowest frequency, resolution, number of bins,
+frequency of each bin } */
+typedef struct frequencygrid_str {
+  double flo;
+  double fres;
+  int numBins;
+  double *f;
+} * FrequencyGrid;
+/* SpectralCache: { number of bins, one matrix per bin, whether each
+bin holds a matrix } */
+typedef struct spectralcache_str {
+  int numBins;
+  TransferMatrix *matrix;
+  char *cached;
+} * SpectralCache;
+FrequencyGrid createFrequencyGrid(double flo, double fhi, double fres);
+/*
+Creates a new FrequencyGrid with bins at flo, flo + fres, flo +
+2 fres, ... up to and including fhi. The frequencies are accumulated by
+repeated addition of fres, as a loop "for (f = flo; f <= fhi; f +=
+fres)" would step, so the grid has the same bins and frequencies as
+such a loop (it may stop one bin short of fhi when fhi - flo is a
+multiple of fres).
+Parameters:
+flo: the frequency of bin 0 in Hz
+fhi: the highest frequency in Hz
+fres: the spacing of the bins in Hz
+Returns:
+a new FrequencyGrid with the given parameters
+*/
+double gridFrequency(FrequencyGrid g, int bin);
+/*
+Returns the frequency of a bin.
+Parameters:
+g: the FrequencyGrid
+bin: the bin index
+Returns:
+the frequency of the bin in Hz
+*/
+int frequencyBin(FrequencyGrid g, double f);
+/*
+Finds the bin of a frequency. Frequencies within a millionth of the
+resolution of the frequency of a bin are taken to lie on it, so that
+frequencies computed as flo + bin * fres still map onto the grid.
+Parameters:
+g: the FrequencyGrid
+f: the frequency in Hz
+Returns:
+the bin index
+-1 if f does not lie on the grid
+*/
+void freeFrequencyGrid(FrequencyGrid g);
+/*
+Frees a FrequencyGrid.
+Parameters:
+g: the FrequencyGrid (may be NULL)
+*/
+SpectralCache createSpectralCache(FrequencyGrid g);
+/*
+Creates an empty SpectralCache with one entry per bin of a grid.
+Parameters:
+g: the FrequencyGrid
+Returns:
+a new SpectralCache
+*/
+int getCachedMatrix(SpectralCache c, int bin, TransferMatrix *m);
+/*
+Retrieves the matrix cached for a bin.
+Parameters:
+c: the SpectralCache
+bin: the bin index
+m: the return variable for the cached matrix
+Returns:
+1 if a matrix has been cached for the bin
+0 otherwise
+*/
+void putCachedMatrix(SpectralCache c, int bin, TransferMatrix m);
+/*
+Caches a matrix for a bin, replacing any matrix previously cached.
+Parameters:
+c: the SpectralCache
+bin: the bin index
+m: the TransferMatrix
+*/
+void clearSpectralCache(SpectralCache c);
+/*
+Removes all the matrices from a SpectralCache.
+Parameters:
+c: the SpectralCache
+*/
+void freeSpectralCache(SpectralCache c);
+/*
+Frees a SpectralCache.
+Parameters:
+c: the SpectralCache (may be NULL)
+*/
+#endif
@@ -4,14 +4,45 @@ By Paul Dickens, 2005
 Physical model of the acoustic impedance of a flute.
 */
 #include "ParseXML.h"
+#include "Sampling.h"
 #include "Woodwind.h"
+#include "WoodwindProgram.h"
 #include <math.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+/* Sweep: a spectrum shared between the worker threads { instrument,
+entry ratio, number of frequencies, frequencies, impedances, index of
+the next batch to calculate, lock on the index } */
+typedef struct sweep_str {
+  Woodwind instrument;
+  double entryratio;
+  int numFreqs;
+  const double *f;
+  complex *Z;
+  int nextBatch;
+  pthread_mutex_t lock;
+} Sweep;
+/* Spectrum: the instruments evaluated by evaluateSpectrum { instrument,
+the instrument with every segment halved (NULL unless extrapolating),
+entry ratio, number of threads } */
+typedef struct spectrum_str {
+  Woodwind instrument;
+  Woodwind fine;
+  double entryratio;
+  int threads;
+} Spectrum;
 int parseCommandLine(int argc, char **argv, char **holestring, double *temp,
                      double *humid, double *flo, double *fhi, double *fres,
-                     double *entryratio, char **xml_filename);
+                     double *entryratio, int *threads, double *maxLength,
+                     char **sampling, char **xml_filename);
+int prepareInstrument(char *xml_filename, char *holestring, double temp,
+                      double humid, double entryratio, double maxLength,
+                      int halve, Woodwind *instrument);
+void calculateSweep(Sweep *sweep, int threads);
+void *sweepWorker(void *arg);
+void evaluateSpectrum(const double *f, int n, complex *Z, void *context);
 /* Default parameter values */
 #define TEMP 25.0
 #define HUMID 0.5
@@ -20,16 +51,23 @@ int parseCommandLine(int argc, char **argv, char **holestring, double *temp,
 #define FHI 4000.0
 #define FRES 2.0
 #define ENTRYRATIO 1.0
+#define THREADS 1
+/* Number of frequencies calculated together */
+#define BATCH_SIZE 256
 int main(int argc, char **argv) {
   char *holestring;
   double temp, humid;
-  double f, flo, fhi, fres, entryratio;
-  char *xml_filename;
-  Woodwind instrument;
-  complex Z;
+  double flo, fhi, fres, entryratio, maxLength;
+  char *xml_filename, *spec;
+  Spectrum spectrum;
+  FrequencyGrid grid;
+  Sampling sampling;
+  complex *Z;
+  int i, threads;
   /* check correct usage */
   if (!parseCommandLine(argc, argv, &holestring, &temp, &humid, &flo, &fhi,
-                        &fres, &entryratio, &xml_filename)) {
+                        &fres, &entryratio, &threads, &maxLength, &spec,
+                        &xml_filename)) {
     fprintf(stderr, "Usage: Impedance [OPTIONS] <XML file>\n\n");
     fprintf(stderr, " Options:\n");
     fprintf(stderr, "\t-s <holestring>\n");
@@ -38,7 +76,12 @@ int main(int argc, char **argv) {
     fprintf(stderr, "\t-l <flo> (default 100.0)\n");
     fprintf(stderr, "\t-h <fhi> (default 4000.0)\n");
     fprintf(stderr, "\t-r <fres> (default 2.0)\n");
-    fprintf(stderr, "\t-e <entryratio> (default 1.0)\n\n");
+    fprintf(stderr, "\t-e <entryratio> (default 1.0)\n");
+    fprintf(stderr, "\t-j <threads> (default 1)\n");
+    fprintf(stderr, "\t-x <segment length> (Richardson extrapolation from\n");
+    fprintf(stderr, "\t   this and half this length, adding a column with\n");
+    fprintf(stderr, "\t   the error estimate; default off)\n");
+    fprintf(stderr, "\t-g <sampling> (default uniform)\n\n");
     fprintf(stderr, " <holestring>:\n");
     fprintf(stderr, "\t- Optional if no holes are defined in XML file.\n");
     fprintf(stderr, "\t- Must be a sequence of 'O' (open hole) ");
@@ -46,40 +89,162 @@ int main(int argc, char **argv) {
     fprintf(stderr,
             "\t- Length must be equal to the number of defined holes.\n");
     fprintf(stderr, "\t- e.g. \"XXOOOOOOXOOOOXOOO\"\n\n");
+    fprintf(stderr, " <sampling>:\n");
+    fprintf(stderr, "\t- \"uniform\": every fres Hz from flo up to fhi.\n");
+    fprintf(stderr, "\t- \"log:<n>\": n frequencies per octave.\n");
+    fprintf(stderr, "\t- \"piecewise:<f0>:<res0>:<f1>:...:<fn>\": every\n");
+    fprintf(stderr, "\t  res_i Hz from f_i to f_i+1.\n");
+    fprintf(stderr, "\t- \"adaptive:<tolerance>\": refined down to fres\n");
+    fprintf(stderr, "\t  only where the spectrum bends by more than\n");
+    fprintf(stderr, "\t  tolerance dB, or has a peak or dip.\n\n");
+    return -1;
+  }
+  if (!prepareInstrument(xml_filename, holestring, temp, humid, entryratio,
+                         maxLength, 0, &spectrum.instrument))
     return -1;
+  /* the same instrument with every segment halved, for extrapolation */
+  spectrum.fine = NULL;
+  if ((maxLength > 0.0) &&
+      !prepareInstrument(xml_filename, holestring, temp, humid, entryratio,
+                         maxLength, 1, &spectrum.fine))
+    return -1;
+  spectrum.entryratio = entryratio;
+  spectrum.threads = threads;
+  /* choose the frequencies in spectrum range, and calculate the
+  impedances (with the fine values when extrapolating) */
+  grid = createFrequencyGrid(flo, fhi, fres);
+  sampling = createSampling(grid, spec, (spectrum.fine != NULL) ? 2 : 1,
+                            evaluateSpectrum, &spectrum);
+  if (sampling == NULL) {
+    fprintf(stderr, "Impedance error: \"%s\" is an invalid sampling.\n",
+            (spec != NULL) ? spec : "uniform");
+    return -1;
+  }
+  evaluateSampling(sampling, evaluateSpectrum, &spectrum);
+  if (sampling->numEvaluations < grid->numBins)
+    fprintf(stderr, "Impedance: evaluated %d of %d frequencies\n",
+            sampling->numEvaluations, grid->numBins);
+  /* print output in frequency order */
+  for (i = 0; i < sampling->numSamples; i++) {
+    Z = sampling->Z + i * sampling->numValues;
+    if (spectrum.fine == NULL)
+      printf("%e\t%e\t%e\n", sampling->f[i], Z[0].Re, Z[0].Im);
+    else
+      printf("%e\t%e\t%e\t%e\n", sampling->f[i], Z[0].Re, Z[0].Im,
+             modz(subz(Z[0], Z[1])));
   }
+  return 0;
+}
+int prepareInstrument(char *xml_filename, char *holestring, double temp,
+                      double humid, double entryratio, double maxLength,
+                      int halve, Woodwind *instrument) {
+  int merged;
   /* retrieve data structures from XML file */
-  if (!parseXMLFile(xml_filename, &instrument)) {
+  if (!parseXMLFile(xml_filename, instrument)) {
     fprintf(stderr, "Impedance error: Impedance failed to parse XML file.\n");
-    return -1;
+    return 0;
   }
+  if (maxLength > 0.0)
+    discretiseWoodwind(*instrument, maxLength);
+  if (halve)
+    halveWoodwind(*instrument);
   /* set the air properties (speed of sound, density) for each
   segment */
-  setAirProperties(instrument, temp, temp, 0, humid, X_CO2);
+  setAirProperties(*instrument, temp, temp, 0, humid, X_CO2);
+  /* at a uniform temperature, merge the bore pieces which are
+  acoustically one segment (only cylinders when extrapolating, so that
+  the cones keep the segment lengths) */
+  merged = coalesceWoodwind(*instrument,
+                            (maxLength > 0.0) ? 0.0 : WW_MAX_LENGTH);
+  if (merged > 0)
+    fprintf(stderr, "Impedance: merged %d bore segments\n", merged);
+  /* precompute the frequency-independent terms of every element */
+  compileWoodwind(*instrument, entryratio);
   /* set fingering from holestring and validate */
-  if (!setFingering(instrument, holestring)) {
+  if (!setFingering(*instrument, holestring)) {
     fprintf(stderr, "Impedance error: \"%s\" ", holestring);
     fprintf(stderr,
             "is an invalid fingering for the given woodwind definition.\n");
-    return -1;
+    return 0;
   }
-  /* for each frequency in spectrum range... */
-  for (f = flo; f <= fhi; f += fres) {
-    /* calculate impedance */
-    Z = impedance(f, instrument, entryratio);
-    /* print output */
-    printf("%e\t%e\t%e\n", f, Z.Re, Z.Im);
+  return 1;
+}
+void calculateSweep(Sweep *sweep, int threads) {
+  pthread_t *workers;
+  int i;
+  /* calculate the impedances, in batches shared between the threads
+  (the instrument is only read) */
+  sweep->nextBatch = 0;
+  pthread_mutex_init(&sweep->lock, NULL);
+  if (threads == 1)
+    sweepWorker(sweep);
+  else {
+    workers = (pthread_t *)malloc(threads * sizeof(pthread_t));
+    for (i = 0; i < threads; i++)
+      pthread_create(&workers[i], NULL, sweepWorker, sweep);
+    for (i = 0; i < threads; i++)
+      pthread_join(workers[i], NULL);
+    free(workers);
   }
-  return 0;
+  pthread_mutex_destroy(&sweep->lock);
+}
+void *sweepWorker(void *arg) {
+  Sweep *sweep = (Sweep *)arg;
+  int first, n;
+  for (;;) {
+    /* take the next batch */
+    pthread_mutex_lock(&sweep->lock);
+    first = sweep->nextBatch * BATCH_SIZE;
+    sweep->nextBatch++;
+    pthread_mutex_unlock(&sweep->lock);
+    if (first >= sweep->numFreqs)
+      return NULL;
+    n = sweep->numFreqs - first;
+    if (n > BATCH_SIZE)
+      n = BATCH_SIZE;
+    impedanceBatch(sweep->f + first, n, sweep->instrument, sweep->entryratio,
+                   sweep->Z + first);
+  }
+}
+void evaluateSpectrum(const double *f, int n, complex *Z, void *context) {
+  Spectrum *spectrum = (Spectrum *)context;
+  Sweep sweep;
+  complex *coarseZ, *fineZ;
+  int i;
+  sweep.instrument = spectrum->instrument;
+  sweep.entryratio = spectrum->entryratio;
+  sweep.numFreqs = n;
+  sweep.f = f;
+  if (spectrum->fine == NULL) {
+    sweep.Z = Z;
+    calculateSweep(&sweep, spectrum->threads);
+    return;
+  }
+  /* recalculate with every segment halved, and store the extrapolated
+  and the fine values */
+  coarseZ = (complex *)malloc((n > 0 ? n : 1) * sizeof(complex));
+  fineZ = (complex *)malloc((n > 0 ? n : 1) * sizeof(complex));
+  sweep.Z = coarseZ;
+  calculateSweep(&sweep, spectrum->threads);
+  sweep.instrument = spectrum->fine;
+  sweep.Z = fineZ;
+  calculateSweep(&sweep, spectrum->threads);
+  for (i = 0; i < n; i++) {
+    Z[2 * i] = richardsonExtrapolate(coarseZ[i], fineZ[i]);
+    Z[2 * i + 1] = fineZ[i];
+  }
+  free(coarseZ);
+  free(fineZ);
 }
 int parseCommandLine(int argc, char **argv, char **holestring, double *temp,
                      double *humid, double *flo, double *fhi, double *fres,
-                     double *entryratio, char **xml_filename) {
+                     double *entryratio, int *threads, double *maxLength,
+                     char **sampling, char **xml_filename) {
   int i;
   double d;
   int sflag = 0, tflag = 0, uflag = 0, lflag = 0, hflag = 0, rflag = 0,
-      eflag = 0;
-  int numoptions = 7, numinputfiles = 1;
+      eflag = 0, jflag = 0, xflag = 0, gflag = 0;
+  int numoptions = 10, numinputfiles = 1;
   int minargc = 1 + numinputfiles;
   int maxargc = minargc + 2 * numoptions;
   /* Check correct number of parameters */
@@ -93,6 +258,9 @@ int parseCommandLine(int argc, char **argv, char **holestring, double *temp,
   *fhi = FHI;
   *fres = FRES;
   *entryratio = ENTRYRATIO;
+  *threads = THREADS;
+  *maxLength = 0.0;
+  *sampling = NULL;
   /* Check and set options */
   for (i = 1; i < (argc - numinputfiles); i += 2) {
     if (strcmp(argv[i], "-s") == 0) {
@@ -168,6 +336,35 @@ int parseCommandLine(int argc, char **argv, char **holestring, double *temp,
       eflag = 1;
       continue;
     }
+    if (strcmp(argv[i], "-j") == 0) {
+      if (jflag)
+        return 0;
+      *threads = atoi(argv[i + 1]);
+      if (*threads < 1) {
+        fprintf(stderr, "Invalid -j option\n");
+        return 0;
+      }
+      jflag = 1;
+      continue;
+    }
+    if (strcmp(argv[i], "-x") == 0) {
+      if (xflag)
+        return 0;
+      *maxLength = atof(argv[i + 1]);
+      if (*maxLength <= 0.0) {
+        fprintf(stderr, "Invalid -x option\n");
+        return 0;
+      }
+      xflag = 1;
+      continue;
+    }
+    if (strcmp(argv[i], "-g") == 0) {
+      if (gflag)
+        return 0;
+      *sampling = argv[i + 1];
+      gflag = 1;
+      continue;
+    }
     /* else invalid option */
     fprintf(stderr, "Invalid option: %s\n", argv[i]);
     return 0;
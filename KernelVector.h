@@ -0,0 +1,49 @@
+/*
+KernelVector.h
+The vector types and helpers shared by the batched kernels
+(AcousticsKernel.h, NoteKernel.h). A kernel file includes this once for
+each vector width, with KERNEL_WIDTH (the number of doubles per vector)
+and KERNEL_SUFFIX (appended to every name) defined, and undefines
+vdouble and vlong at its end. Vectors use the GCC vector extensions, so
+the same source serves as the AVX-512, AVX2 and scalar kernels.
+*/
+#include <string.h>
+#define KERNEL_PASTE2(name, suffix) name##suffix
+#define KERNEL_PASTE(name, suffix) KERNEL_PASTE2(name, suffix)
+#define KERNEL(name) KERNEL_PASTE(name, KERNEL_SUFFIX)
+typedef double KERNEL(vdouble)
+    __attribute__((vector_size(KERNEL_WIDTH * sizeof(double))));
+typedef long long KERNEL(vlong)
+    __attribute__((vector_size(KERNEL_WIDTH * sizeof(long long))));
+#define vdouble KERNEL(vdouble)
+#define vlong KERNEL(vlong)
+/* adding and subtracting 1.5 * 2^52 rounds to the nearest integer,
+leaving the integer in the low bits of the sum */
+#define ROUND_MAGIC 6755399441055744.0
+/* loads a vector from lanes doubles, repeating the last (a whole
+vector is loaded directly) */
+static inline vdouble KERNEL(loadv)(const double *src, int lanes) {
+  double buffer[KERNEL_WIDTH];
+  vdouble v;
+  int l;
+  if (lanes == KERNEL_WIDTH) {
+    memcpy(&v, src, sizeof(v));
+    return v;
+  }
+  for (l = 0; l < KERNEL_WIDTH; l++)
+    buffer[l] = src[(l < lanes) ? l : lanes - 1];
+  memcpy(&v, buffer, sizeof(v));
+  return v;
+}
+/* stores the first lanes elements of a vector (a whole vector is
+stored directly, rather than by a call to memcpy) */
+static inline void KERNEL(storev)(double *dst, vdouble v, int lanes) {
+  if (lanes == KERNEL_WIDTH)
+    memcpy(dst, &v, sizeof(v));
+  else
+    memcpy(dst, &v, lanes * sizeof(double));
+}
+/* selects a where mask is set, b elsewhere */
+static inline vdouble KERNEL(selectv)(vlong mask, vdouble a, vdouble b) {
+  return (vdouble)(((vlong)a & mask) | ((vlong)b & ~mask));
+}
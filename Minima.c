@@ -4,8 +4,10 @@ By Andrew Botros, 2001-2004.
 Modified by Paul Dickens, 2006-2007.
 Characterises the minima of acoustic impedance spectra.
 Refer to Minima.h for interface details.
-IMPORTANT: Calculations are optimised for a spectrum resolution of
-2Hz.
+The detection and fitting of extrema are defined by spans in Hz
+rather than numbers of points, so that spectra of other resolutions,
+or sampled nonuniformly, give the same extrema as at the 2Hz
+resolution the spans were tuned for.
 NOTE: The weighting of the frequency of an impedance extremum fit to
 favour the absolute emtremum has been changed to an option in the
 function 'parabolaExt' with a default of 0 (no weighting). A block
@@ -25,11 +27,19 @@ when the next point to be considered is equal to the previous one
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-/* number of data points approximated around each minimum */
-#define NUM_POINTS 11
-/* number of points which must be consecutively increasing or
-decreasing to define the spectrum as rising or dropping. */
-#define TWEAK 5
+/* span in Hz over which the spectrum must be consecutively increasing
+or decreasing to define it as rising or dropping. */
+#define TWEAK_SPAN 10.0
+/* span in Hz of the data points approximated around each extremum */
+#define FIT_SPAN 20.0
+/* least number of data points approximated around each extremum,
+widening the span of coarsely sampled spectra */
+#define MIN_FIT_POINTS 3
+/* tolerance in Hz of comparisons of spans */
+#define SPAN_TOLERANCE 1.0e-6
+/* number of slides of a window after which its running sums are
+recomputed */
+#define RESET_SLIDES 11
 /* weight fit to absolute extremum? */
 #define WEIGHT 0
 /* to evaluate harmonics, a window is defined around the frequency f
@@ -40,9 +50,9 @@ harmonics. */
 /* maximum number of harmonics used to calculate average impedance of
 harmonics */
 #define HARMONICS_AVERAGED 3
-Vector minima(Vector allpoints) {
+Vector minima(Vector allpoints) { return extremaMinima(extrema(allpoints)); }
+Vector extremaMinima(Vector extv) {
   int i, j;
-  Vector extv = extrema(allpoints);
   Extremum e, searche;
   Minimum m;
   Vector minv = createVector();
@@ -119,180 +129,389 @@ Vector minima(Vector allpoints) {
   harmonicity(minv);
   return minv;
 }
-Vector extrema(Vector allpoints) {
-  int i, j;
-  int seq_inc, seq_dec;
+/* the running sums over a window of weighted data points, of powers of
+x measured from a reference point near the window and of y times them */
+typedef struct moments_str {
+  double ref;
+  double x[5];
+  double xy[3];
+  int slides;
+} Moments;
+/* adds a point of weight w to the running sums (a negative weight
+removes it) */
+static void addMoment(Moments *m, Point p, double w) {
+  double u = p->x - m->ref;
+  double u2 = u * u;
+  m->x[0] += w;
+  m->x[1] += w * u;
+  m->x[2] += w * u2;
+  m->x[3] += w * u2 * u;
+  m->x[4] += w * u2 * u2;
+  m->xy[0] += w * p->y;
+  m->xy[1] += w * u * p->y;
+  m->xy[2] += w * u2 * p->y;
+}
+/* empties the running sums, measuring x from ref */
+static void clearMoments(Moments *m, double ref) {
+  int i;
+  m->ref = ref;
+  for (i = 0; i < 5; i++)
+    m->x[i] = 0.0;
+  for (i = 0; i < 3; i++)
+    m->xy[i] = 0.0;
+}
+/* recomputes the running sums of a window of equally weighted points
+about its last point */
+static void resetMoments(Moments *m, Vector points) {
+  int i;
+  clearMoments(m, ((Point)elementAt(points, sizeVector(points) - 1))->x);
+  for (i = 0; i < sizeVector(points); i++)
+    addMoment(m, (Point)elementAt(points, i), 1.0);
+  m->slides = 0;
+}
+/* fits the parabola y = a + b t + c t^2 by weighted least squares, t
+being x less the mean x of the window, setting the mean and returning
+0 if the fit is singular */
+static int fitMoments(const Moments *m, double *mean, double *a, double *b,
+                      double *c) {
+  double n = m->x[0], u = m->x[1] / n, u2 = u * u;
+  /* the sums of powers of t, and of y times them */
+  double t2 = m->x[2] - u * m->x[1];
+  double t3 = m->x[3] - 3.0 * u * m->x[2] + 2.0 * u2 * m->x[1];
+  double t4 = m->x[4] - 4.0 * u * m->x[3] + 6.0 * u2 * m->x[2] -
+              3.0 * u2 * u * m->x[1];
+  double y0 = m->xy[0];
+  double y1 = m->xy[1] - u * m->xy[0];
+  double y2 = m->xy[2] - 2.0 * u * m->xy[1] + u2 * m->xy[0];
+  /* the normal equations, with sum t = 0, solved by Cramer's rule */
+  double delta = n * (t2 * t4 - t3 * t3) - t2 * t2 * t2;
+  if (delta == 0.0)
+    return 0;
+  *mean = m->ref + u;
+  *a = (y0 * (t2 * t4 - t3 * t3) + t2 * (y1 * t3 - y2 * t2)) / delta;
+  *b = (n * (y1 * t4 - y2 * t3) + t2 * (y0 * t3 - y1 * t2)) / delta;
+  *c = (n * (t2 * y2 - t3 * y1) - t2 * t2 * y0) / delta;
+  return 1;
+}
+/* evaluates the extremum of a window of points from its running sums */
+static Extremum momentsExt(const Moments *m, Vector points, minmax type,
+                           int weight) {
+  Extremum ext = (Extremum)malloc(sizeof(*ext));
+  int numext;
+  double mean, a, b, c;
+  double x0, y0;
+  double absf;
+  ext->type = type;
+  ext->first = ext->last = -1;
+  if (!fitMoments(m, &mean, &a, &b, &c)) {
+    ext->f = ext->Z = ext->B = invalidNum();
+    return ext;
+  }
+  /* determine analytical extremum from parabola fit */
+  x0 = mean - b / (2.0 * c);
+  y0 = a - b * b / (4.0 * c);
+  if (weight) {
+    /* find frequency of absolute extremum in data vector */
+    absf = (type == MINIMUM) ? lowest(points) : highest(points);
+    numext = numExtrema(points, type);
+    /* if only one extremum in set, heavily weight to absolute
+    extremum */
+    if (numext == 1)
+      ext->f = (x0 * absf) / (0.95 * x0 + 0.05 * absf);
+    /* otherwise, moderately weight towards absolute extremum */
+    else
+      ext->f = (x0 * absf) / (0.75 * x0 + 0.25 * absf);
+  }
+  /* if weight is false, use fit to determine f */
+  else
+    ext->f = x0;
+  /* impedance is parabola extremum
+  bandwidth and Q factor is 3dB span of parabola */
+  ext->Z = y0;
+  ext->B = 2.0 * sqrt(((type == MINIMUM) ? 3.0 : -3.0) / c);
+  return ext;
+}
+/* Sample: a point of the window of a detector and its weight in the
+fit, the spacing in Hz from the point before it, so that the fit
+approximates the spectrum over the span of the window however densely
+its parts are sampled */
+typedef struct sample_str {
+  struct point_str p;
+  double w;
+} Sample;
+/* ExtremaDetector: { the window of samples (a ring buffer of capacity
+a power of 2, oldest first from head), its number of samples, index of
+its oldest sample among the points read, the first point read, number
+of copies of it before the window standing for the points before the
+data, running sums of the window, number of points read, spans in Hz
+increased and decreased, rising and falling flags, whether an extremum
+awaits the points after it to be fitted, its type, the frequency about
+which it is to be fitted, extrema found so far } */
+struct extremadetector_str {
+  Sample *ring;
+  int capacity, head, num;
+  int first;
+  Sample origin;
+  int padding;
+  Moments m;
+  int count;
+  double seq_inc, seq_dec;
   int descent, ascent;
-  Extremum e;
-  Point p;
-  Vector extv = createVector();
+  int pending;
+  minmax type;
+  double centre;
+  Vector extv;
+};
+ExtremaDetector createExtremaDetector(void) {
+  ExtremaDetector d = (ExtremaDetector)malloc(sizeof(*d));
+  d->capacity = 16;
+  d->ring = (Sample *)malloc(d->capacity * sizeof(Sample));
+  d->head = 0;
+  d->num = 0;
+  d->first = 0;
+  d->padding = 0;
+  d->count = 0;
+  d->seq_inc = 0.0;
+  d->seq_dec = 0.0;
+  d->descent = 0;
+  d->ascent = 0;
+  d->pending = 0;
+  d->extv = createVector();
+  return d;
+}
+/* the i-th sample of the window, oldest first */
+static Sample *sampleAt(ExtremaDetector d, int i) {
+  return &d->ring[(d->head + i) & (d->capacity - 1)];
+}
+/* appends a sample to the window, doubling its storage when full */
+static Sample *pushSample(ExtremaDetector d, double x, double y, double w) {
+  Sample *ring, *s;
+  int i;
+  if (d->num == d->capacity) {
+    ring = (Sample *)malloc(2 * d->capacity * sizeof(Sample));
+    for (i = 0; i < d->num; i++)
+      ring[i] = *sampleAt(d, i);
+    free(d->ring);
+    d->ring = ring;
+    d->capacity *= 2;
+    d->head = 0;
+  }
+  s = &d->ring[(d->head + d->num++) & (d->capacity - 1)];
+  s->p.x = x;
+  s->p.y = y;
+  s->w = w;
+  return s;
+}
+/* the number of copies of the first point which stand for the points
+before the data in a window of FIT_SPAN ending at x */
+static int paddingAt(ExtremaDetector d, double x) {
+  double n;
+  if (d->origin.w <= 0.0)
+    return 0;
+  n = (FIT_SPAN - (x - d->origin.p.x)) / d->origin.w;
+  return (n > 0.0) ? (int)floor(n + 0.5) : 0;
+}
+/* recomputes the running sums of the window about its newest point */
+static void resetWindow(ExtremaDetector d) {
+  Sample *s;
+  int i;
+  clearMoments(&d->m, sampleAt(d, d->num - 1)->p.x);
+  for (i = 0; i < d->padding; i++)
+    addMoment(&d->m, &d->origin.p, d->origin.w);
+  for (i = 0; i < d->num; i++) {
+    s = sampleAt(d, i);
+    addMoment(&d->m, &s->p, s->w);
+  }
+}
+/* slides the window of a detector onto a point dx beyond the last,
+dropping the oldest points while the rest still span FIT_SPAN and
+number at least MIN_FIT_POINTS, and updating its running sums, which
+are recomputed about the newest point every RESET_SLIDES slides so that
+the powers of x stay small and the rounding errors of the updates do
+not accumulate */
+static void slideWindow(ExtremaDetector d, double x, double y, double dx) {
+  int due = (++d->m.slides >= RESET_SLIDES);
+  int reset = due;
+  int padding;
+  Sample *s;
+  /* the first point, and its copies, weigh the first spacing */
+  if (d->count == 1) {
+    d->origin.w = dx;
+    sampleAt(d, 0)->w = dx;
+    d->padding = paddingAt(d, x);
+    reset = 1;
+  }
+  padding = paddingAt(d, x);
+  for (; d->padding > padding; d->padding--) {
+    if (!reset)
+      addMoment(&d->m, &d->origin.p, -d->origin.w);
+  }
+  while ((d->padding == 0) && (d->num >= MIN_FIT_POINTS) &&
+         (x - sampleAt(d, 1)->p.x >= FIT_SPAN - SPAN_TOLERANCE)) {
+    s = sampleAt(d, 0);
+    if (!reset)
+      addMoment(&d->m, &s->p, -s->w);
+    d->head = (d->head + 1) & (d->capacity - 1);
+    d->num--;
+    d->first++;
+  }
+  s = pushSample(d, x, y, dx);
+  if (reset)
+    resetWindow(d);
+  else
+    addMoment(&d->m, &s->p, s->w);
+  if (due)
+    d->m.slides = 0;
+}
+/* the window as a Vector of Points, for the weighting of the fit to
+the absolute extremum */
+static Vector windowPoints(ExtremaDetector d) {
   Vector points = createVector();
-  /* load vector of points with the initial portion of data.
-  All points are equal to the first point in the data. */
-  for (i = 0; i < NUM_POINTS; i++) {
-    p = (Point)malloc(sizeof(*p));
-    *p = *((Point)elementAt(allpoints, 0));
-    addElement(points, p);
+  int i;
+  for (i = 0; i < d->padding; i++)
+    addElement(points, &d->origin.p);
+  for (i = 0; i < d->num; i++)
+    addElement(points, &sampleAt(d, i)->p);
+  return points;
+}
+/* fits the pending extremum to the window, adds it to the extrema and
+resets the flags, remembering whether we're ascending or descending */
+static void fitPending(ExtremaDetector d) {
+  Vector points = WEIGHT ? windowPoints(d) : NULL;
+  Extremum e = momentsExt(&d->m, points, d->type, WEIGHT);
+  if (points != NULL)
+    freeVector(points);
+  e->first = (d->padding > 0) ? 0 : d->first;
+  e->last = d->count;
+  addElement(d->extv, e);
+  d->seq_inc = 0.0;
+  d->seq_dec = 0.0;
+  d->descent = (d->type == MAXIMUM);
+  d->ascent = (d->type == MINIMUM);
+  d->pending = 0;
+}
+/* whether the window is centred on the pending extremum (the window of
+a coarsely or unevenly sampled spectrum may have to read past the point
+which detected it) */
+static int pendingCentred(ExtremaDetector d) {
+  double oldest = (d->padding > 0) ? d->origin.p.x : sampleAt(d, 0)->p.x;
+  double newest = sampleAt(d, d->num - 1)->p.x;
+  return 0.5 * (oldest + newest) >= d->centre - SPAN_TOLERANCE;
+}
+/* an extremum of a type detected at x, after the spectrum has turned
+over a span of at least TWEAK_SPAN: fits it now if the window is
+centred on the turn, returning 0, or leaves it pending until it is,
+returning 1 */
+static int detectedAt(ExtremaDetector d, minmax type, double x,
+                      double span) {
+  d->pending = 1;
+  d->type = type;
+  d->centre = x - ((span > TWEAK_SPAN) ? span : TWEAK_SPAN);
+  if (!pendingCentred(d))
+    return 1;
+  fitPending(d);
+  return 0;
+}
+void detectExtrema(ExtremaDetector d, double x, double y) {
+  double previous, dx;
+  int rise = 1, fall = 1;
+  /* start the window with the first point, which is equal to the
+  point before it */
+  if (d->count == 0) {
+    d->origin.p.x = x;
+    d->origin.p.y = y;
+    d->origin.w = 0.0;
+    pushSample(d, x, y, 0.0);
+    d->m.slides = 1;
+    d->count++;
+    return;
   }
-  /* initialise flags */
-  seq_inc = 0;
-  seq_dec = 0;
-  descent = 0;
-  ascent = 0;
-  /* progress points one at a time till end of data set */
-  for (i = 0; progressPoints(points, allpoints, i); i++) {
-    /* if graph increases... */
-    if (((Point)elementAt(points, sizeVector(points) - 1))->y >
-        ((Point)elementAt(points, sizeVector(points) - 2))->y) {
-      /* tally number of points increased ... set flag when
-      we have moved up far enough to expect minimum/maximum */
-      seq_inc += 2;
-      if (seq_inc / 2 >= TWEAK)
-        ascent = 1;
-      if (seq_dec / 2 > 0)
-        seq_dec -= 2;
-      if (descent && ascent) {
-        /* run parabola least squares fit on points, add minimum to
-        vector */
-        for (j = 0; j < (NUM_POINTS / 2 - TWEAK); j++) {
-          progressPoints(points, allpoints, i);
-          i++;
-        }
-        e = parabolaExt(points, MINIMUM, WEIGHT);
-        if (e != NULL)
-          addElement(extv, e);
-        /* reset flags and remember we're ascending */
-        seq_inc = 0;
-        seq_dec = 0;
-        descent = 0;
-        ascent = 1;
-      }
+  previous = sampleAt(d, d->num - 1)->p.y;
+  dx = x - sampleAt(d, d->num - 1)->p.x;
+  slideWindow(d, x, y, dx);
+  /* read on until the window is centred on a pending extremum, then fit
+  it and go on comparing from the point read last */
+  if (d->pending) {
+    if (!pendingCentred(d)) {
+      d->count++;
+      return;
     }
-    /* if graph decreases... */
-    if (((Point)elementAt(points, sizeVector(points) - 1))->y <
-        ((Point)elementAt(points, sizeVector(points) - 2))->y) {
-      /* tally number of points increased ... set flag when
-      we have moved up far enough to expect minimum/maximum */
-      seq_dec += 2;
-      if (seq_dec / 2 >= TWEAK)
-        descent = 1;
-      if (seq_inc / 2 > 0)
-        seq_inc -= 2;
-      if (ascent && descent) {
-        /* run parabola least squares fit on points, add minimum to
-        vector */
-        for (j = 0; j < (NUM_POINTS / 2 - TWEAK); j++) {
-          progressPoints(points, allpoints, i);
-          i++;
-        }
-        e = parabolaExt(points, MAXIMUM, WEIGHT);
-        if (e != NULL)
-          addElement(extv, e);
-        /* reset flags and remember we're descending*/
-        seq_inc = 0;
-        seq_dec = 0;
-        descent = 1;
-        ascent = 0;
-      }
+    fitPending(d);
+    rise = 0;
+    fall = (d->type == MINIMUM);
+  }
+  /* if graph increases... */
+  if (rise && (y > previous)) {
+    /* tally span increased ... set flag when we have moved up far
+    enough to expect minimum/maximum */
+    d->seq_inc += dx;
+    if (d->seq_inc >= TWEAK_SPAN - SPAN_TOLERANCE)
+      d->ascent = 1;
+    if (d->seq_dec >= dx - SPAN_TOLERANCE)
+      d->seq_dec -= dx;
+    /* fit minimum, add it to vector */
+    if (d->descent && d->ascent && detectedAt(d, MINIMUM, x, d->seq_inc)) {
+      d->count++;
+      return;
     }
-    /* if graph neither increases nor decreases... */
-    if (((Point)elementAt(points, sizeVector(points) - 1))->y ==
-        ((Point)elementAt(points, sizeVector(points) - 2))->y) {
-      if (descent) {
-        seq_inc++;
-        seq_dec--;
-      }
-      if (ascent) {
-        seq_dec++;
-        seq_inc--;
-      }
+  }
+  /* if graph decreases... */
+  if (fall && (y < previous)) {
+    /* tally span decreased ... set flag when we have moved down far
+    enough to expect minimum/maximum */
+    d->seq_dec += dx;
+    if (d->seq_dec >= TWEAK_SPAN - SPAN_TOLERANCE)
+      d->descent = 1;
+    if (d->seq_inc >= dx - SPAN_TOLERANCE)
+      d->seq_inc -= dx;
+    /* fit maximum, add it to vector */
+    if (d->ascent && d->descent && detectedAt(d, MAXIMUM, x, d->seq_dec)) {
+      d->count++;
+      return;
     }
   }
-  return extv;
-}
-Extremum parabolaExt(Vector points, minmax type, int weight) {
-  Extremum ext = (Extremum)malloc(sizeof(*ext));
-  int numext;
-  double a, b, c, delta;
-  double x0, y0;
-  double minf;
-  double maxf;
-  /* compute least squares parabolic fit from data vector */
-  delta = det(D(points));
-  a = (1.0 / delta) * det(A(points));
-  b = (1.0 / delta) * det(B(points));
-  c = (1.0 / delta) * det(C(points));
-  if (type == MINIMUM) {
-    ext->type = MINIMUM;
-    /* determine analytical minimum from parabola fit */
-    x0 = -1.0 * (b / (2.0 * c));
-    y0 = a + b * x0 + c * x0 * x0;
-    if (weight) {
-      /* find frequency of absolute minimum in data vector */
-      minf = lowest(points);
-      numext = numExtrema(points, MINIMUM);
-      /* if only one minimum in set, heavily weight to absolute
-      minimum */
-      if (numext == 1) {
-        ext->f = (x0 * minf) / (0.95 * x0 + 0.05 * minf);
-      }
-      /* otherwise, moderately weight towards absolute minimum */
-      else {
-        ext->f = (x0 * minf) / (0.75 * x0 + 0.25 * minf);
-      }
+  /* if graph neither increases nor decreases... */
+  if (y == previous) {
+    if (d->descent) {
+      d->seq_inc += 0.5 * dx;
+      d->seq_dec -= 0.5 * dx;
     }
-    /* if weight is false, use fit to determine f */
-    else
-      ext->f = x0;
-    /* construct minimum ...
-    impedance is parabola minimum
-    bandwidth and Q factor is 3dB span of parabola */
-    ext->Z = y0;
-    ext->B =
-        2.0 * ((sqrt((y0 + 3.0 - a) / c + (b / (2.0 * c)) * (b / (2.0 * c))) -
-                (b / (2.0 * c))) -
-               x0);
-  } else {
-    ext->type = MAXIMUM;
-    /* determine analytical maximum from parabola fit */
-    x0 = -1.0 * (b / (2.0 * c));
-    y0 = a + b * x0 + c * x0 * x0;
-    if (weight) {
-      /* find frequency of absolute maximum in data vector */
-      maxf = highest(points);
-      numext = numExtrema(points, MAXIMUM);
-      /* if only one maximum in set, heavily weight to absolute
-      maximum */
-      if (numext == 1) {
-        ext->f = (x0 * maxf) / (0.95 * x0 + 0.05 * maxf);
-      }
-      /* otherwise, moderately weight towards absolute maximum */
-      else {
-        ext->f = (x0 * maxf) / (0.75 * x0 + 0.25 * maxf);
-      }
+    if (d->ascent) {
+      d->seq_dec += 0.5 * dx;
+      d->seq_inc -= 0.5 * dx;
     }
-    /* if weight is false, use fit to determine f */
-    else
-      ext->f = x0;
-    /* construct maximum
-    impedance is parabola maximum
-    bandwidth and Q factor is 3dB span of parabola */
-    ext->Z = y0;
-    ext->B =
-        2.0 * ((sqrt((y0 - 3.0 - a) / c + (b / (2.0 * c)) * (b / (2.0 * c))) -
-                (b / (2.0 * c))) -
-               x0);
   }
-  return ext;
+  d->count++;
+}
+Vector detectedExtrema(ExtremaDetector d) { return d->extv; }
+void freeExtremaDetector(ExtremaDetector d) {
+  free(d->ring);
+  free(d);
+}
+Vector extrema(Vector allpoints) {
+  ExtremaDetector d = createExtremaDetector();
+  Vector extv = d->extv;
+  Point p;
+  int i;
+  /* progress points one at a time till end of data set */
+  for (i = 0; i < sizeVector(allpoints); i++) {
+    p = (Point)elementAt(allpoints, i);
+    detectExtrema(d, p->x, p->y);
+  }
+  freeExtremaDetector(d);
+  return extv;
+}
+Extremum parabolaExt(Vector points, minmax type, int weight) {
+  Moments m;
+  resetMoments(&m, points);
+  return momentsExt(&m, points, type, weight);
 }
 int progressPoints(Vector points, Vector allpoints, int index) {
-  Point p = (Point)malloc(sizeof(*p));
   /* read points if data still in file */
   if (index < sizeVector(allpoints)) {
-    *p = *((Point)elementAt(allpoints, index));
     /* remove oldest point and add newly read point */
     popFront(points);
-    addElement(points, p);
+    addElement(points, elementAt(allpoints, index));
     return 1;
   }
   /* otherwise end of data reached */
@@ -362,39 +581,76 @@ double highest(Vector points) {
   }
   return maxf;
 }
-void harmonicity(Vector minv) {
-  int i;
-  Vector harmv;
-  /* for each Minimum in vector... */
-  for (i = 0; i < sizeVector(minv); i++) {
-    /* find all the harmonic minima of the particular Minimum */
-    harmv = harmonics(minv, i);
-    /* record the number of harmonics the Minimum has */
-    ((Minimum)elementAt(minv, i))->numharm = (double)sizeVector(harmv);
-    /* calculate and record the weighted average impedance of
-    these harmonic minima. */
-    ((Minimum)elementAt(minv, i))->meanharmZ = harmAvgZ(harmv);
+/* RankedMinimum: { a Minimum, its index in the vector of minima } */
+typedef struct rankedminimum_str {
+  Minimum m;
+  int index;
+} RankedMinimum;
+/* orders minima by frequency, then by index, with invalid frequencies
+last */
+static int compareRanked(const void *a, const void *b) {
+  const RankedMinimum *ra = (const RankedMinimum *)a;
+  const RankedMinimum *rb = (const RankedMinimum *)b;
+  int va = !isnan(ra->m->f), vb = !isnan(rb->m->f);
+  if (va != vb)
+    return vb - va;
+  if (va && (ra->m->f != rb->m->f))
+    return (ra->m->f < rb->m->f) ? -1 : 1;
+  return ra->index - rb->index;
+}
+/* sorts the minima of a vector by frequency, returning the number of
+valid frequencies, which come first */
+static int rankMinima(Vector minv, RankedMinimum *ranked) {
+  int i, n = sizeVector(minv);
+  for (i = 0; i < n; i++) {
+    ranked[i].m = (Minimum)elementAt(minv, i);
+    ranked[i].index = i;
   }
-  return;
+  qsort(ranked, n, sizeof(RankedMinimum), compareRanked);
+  for (i = 0; (i < n) && !isnan(ranked[i].m->f); i++)
+    ;
+  return i;
 }
-Vector harmonics(Vector minv, int pos) {
-  int i;
-  int harmonic;
-  double window, left_bound, right_bound;
-  double df;
-  int curharmonic;
-  int found;
-  /* get the ratios of minima frequencies following
-  the Minimum in question */
-  double *ha = harmonicsArray(minv, pos);
-  int arraysize = sizeVector(minv) - pos - 1;
-  Vector harmv = createVector();
+/* the index of the first of ranked[lo..n-1], in ascending frequency,
+whose frequency ratio to f is at least ratio (n if there is none) */
+static int firstRatio(const RankedMinimum *ranked, int lo, int n, double f,
+                      double ratio) {
+  int mid, hi = n;
+  while (lo < hi) {
+    mid = lo + (hi - lo) / 2;
+    if (ranked[mid].m->f / f < ratio)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return lo;
+}
+/* whether the last minimum of the vector has a valid frequency */
+static int lastMinimumValid(Vector minv) {
+  int n = sizeVector(minv);
+  return (n > 0) && !isnan(((Minimum)elementAt(minv, n - 1))->f);
+}
+/* searches the integer harmonic windows of the minimum of frequency f
+among the minima above it, ranked[lo..n-1] in ascending frequency, by
+bisection, choosing in each window the minimum closest to the integer
+mark (the first such, if several are equally close). A window reaching
+past the last minimum counts only if the last minimum of the vector,
+lastValid, has a valid frequency, as when the minima were scanned in
+vector order. Returns the number of harmonics, setting the weighted
+average impedance of the first HARMONICS_AVERAGED of them, and adds them
+to harmv unless it is NULL. */
+static int searchHarmonics(const RankedMinimum *ranked, int lo, int n,
+                           int lastValid, double f, double *meanharmZ,
+                           Vector harmv) {
+  int above, below, best, end, harmonic, numharm = 0;
+  double window, left_bound, right_bound, ratio;
+  double totalZ = 0.0, totalfraction = 0.0;
   Harmonic h;
-  i = 1;
-  /* search for possible integer harmonics until
-  last Minimum is reached */
+  if (lo >= n) {
+    *meanharmZ = invalidNum();
+    return 0;
+  }
   for (harmonic = 2;; harmonic++) {
-    i--;
     /* calculate a window in which harmonic will be defined.
     The widest window allowable is 0.5. */
     window = (HARMONIC_WINDOW / 100.0) * harmonic;
@@ -402,44 +658,84 @@ Vector harmonics(Vector minv, int pos) {
       window = 0.5;
     left_bound = harmonic - window;
     right_bound = harmonic + window;
-    found = 0;
-    /* search for any Minimum which exists in the defined window.
-    Compare this to previously found minima in the same
-    window, and choose the Minimum closest to the integer
-    mark as the harmonic. */
-    while (i < arraysize) {
-      if (ha[i] >= right_bound) {
-        i++;
-        break;
-      } else {
-        if ((ha[i] > left_bound) && (ha[i] < right_bound)) {
-          if (found) {
-            if (fabs(harmonic - ha[i]) < df) {
-              df = fabs(harmonic - ha[i]);
-              curharmonic = i;
-            }
-          } else {
-            df = fabs(harmonic - ha[i]);
-            curharmonic = i;
-            found = 1;
-          }
-        }
-        i++;
+    /* the closest minimum to the mark is the first at or above it or
+    the first of those equal to the last below it */
+    above = firstRatio(ranked, lo, n, f, harmonic);
+    end = firstRatio(ranked, above, n, f, right_bound);
+    best = (above < end) ? above : -1;
+    if (above > lo) {
+      below = firstRatio(ranked, lo, above, f, ranked[above - 1].m->f / f);
+      ratio = ranked[below].m->f / f;
+      if ((ratio > left_bound) &&
+          ((best < 0) || (harmonic - ratio <=
+                          ranked[best].m->f / f - harmonic)))
+        best = below;
+    }
+    /* a window reaching past the last minimum must not lie above it */
+    if ((best >= 0) &&
+        ((end < n) || (lastValid && (ranked[n - 1].m->f / f >= harmonic)))) {
+      ratio = ranked[best].m->f / f;
+      numharm++;
+      if (numharm <= HARMONICS_AVERAGED) {
+        totalZ = totalZ + ranked[best].m->Z / (int)round(ratio);
+        totalfraction = totalfraction + 1.0 / (double)(int)round(ratio);
+      }
+      if (harmv != NULL) {
+        h = (Harmonic)malloc(sizeof(*h));
+        h->n = round(ratio);
+        h->Z = ranked[best].m->Z;
+        addElement(harmv, h);
       }
     }
-    /* if a minimum is found in this window, enter the rounded off
-    integer ratio and the impedance level of the harmonic into
-    a Harmonic structure and insert this into a vector. */
-    if (found && (ha[i - 1] >= harmonic)) {
-      h = (Harmonic)malloc(sizeof(*h));
-      h->n = round(ha[curharmonic]);
-      h->Z = ((Minimum)elementAt(minv, pos + curharmonic + 1))->Z;
-      addElement(harmv, h);
+    /* the search ends once a window reaches the last minimum, even if
+    only as the first minimum beyond it */
+    if (end >= n - 1)
+      break;
+  }
+  *meanharmZ = (numharm > 0) ? totalZ / totalfraction : invalidNum();
+  return numharm;
+}
+void harmonicity(Vector minv) {
+  int n = sizeVector(minv);
+  RankedMinimum *ranked =
+      (RankedMinimum *)malloc((n > 0 ? n : 1) * sizeof(RankedMinimum));
+  int numvalid = rankMinima(minv, ranked);
+  int lastValid = lastMinimumValid(minv);
+  int i;
+  Minimum m;
+  /* for each Minimum in vector, find its harmonics among the minima
+  above it, recording their number and the weighted average impedance
+  of these harmonic minima */
+  for (i = 0; i < n; i++) {
+    m = ranked[i].m;
+    if (i < numvalid)
+      m->numharm = (double)searchHarmonics(ranked, i + 1, numvalid,
+                                          lastValid, m->f, &m->meanharmZ,
+                                          NULL);
+    else {
+      m->numharm = 0.0;
+      m->meanharmZ = invalidNum();
     }
-    /* if last Minimum reached, break */
-    if (i == arraysize)
+  }
+  free(ranked);
+  return;
+}
+Vector harmonics(Vector minv, int pos) {
+  int n = sizeVector(minv);
+  RankedMinimum *ranked =
+      (RankedMinimum *)malloc((n > 0 ? n : 1) * sizeof(RankedMinimum));
+  int numvalid = rankMinima(minv, ranked);
+  Vector harmv = createVector();
+  double meanharmZ;
+  int i;
+  for (i = 0; i < numvalid; i++) {
+    if (ranked[i].index == pos) {
+      searchHarmonics(ranked, i + 1, numvalid, lastMinimumValid(minv),
+                      ranked[i].m->f, &meanharmZ, harmv);
       break;
+    }
   }
+  free(ranked);
   /* return all found harmonics */
   return harmv;
 }
@@ -511,113 +807,3 @@ int isValidNum(double d) {
     flag = 0;
   return flag;
 }
-/* Refer to Minima.h for documentation on the following */
-double det(double **M) {
-  return ((M[1][1] * (M[2][2] * M[3][3] - M[2][3] * M[3][2])) -
-          (M[2][1] * (M[1][2] * M[3][3] - M[1][3] * M[3][2])) +
-          (M[3][1] * (M[1][2] * M[2][3] - M[1][3] * M[2][2])));
-}
-double **A(Vector points) {
-  double **M;
-  double x, y;
-  int i, j;
-  M = (double **)malloc(4 * sizeof(double *));
-  for (i = 0; i <= 3; i++)
-    M[i] = (double *)malloc(4 * sizeof(double));
-  for (i = 1; i <= 3; i++) {
-    for (j = 1; j <= 3; j++)
-      M[i][j] = 0.0;
-  }
-  for (i = 0; i < sizeVector(points); i++) {
-    x = ((Point)elementAt(points, i))->x;
-    y = ((Point)elementAt(points, i))->y;
-    M[1][1] += y;
-    M[1][2] += x;
-    M[1][3] += x * x;
-    M[2][1] += x * y;
-    M[2][2] += x * x;
-    M[2][3] += x * x * x;
-    M[3][1] += x * x * y;
-    M[3][2] += x * x * x;
-    M[3][3] += x * x * x * x;
-  }
-  return M;
-}
-double **B(Vector points) {
-  double **M;
-  double x, y;
-  int i, j;
-  M = (double **)malloc(4 * sizeof(double *));
-  for (i = 0; i <= 3; i++)
-    M[i] = (double *)malloc(4 * sizeof(double));
-  for (i = 1; i <= 3; i++) {
-    for (j = 1; j <= 3; j++)
-      M[i][j] = 0.0;
-  }
-  for (i = 0; i < sizeVector(points); i++) {
-    x = ((Point)elementAt(points, i))->x;
-    y = ((Point)elementAt(points, i))->y;
-    M[1][1] += 1.0;
-    M[1][2] += y;
-    M[1][3] += x * x;
-    M[2][1] += x;
-    M[2][2] += x * y;
-    M[2][3] += x * x * x;
-    M[3][1] += x * x;
-    M[3][2] += x * x * y;
-    M[3][3] += x * x * x * x;
-  }
-  return M;
-}
-double **C(Vector points) {
-  double **M;
-  double x, y;
-  int i, j;
-  M = (double **)malloc(4 * sizeof(double *));
-  for (i = 0; i <= 3; i++)
-    M[i] = (double *)malloc(4 * sizeof(double));
-  for (i = 1; i <= 3; i++) {
-    for (j = 1; j <= 3; j++)
-      M[i][j] = 0.0;
-  }
-  for (i = 0; i < sizeVector(points); i++) {
-    x = ((Point)elementAt(points, i))->x;
-    y = ((Point)elementAt(points, i))->y;
-    M[1][1] += 1.0;
-    M[1][2] += x;
-    M[1][3] += y;
-    M[2][1] += x;
-    M[2][2] += x * x;
-    M[2][3] += x * y;
-    M[3][1] += x * x;
-    M[3][2] += x * x * x;
-    M[3][3] += x * x * y;
-  }
-  return M;
-}
-double **D(Vector points) {
-  double **M;
-  double x, y;
-  int i, j;
-  M = (double **)malloc(4 * sizeof(double *));
-  for (i = 0; i <= 3; i++)
-    M[i] = (double *)malloc(4 * sizeof(double));
-  for (i = 1; i <= 3; i++) {
-    for (j = 1; j <= 3; j++)
-      M[i][j] = 0.0;
-  }
-  for (i = 0; i < sizeVector(points); i++) {
-    x = ((Point)elementAt(points, i))->x;
-    y = ((Point)elementAt(points, i))->y;
-    M[1][1] += 1.0;
-    M[1][2] += x;
-    M[1][3] += x * x;
-    M[2][1] += x;
-    M[2][2] += x * x;
-    M[2][3] += x * x * x;
-    M[3][1] += x * x;
-    M[3][2] += x * x * x;
-    M[3][3] += x * x * x * x;
-  }
-  return M;
-}
@@ -3,8 +3,8 @@ Minima.h
 By Andrew Botros, 2001-2004.
 Modified by Paul Dickens, 2006-2007.
 Characterises the minima of acoustic impedance spectra.
-IMPORTANT: Calculations are optimised for a spectrum resolution of
-2Hz.
+Extrema are detected and fitted over spans in Hz (refer to Minima.c),
+so the data points may be of any resolution, or spaced nonuniformly.
 NOTE: The weighting of the frequency of an impedance extremum fit to
 favour the absolute emtremum has been changed to an option in the
 function 'parabolaExt' with a default of 0 (no weighting). A block
@@ -48,13 +48,19 @@ typedef struct minimum_str {
   double R_max_df;
   double R_max_dZ;
 } * Minimum;
-/* Extremum: { max/min, frequency, impedance, bandwidth } */
+/* Extremum: { max/min, frequency, impedance, bandwidth, indices of the
+first and last data points fitted (-1 if not known) } */
 typedef struct extremum_str {
   minmax type;
   double f;
   double Z;
   double B;
+  int first;
+  int last;
 } * Extremum;
+/* ExtremaDetector: the state of extrema between data points (refer
+to Minima.c) */
+typedef struct extremadetector_str *ExtremaDetector;
 /* Harmonic:
 { harmonic number, weighted average harmonic impedance } */
 typedef struct harmonic_str {
@@ -69,6 +75,14 @@ allpoints: the vector of data points.
 Returns:
 A vector of Minimum structs.
 */
+Vector extremaMinima(Vector extv);
+/*
+Characterises the minima among the extrema of an impedance spectrum.
+Parameters:
+extv: the vector of Extremum structs, as returned by extrema.
+Returns:
+A vector of Minimum structs.
+*/
 Vector extrema(Vector allpoints);
 /*
 Evaluates the extrema in an impedance spectra data file.
@@ -77,6 +91,38 @@ allpoints: the vector of data points.
 Returns:
 A vector of Extremum structs, or NULL if bad data file.
 */
+ExtremaDetector createExtremaDetector(void);
+/*
+Creates the incremental form of extrema, which reads the data points
+one at a time and keeps only the window of them fitted to an extremum
+and the extrema found so far.
+Returns:
+A new ExtremaDetector.
+*/
+void detectExtrema(ExtremaDetector d, double x, double y);
+/*
+Reads the next data point of a spectrum, adding any extremum it
+completes to the detector's extrema.
+Parameters:
+d: the ExtremaDetector.
+x: the frequency of the point (increasing from point to point, by any
+spacing).
+y: the impedance of the point.
+*/
+Vector detectedExtrema(ExtremaDetector d);
+/*
+Returns the extrema found so far by a detector.
+Parameters:
+d: the ExtremaDetector.
+Returns:
+A vector of Extremum structs, which outlives the detector.
+*/
+void freeExtremaDetector(ExtremaDetector d);
+/*
+Frees an ExtremaDetector, but not its extrema.
+Parameters:
+d: the ExtremaDetector.
+*/
 Extremum parabolaExt(Vector points, minmax type, int weight);
 /*
 Calculates the extremum of a given vector of data points. It
@@ -84,6 +130,11 @@ performs a least squares parabolic fit on the data and evaluates the
 frequency, impedance and bandwidth from this fit. Note that the
 frequency of extrema are (optionally) averaged with the absolute
 extrema present in the data set.
+The fit is solved in closed form from the sums of powers of x, measured
+from the mean x of the points, and of y times them (refer to
+Bevington (1969), "Data Reduction and Error Analysis for the Physical
+Sciences"). extrema keeps these sums as running sums as the window
+slides, rather than calling this function.
 Parameters:
 points: a Vector of Points about the extremum.
 type: a minmax type indicating minimum/maximum.
@@ -97,7 +148,8 @@ int progressPoints(Vector points, Vector allpoints, int index);
 Reads the next data point present in the impedance spectra file, and
 places this within a window of data points - also shifting the
 window to the right by one point and popping the leftmost data
-point.
+point. The window refers to the Points of allpoints rather than
+copying them.
 Parameters:
 points: the window of data points that the function updates.
 allpoints: the vector of all data points.
@@ -135,7 +187,9 @@ A double of the frequency of the highest y value among points
 void harmonicity(Vector minv);
 /*
 Sets the harmonicity variables numharm and meanharmZ
-for each Minimum struct in a given minima vector.
+for each Minimum struct in a given minima vector. The minima are sorted
+by frequency once, and the harmonics of each are found among the
+minima above it by bisection of each harmonic window.
 Parameters:
 minv: the vector of Minimum structs to be updated
 */
@@ -192,23 +246,4 @@ d: the double to evaluate
 Returns:
 1 if valid, 0 otherwise
 */
-double det(double **M);
-/*
-Calculates the determinant of a 3x3 matrix.
-Parameters:
-M: a 2 dimensional double array representing the matrix.
-Returns:
-The determinant of M as a double.
-*/
-double **A(Vector points);
-double **B(Vector points);
-double **C(Vector points);
-double **D(Vector points);
-/*
-A, B, C, D return matrices necessary in calculating the least
-squares parabolic fit to a set of data points. Each function is
-passed a Vector of Points about the minimum to be fitted.
-Refer to Bevington (1969), "Data Reduction and Error Analysis
-for the Physical Sciences".
-*/
 #endif
@@ -5,7 +5,12 @@ Modified by Paul Dickens, 2007
 Note.c is a frequency to musical note converter.
 Refer to Note.h for interface details.
 */
+/* necessary define for some gcc math.h functions */
+#ifndef _ISOC99_SOURCE
+#define _ISOC99_SOURCE
+#endif
 #include "Note.h"
+#include "BatchDispatch.h"
 #include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -13,7 +18,7 @@ Refer to Note.h for interface details.
 #define A4_INDEX 57
 #define A4_MIDI_INDEX 69
 /* array of notes */
-char *notes[120] = {
+static const char *notes[120] = {
     "C0",  "C#0", "D0",  "D#0", "E0",  "F0",  "F#0", "G0",  "G#0", "A0",  "A#0",
     "B0",  "C1",  "C#1", "D1",  "D#1", "E1",  "F1",  "F#1", "G1",  "G#1", "A1",
     "A#1", "B1",  "C2",  "C#2", "D2",  "D#2", "E2",  "F2",  "F#2", "G2",  "G#2",
@@ -25,90 +30,101 @@ char *notes[120] = {
     "E7",  "F7",  "F#7", "G7",  "G#7", "A7",  "A#7", "B7",  "C8",  "C#8", "D8",
     "D#8", "E8",  "F8",  "F#8", "G8",  "G#8", "A8",  "A#8", "B8",  "C9",  "C#9",
     "D9",  "D#9", "E9",  "F9",  "F#9", "G9",  "G#9", "A9",  "A#9", "B9"};
-#define MINUS 0
-#define PLUS 1
+/* the frequency range of the notes */
+#define F_LOW 26.73
+#define F_HIGH 14496.0
+/* the number of notes notesBatch quantises at once */
+#define NOTE_BLOCK 64
+/* intervals within this many cents of rounding to another cent are
+recalculated by note */
+#define NOTE_TIE 1.0e-9
+#ifdef BATCH_DISPATCH
+#pragma GCC push_options
+#pragma GCC target("avx512f,avx2,fma")
+#define KERNEL_WIDTH 8
+#define KERNEL_SUFFIX _avx512
+#include "NoteKernel.h"
+#undef KERNEL_WIDTH
+#undef KERNEL_SUFFIX
+#pragma GCC pop_options
+#pragma GCC push_options
+#pragma GCC target("avx2,fma")
+#define KERNEL_WIDTH 4
+#define KERNEL_SUFFIX _avx2
+#include "NoteKernel.h"
+#undef KERNEL_WIDTH
+#undef KERNEL_SUFFIX
+#pragma GCC pop_options
+#endif
+#define KERNEL_WIDTH 1
+#define KERNEL_SUFFIX _scalar
+#include "NoteKernel.h"
+#undef KERNEL_WIDTH
+#undef KERNEL_SUFFIX
 Note note(double input, int round) {
-  double frequency;
-  int r_index = 0;
-  int cent_index = 0;
-  int side;
-  Note n = (Note)malloc(sizeof(Note *));
-  /* a semitone higher than a given frequency is 2^(1/12) times the
-  frequency
-  a cent higher than a given frequency is 2^(1/1200) times the
-  frequency */
-  double r = pow(2, 1.0 / 12.0);
-  double cent = pow(2, 1.0 / 1200.0);
+  Note n;
+  int total, r_index, cents, magnitude;
   /* input frequency must be between A0 and A9 */
-  if ((input < 26.73) || (input > 14496.0)) {
-    return NULL;
+  if (!((input >= F_LOW) && (input <= F_HIGH))) {
+    n.name = NULL;
+    n.cents = 0;
+    n.midi = 0;
+    return n;
   }
-  /* set A4 (440Hz) as reference point */
-  frequency = A4;
-  /* search for input ratio against A4 to the nearest cent
-  in range -49 to +50 cents around closest note */
-  if (input >= frequency) {
-    while (input >= r * frequency) {
-      frequency = r * frequency;
-      r_index++;
-    }
-  } else {
-    while (input < frequency) {
-      frequency = frequency / r;
-      r_index--;
-    }
-  }
-  while (input >= cent * frequency) {
-    frequency = cent * frequency;
-    cent_index++;
-  }
-  if ((cent * frequency - input) < (input - frequency))
-    cent_index++;
-  if (cent_index > 50) {
-    r_index++;
-    cent_index = 100 - cent_index;
-    if (cent_index != 0)
-      side = MINUS;
-    else
-      side = PLUS;
-  } else
-    side = PLUS;
+  /* the interval to A4 (440Hz) to the nearest cent, split into the
+  closest note and -49 to +50 cents around it */
+  total = (int)floor(1200.0 * log2(input / A4) + 0.5);
+  r_index = (int)floor((total + 49) / 100.0);
+  cents = total - 100 * r_index;
   if (round) {
-    /* round cents to nearest 5 cents */
-    switch (cent_index % 5) {
-    case 1:
-      cent_index = cent_index - 1;
-      break;
-    case 2:
-      cent_index = cent_index - 2;
-      break;
-    case 3:
-      cent_index = cent_index + 2;
+    /* round the magnitude of cents to nearest 5 cents */
+    magnitude = abs(cents);
+    magnitude = 5 * ((magnitude + 2) / 5);
+    cents = (cents < 0) ? -magnitude : magnitude;
+  }
+  n.name = notes[A4_INDEX + r_index];
+  n.cents = cents;
+  n.midi = A4_MIDI_INDEX + r_index;
+  return n;
+}
+void notesBatch(const double *f, int n, int round, Note *result) {
+  double offset[NOTE_BLOCK], index[NOTE_BLOCK], cents[NOTE_BLOCK];
+  int level = batchLevel();
+  int i, k, m;
+  for (i = 0; i < n; i += NOTE_BLOCK) {
+    m = (n - i < NOTE_BLOCK) ? n - i : NOTE_BLOCK;
+    /* quantise the whole block without branching on the notes */
+    switch (level) {
+#ifdef BATCH_DISPATCH
+    case BATCH_AVX512:
+      noteKernel_avx512(f + i, m, round, offset, index, cents);
       break;
-    case 4:
-      cent_index = cent_index + 1;
+    case BATCH_AVX2:
+      noteKernel_avx2(f + i, m, round, offset, index, cents);
       break;
+#endif
     default:
-      break;
+      noteKernel_scalar(f + i, m, round, offset, index, cents);
+    }
+    /* then look up the names, leaving the frequencies out of range or
+    at a tie to note */
+    for (k = 0; k < m; k++) {
+      if (!((f[i + k] >= F_LOW) && (f[i + k] <= F_HIGH)) ||
+          (offset[k] < NOTE_TIE) || (offset[k] > 1.0 - NOTE_TIE)) {
+        result[i + k] = note(f[i + k], round);
+        continue;
+      }
+      result[i + k].name = notes[A4_INDEX + (int)index[k]];
+      result[i + k].cents = (int)cents[k];
+      result[i + k].midi = A4_MIDI_INDEX + (int)index[k];
     }
-    if (cent_index == 0)
-      side = PLUS;
   }
-  /* fill string buffer with note information and return */
-  n->name = (char *)malloc(BUFSIZ * sizeof(char));
-  sprintf(n->name, "%s", notes[A4_INDEX + r_index]);
-  if (side == PLUS)
-    n->cents = cent_index;
-  else
-    n->cents = (-1) * cent_index;
-  n->midi = A4_MIDI_INDEX + r_index;
-  return n;
 }
 char *noteString(Note n) {
   char *note_string = (char *)malloc(BUFSIZ * sizeof(char));
-  if (n->cents >= 0)
-    sprintf(note_string, "%s plus %d cents", n->name, abs(n->cents));
+  if (n.cents >= 0)
+    sprintf(note_string, "%s plus %d cents", n.name, abs(n.cents));
   else
-    sprintf(note_string, "%s minus %d cents", n->name, abs(n->cents));
+    sprintf(note_string, "%s minus %d cents", n.name, abs(n.cents));
   return note_string;
 }
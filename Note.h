@@ -6,15 +6,17 @@ Note.c is a frequency to musical note converter.
 */
 #ifndef NOTE_H_PROTECTOR
 #define NOTE_H_PROTECTOR
-/* Note: { note struct including name, cents, midi number ) */
+/* Note: { note name (in a static table, NULL if the frequency is out
+of range), cents, midi number } */
 typedef struct note_str {
-  char *name;
+  const char *name;
   int cents;
   int midi;
-} * Note;
+} Note;
 Note note(double input, int round);
 /*
-Converts the given frequency to a musical note.
+Converts the given frequency to a musical note, in closed form from its
+interval in cents to A4.
 Parameters:
 input: must be a double between 27.5Hz (A0) and 14080Hz (A9)
 round: round note to nearest 5 cents if true
@@ -25,7 +27,19 @@ A note struct which includes:
 nearest 5 cents
 - midi: a midi number corresponding to the closest semitone for
 the frequency
-... OR NULL if frequency out of range.
+... OR a note whose name is NULL if frequency out of range.
+*/
+void notesBatch(const double *f, int n, int round, Note *result);
+/*
+Converts an array of frequencies to musical notes, as note does for
+each. The intervals to A4 are calculated and quantised over blocks of
+frequencies in vector registers (refer to NoteKernel.h), and only the
+names are then filled in one at a time.
+Parameters:
+f: the array of frequencies
+n: the number of frequencies
+round: round notes to nearest 5 cents if true
+result: the return array of n notes
 */
 char *noteString(Note n);
 /*
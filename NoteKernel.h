@@ -0,0 +1,85 @@
+/*
+NoteKernel.h
+The batched note quantisation kernel used by Note.c. This file is
+included once for each vector width, with KERNEL_WIDTH (the number of
+frequencies per vector) and KERNEL_SUFFIX (appended to every name)
+defined, and with the matching target options in force (refer to
+KernelVector.h).
+*/
+#include "KernelVector.h"
+#include <math.h>
+/* sqrt(1/2), the lower bound of the reduced argument of log2v */
+#define LOG_SQRTH 0.70710678118654752440
+/* log2(e) */
+#define LOG2_E 1.44269504088896340736
+/* largest integer not greater than x (for |x| < 2^51) */
+static inline vdouble KERNEL(floorv)(vdouble x) {
+  vdouble zero = {0.0};
+  vdouble q = (x + ROUND_MAGIC) - ROUND_MAGIC;
+  return q - KERNEL(selectv)((vlong)(q > x), zero + 1.0, zero);
+}
+/* base 2 logarithm of positive normal x (the exponent of x, plus the
+Cephes rational approximation of log(1 + m) for sqrt(1/2) <= 1 + m <
+sqrt(2)) */
+static inline vdouble KERNEL(log2v)(vdouble x) {
+  vdouble zero = {0.0};
+  vlong bits = (vlong)x;
+  vlong e = ((bits >> 52) & 0x7ff) - 1022;
+  vdouble m = (vdouble)((bits & 0x000fffffffffffffLL) | (1022LL << 52));
+  vlong small = (vlong)(m < LOG_SQRTH);
+  vdouble z, px, qx;
+  /* m in [0.5, 1): take 2m below sqrt(1/2) instead */
+  e += small;
+  m = KERNEL(selectv)(small, m + m, m) - 1.0;
+  z = m * m;
+  px = 1.01875663804580931796E-4 * m + 4.97494994976747001425E-1;
+  px = px * m + 4.70579119878881725854E0;
+  px = px * m + 1.44989225341610930846E1;
+  px = px * m + 1.79368678507819816313E1;
+  px = px * m + 7.70838733755885391666E0;
+  qx = m + 1.12873587189167450590E1;
+  qx = qx * m + 4.52279145837532221105E1;
+  qx = qx * m + 8.29875266912776603211E1;
+  qx = qx * m + 7.11544750618167507305E1;
+  qx = qx * m + 2.31251620126765340583E1;
+  /* the exponent as a double, by the same magic as floorv */
+  return ((vdouble)(e + (vlong)(zero + ROUND_MAGIC)) - ROUND_MAGIC) +
+         (m + (m * (z * px / qx) - 0.5 * z)) * LOG2_E;
+}
+/* the interval of each frequency to A4 to the nearest cent, split
+into the index of the closest note relative to A4 and the cents about
+it (rounded to 5 cents if round), and the distance of the interval in
+cents plus a half above the cent taken, by which the caller finds the
+intervals too near a rounding boundary to trust. Frequencies out of
+range are taken to be A4. */
+static void KERNEL(noteKernel)(const double *f, int n, int round,
+                               double *offset, double *index,
+                               double *cents) {
+  vdouble zero = {0.0};
+  vdouble vf, t, q, r, c, mag;
+  vlong inRange;
+  int i, lanes;
+  for (i = 0; i < n; i += KERNEL_WIDTH) {
+    lanes = (n - i < KERNEL_WIDTH) ? n - i : KERNEL_WIDTH;
+    vf = KERNEL(loadv)(f + i, lanes);
+    inRange = (vlong)(vf >= F_LOW) & (vlong)(vf <= F_HIGH);
+    vf = KERNEL(selectv)(inRange, vf, zero + A4);
+    t = 1200.0 * KERNEL(log2v)(vf * (1.0 / A4)) + 0.5;
+    q = KERNEL(floorv)(t);
+    /* 0.01 and 0.2 are rounded up, so multiplying a whole multiple of
+    100 or 5 by them cannot fall below the quotient */
+    r = KERNEL(floorv)((q + 49.0) * 0.01);
+    c = q - 100.0 * r;
+    if (round) {
+      /* round the magnitude of cents to nearest 5 cents */
+      mag = KERNEL(selectv)((vlong)(c < 0.0), -c, c);
+      mag = 5.0 * KERNEL(floorv)((mag + 2.0) * 0.2);
+      c = KERNEL(selectv)((vlong)(c < 0.0), -mag, mag);
+    }
+    KERNEL(storev)(offset + i, t - q, lanes);
+    KERNEL(storev)(index + i, r, lanes);
+    KERNEL(storev)(cents + i, c, lanes);
+  }
+}
+#undef vdouble
+#undef vlong
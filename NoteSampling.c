@@ -0,0 +1,156 @@
+/*
+NoteSampling.c
+Evaluation of the spectrum of a fingering only where the analysis of
+its note needs it. Refer to NoteSampling.h for interface details.
+*/
+#include "NoteSampling.h"
+#include "Minima.h"
+#include "Point.h"
+#include "Vector.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+/* marks the unevaluated bins among the points to which an extremum was
+fitted, returning their number */
+static int requireFit(Extremum e, const char *known, char *required) {
+  int bin, n = 0;
+  for (bin = e->first; bin <= e->last; bin++) {
+    if (known[bin] || required[bin])
+      continue;
+    required[bin] = 1;
+    n++;
+  }
+  return n;
+}
+/* marks the unevaluated bins of the fit of the nearest extremum of a
+type either side of extremum k */
+static int requireNeighbours(Vector extv, int k, minmax type,
+                             const char *known, char *required) {
+  Extremum e;
+  int j, n = 0;
+  for (j = k - 1; j >= 0; j--) {
+    e = (Extremum)elementAt(extv, j);
+    if (e->type == type) {
+      n += requireFit(e, known, required);
+      break;
+    }
+  }
+  for (j = k + 1; j < sizeVector(extv); j++) {
+    e = (Extremum)elementAt(extv, j);
+    if (e->type == type) {
+      n += requireFit(e, known, required);
+      break;
+    }
+  }
+  return n;
+}
+/* whether Analysis takes a minimum to lie at a note */
+static int atNote(Extremum e, int midi) {
+  Note n = note(e->f, 0);
+  return (n.name != NULL) && (n.midi == midi);
+}
+/* marks the unevaluated bins of the fits which the analysis of the note
+needs, returning their number: first those of every minimum (any of
+which may lie at the note or be a harmonic of it, and a fit to
+interpolated values may lie far from the points it is fitted to), then
+those of the maxima beside the minima at the note */
+static int requireNote(Vector extv, int midi, const char *known,
+                       char *required) {
+  Extremum e;
+  int k, n = 0;
+  for (k = 0; k < sizeVector(extv); k++) {
+    e = (Extremum)elementAt(extv, k);
+    if (e->type == MINIMUM)
+      n += requireFit(e, known, required);
+  }
+  if (n > 0)
+    return n;
+  for (k = 0; k < sizeVector(extv); k++) {
+    e = (Extremum)elementAt(extv, k);
+    if ((e->type == MINIMUM) && atNote(e, midi))
+      n += requireNeighbours(extv, k, MAXIMUM, known, required);
+  }
+  return n;
+}
+/* fills the bins not yet evaluated by linear interpolation between the
+nearest evaluated bins either side (the first and last bins are always
+evaluated) */
+static void interpolate(int numBins, const char *known, double *dB) {
+  int a = 0, b, bin;
+  for (b = 1; b < numBins; b++) {
+    if (!known[b])
+      continue;
+    for (bin = a + 1; bin < b; bin++)
+      dB[bin] = dB[a] + (dB[b] - dB[a]) * (bin - a) / (b - a);
+    a = b;
+  }
+}
+int noteSpectrum(FrequencyGrid g, int midi, double tolerance,
+                 SpectrumFunction evaluate, void *context, double *dB) {
+  char spec[BUFSIZ];
+  char *known = (char *)calloc(g->numBins, sizeof(char));
+  char *required = (char *)calloc(g->numBins, sizeof(char));
+  struct point_str *data =
+      (struct point_str *)malloc(g->numBins * sizeof(*data));
+  double *f = (double *)malloc(g->numBins * sizeof(double));
+  complex *Z = (complex *)malloc(g->numBins * sizeof(complex));
+  Vector points, extv;
+  Sampling s;
+  int numEvaluations, numRequired, bin, i;
+  /* locate the extrema */
+  sprintf(spec, "adaptive:%g", tolerance);
+  s = createSampling(g, spec, 1, evaluate, context);
+  if (s == NULL) {
+    free(known);
+    free(required);
+    free(data);
+    free(f);
+    free(Z);
+    return 0;
+  }
+  for (i = 0; i < s->numSamples; i++) {
+    known[s->bin[i]] = 1;
+    dB[s->bin[i]] = 20.0 * log10(modz(s->Z[i]));
+  }
+  numEvaluations = s->numEvaluations;
+  freeSampling(s);
+  points = createVector();
+  for (bin = 0; bin < g->numBins; bin++) {
+    data[bin].x = gridFrequency(g, bin);
+    addElement(points, &data[bin]);
+  }
+  /* evaluate the windows the analysis needs until they are all known */
+  for (;;) {
+    interpolate(g->numBins, known, dB);
+    for (bin = 0; bin < g->numBins; bin++)
+      data[bin].y = dB[bin];
+    extv = extrema(points);
+    numRequired = requireNote(extv, midi, known, required);
+    for (i = 0; i < sizeVector(extv); i++)
+      free(elementAt(extv, i));
+    freeVector(extv);
+    if (numRequired == 0)
+      break;
+    for (bin = 0, i = 0; bin < g->numBins; bin++) {
+      if (!required[bin])
+        continue;
+      f[i++] = gridFrequency(g, bin);
+    }
+    evaluate(f, numRequired, Z, context);
+    for (bin = 0, i = 0; bin < g->numBins; bin++) {
+      if (!required[bin])
+        continue;
+      dB[bin] = 20.0 * log10(modz(Z[i++]));
+      known[bin] = 1;
+      required[bin] = 0;
+    }
+    numEvaluations += numRequired;
+  }
+  freeVector(points);
+  free(known);
+  free(required);
+  free(data);
+  free(f);
+  free(Z);
+  return numEvaluations;
+}
@@ -0,0 +1,39 @@
+/*
+NoteSampling.h
+Evaluation of the spectrum of a fingering only where the analysis of
+its note needs it: the minimum at the note, its neighbouring extrema
+and its harmonics. Elsewhere the spectrum is interpolated between
+adaptive samples which locate every extremum, so that the extrema found
+by Minima, and hence the analysis of the note, are those of the fully
+evaluated spectrum.
+*/
+#ifndef NOTESAMPLING_H_PROTECTOR
+#define NOTESAMPLING_H_PROTECTOR
+#include "FrequencyGrid.h"
+#include "Sampling.h"
+/* Default tolerance in dB of the adaptive Sampling which locates the
+extrema, fine enough that no extremum Minima detects is missed */
+#define NOTESAMPLING_TOLERANCE 0.1
+int noteSpectrum(FrequencyGrid g, int midi, double tolerance,
+                 SpectrumFunction evaluate, void *context, double *dB);
+/*
+Evaluates the magnitude of a spectrum for the analysis of the note of a
+fingering. An adaptive Sampling of the given tolerance locates the
+extrema; then, until no more bins are needed, the extrema of the
+spectrum so far are found by Minima, and the points fitted to every
+minimum and, once those are all evaluated, to the maxima beside the
+minima at the note are evaluated. The remaining bins are interpolated
+linearly in dB between their evaluated neighbours, which keeps the
+rises and falls of the spectrum that the extrema are detected from.
+Parameters:
+g: the FrequencyGrid
+midi: the midi number of the note
+tolerance: the tolerance in dB of the adaptive Sampling
+evaluate: the SpectrumFunction (one value per frequency)
+context: passed to evaluate
+dB: the return array of the magnitude in dB at each bin of the grid
+Returns:
+the number of evaluations of the spectrum
+0 if the adaptive Sampling is invalid
+*/
+#endif
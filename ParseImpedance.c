@@ -62,3 +62,73 @@ int parseImpedanceFile(Vector filev, char *filename) {
   fclose(fp);
   return 1;
 }
+/* reads a whole line, growing the buffer as needed, returning 0 at the
+end of the file */
+static int readLine(ImpedanceStream s) {
+  int length;
+  if (fgets(s->line, s->size, s->fp) == NULL)
+    return 0;
+  length = strlen(s->line);
+  while ((length == s->size - 1) && (s->line[length - 1] != '\n')) {
+    s->size *= 2;
+    s->line = (char *)realloc(s->line, s->size * sizeof(char));
+    if (fgets(s->line + length, s->size - length, s->fp) == NULL)
+      break;
+    length += strlen(s->line + length);
+  }
+  return 1;
+}
+ImpedanceStream openImpedanceStream(char *filename) {
+  ImpedanceStream s;
+  FILE *fp;
+  char *delimiters = " \t";
+  char *token;
+  int capacity = 8;
+  /* open data file and indicate any error */
+  if (strcmp(filename, "-") == 0)
+    fp = stdin;
+  else if ((fp = fopen(filename, "r")) == NULL) {
+    fprintf(stderr, "Cannot open file %s\n", filename);
+    return NULL;
+  }
+  s = (ImpedanceStream)malloc(sizeof(*s));
+  s->fp = fp;
+  s->size = BUFSIZ;
+  s->line = (char *)malloc(s->size * sizeof(char));
+  s->numSeries = 0;
+  s->midi = (int *)malloc(capacity * sizeof(int));
+  /* parse midi line */
+  if (!readLine(s))
+    return s;
+  for (token = strtok(s->line, delimiters); token != NULL;
+       token = strtok(NULL, delimiters)) {
+    if (s->numSeries == capacity) {
+      capacity *= 2;
+      s->midi = (int *)realloc(s->midi, capacity * sizeof(int));
+    }
+    s->midi[s->numSeries++] = atoi(token);
+  }
+  return s;
+}
+int readImpedanceRow(ImpedanceStream s, double *x, double *y) {
+  char *delimiters = " \t";
+  char *token;
+  int series = 0;
+  if (!readLine(s))
+    return -1;
+  /* Parse x value */
+  if ((token = strtok(s->line, delimiters)) == NULL)
+    return -2;
+  *x = atof(token);
+  while ((series < s->numSeries) &&
+         ((token = strtok(NULL, delimiters)) != NULL))
+    y[series++] = atof(token);
+  return series;
+}
+void closeImpedanceStream(ImpedanceStream s) {
+  if (s->fp != stdin)
+    fclose(s->fp);
+  free(s->line);
+  free(s->midi);
+  free(s);
+}
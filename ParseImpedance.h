@@ -8,6 +8,17 @@ returns a Vector of Vectors of Points.
 #ifndef PARSEIMPEDANCE_H_PROTECTOR
 #define PARSEIMPEDANCE_H_PROTECTOR
 #include "Vector.h"
+#include <stdio.h>
+/* ImpedanceStream: an acoustic impedance spectra file read one row at
+a time { file, line buffer and its size, number of series, midi number
+of each series } */
+typedef struct impedancestream_str {
+  FILE *fp;
+  char *line;
+  int size;
+  int numSeries;
+  int *midi;
+} * ImpedanceStream;
 int parseImpedanceFile(Vector filev, char *filename);
 /*
 Reads each line of a given acoustic impedance spectra file
@@ -20,4 +31,35 @@ Returns:
 1 if the operatioon was successful
 0 otherwise
 */
+ImpedanceStream openImpedanceStream(char *filename);
+/*
+Opens an acoustic impedance spectra file (or the standard input) and
+reads its line of midi numbers, so that its rows can be read one at a
+time without holding the file in memory.
+Parameters:
+filename: the name of the file to read ("-" for the standard input)
+Returns:
+a new ImpedanceStream
+NULL if the file cannot be opened
+*/
+int readImpedanceRow(ImpedanceStream s, double *x, double *y);
+/*
+Reads the next row of an ImpedanceStream: a frequency and an
+impedance for each series. Lines of any length are read.
+Parameters:
+s: the ImpedanceStream
+x: the return variable for the frequency
+y: the return array for the impedances (numSeries of them)
+Returns:
+the number of impedances read (at most numSeries)
+-1 at the end of the file
+-2 if the row is invalid
+*/
+void closeImpedanceStream(ImpedanceStream s);
+/*
+Closes an ImpedanceStream (unless it reads the standard input) and
+frees it.
+Parameters:
+s: the ImpedanceStream
+*/
 #endif
@@ -53,8 +53,8 @@ int parseAndValidateFile(char *xml_filename, xmlDocPtr *doc) {
 int parseWoodwind(xmlDocPtr doc, Woodwind *w) {
   xmlNodePtr curnode;
   EmbouchureHole embouchureHole = NULL;
-  Vector upstreamBore, downstreamBore, cells;
-  double upstreamFlange, flange;
+  Vector upstreamBore = createVector(), downstreamBore, cells;
+  double upstreamFlange = -1.0, flange;
   Head head;
   /* Retrieve and validate root node */
   if ((curnode = getAndAssertDocRoot(doc)) == NULL)
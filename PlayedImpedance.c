@@ -3,39 +3,93 @@ PlayedImpedance.c
 By Paul Dickens, 2006
 Physical model of the acoustic impedance of a played flute.
 */
+#include "Analysis.h"
+#include "NoteSampling.h"
 #include "ParseXML.h"
+#include "Point.h"
+#include "Sampling.h"
 #include "Vector.h"
+#include "WoodwindProgram.h"
 #include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+/* Fingerings: the played impedances evaluated by evaluateFingerings {
+instrument, the instrument with every segment halved (NULL unless
+extrapolating), midi numbers, holestrings } */
+typedef struct fingerings_str {
+  Woodwind instrument;
+  Woodwind fine;
+  Vector midiv;
+  Vector holestringv;
+} Fingerings;
+/* Fingering: the played impedance of one fingering evaluated by
+evaluateFingering { fingerings, index of the fingering } */
+typedef struct fingering_str {
+  Fingerings *fingerings;
+  int index;
+} Fingering;
 int parseCommandLine(int argc, char **argv, double *flo, double *fhi,
-                     double *fres, char **input_filename, char **xml_filename);
+                     double *fres, double *tolerance, double *maxLength,
+                     char **sampling, int *analysis, char **input_filename,
+                     char **xml_filename);
+int prepareInstrument(char *xml_filename, double tolerance, double fhi,
+                      double maxLength, int halve, FrequencyGrid grid,
+                      Woodwind *instrument);
 int parseInputFile(Vector midiv, Vector holestringv, char *input_filename);
+void evaluateFingerings(const double *f, int n, complex *Z, void *context);
+void evaluateFingering(const double *f, int n, complex *Z, void *context);
+void analyseFingerings(Sampling sampling, Vector midiv, int analysis);
+int analyseTargeted(FrequencyGrid grid, double tolerance,
+                    Fingerings *fingerings, int analysis);
 /* Default spectrum range and resolution */
 #define FLO 200.0
 #define FHI 4000.0
 #define FRES 2.0
+/* Output of the analysis option: the impedance table, or the note
+analysis of AnalyseNotes (with or without the harmonicity data) */
+#define ANALYSIS_NONE 0
+#define ANALYSIS_NOTES 1
+#define ANALYSIS_HARMONICITY 2
 int main(int argc, char **argv) {
-  double f, flo, fhi, fres;
+  double flo, fhi, fres, tolerance, maxLength;
   char *input_filename;
   char *xml_filename;
+  char *spec;
   Vector midiv = createVector();
   Vector holestringv = createVector();
-  Woodwind instrument;
-  int i;
+  Fingerings fingerings;
+  FrequencyGrid grid;
+  Sampling sampling;
+  int i, j, numFingerings, analysis;
   int midi;
   char *holestring;
-  double z_dB;
+  double z_dB, error_dB;
+  complex *Z;
   /* check correct usage */
-  if (!parseCommandLine(argc, argv, &flo, &fhi, &fres, &input_filename,
-                        &xml_filename)) {
+  if (!parseCommandLine(argc, argv, &flo, &fhi, &fres, &tolerance, &maxLength,
+                        &spec, &analysis, &input_filename, &xml_filename)) {
     fprintf(stderr,
             "Usage: PlayedImpedance [OPTIONS] <input file> <XML file>\n\n");
     fprintf(stderr, " Options:\n");
     fprintf(stderr, "\t-l <flo> (default 200.0)\n");
     fprintf(stderr, "\t-h <fhi> (default 4000.0)\n");
-    fprintf(stderr, "\t-r <fres> (default 2.0)\n\n");
+    fprintf(stderr, "\t-r <fres> (default 2.0)\n");
+    fprintf(stderr, "\t-a <tolerance> (adaptive discretisation, default "
+                    "off)\n");
+    fprintf(stderr, "\t-x <segment length> (Richardson extrapolation from\n");
+    fprintf(stderr, "\t   this and half this length, printing the error\n");
+    fprintf(stderr, "\t   estimates in dB to stderr; default off)\n");
+    fprintf(stderr, "\t-g <sampling> (\"uniform\", \"log:<n>\",\n");
+    fprintf(stderr, "\t   \"piecewise:<f0>:<res0>:<f1>:...:<fn>\",\n");
+    fprintf(stderr, "\t   \"adaptive:<tolerance in dB>\" or, with -n only,\n");
+    fprintf(stderr, "\t   \"targeted[:<tolerance in dB>]\", which evaluates\n");
+    fprintf(stderr, "\t   each fingering only about the minimum at its\n");
+    fprintf(stderr, "\t   note, its neighbours and its harmonics (default\n");
+    fprintf(stderr, "\t   tolerance 0.1); default uniform)\n");
+    fprintf(stderr, "\t-n <analysis> (\"notes\" or \"harmonicity\": print\n");
+    fprintf(stderr, "\t   the analysis of AnalyseNotes instead of the\n");
+    fprintf(stderr, "\t   impedance; default off)\n\n");
     fprintf(stderr, " <input file>:\n");
     fprintf(stderr, "\t- Must be a tab-delimited list of midi numbers and\n");
     fprintf(stderr, "\t holestrings, one set per line.\n\n");
@@ -47,54 +101,242 @@ int main(int argc, char **argv) {
     fprintf(stderr, "PlayedImpedance failed to parse input file.\n");
     return -1;
   }
-  /* retrieve data structures from XML file */
-  if (!parseXMLFile(xml_filename, &instrument)) {
-    fprintf(stderr, "PlayedImpedance error: ");
-    fprintf(stderr, "PlayedImpedance failed to parse XML file.\n");
+  grid = createFrequencyGrid(flo, fhi, fres);
+  if (!prepareInstrument(xml_filename, tolerance, fhi, maxLength, 0, grid,
+                         &fingerings.instrument))
+    return -1;
+  /* the same instrument with every segment halved, for extrapolation */
+  fingerings.fine = NULL;
+  if ((maxLength > 0.0) &&
+      !prepareInstrument(xml_filename, 0.0, fhi, maxLength, 1, grid,
+                         &fingerings.fine))
+    return -1;
+  fingerings.midiv = midiv;
+  fingerings.holestringv = holestringv;
+  numFingerings = sizeVector(midiv);
+  /* validate the fingerings */
+  for (i = 0; i < numFingerings; i++) {
+    holestring = (char *)elementAt(holestringv, i);
+    if (!setFingering(fingerings.instrument, holestring)) {
+      fprintf(stderr, "PlayedImpedance error: \"%s\" ", holestring);
+      fprintf(stderr, "is an invalid fingering for the given woodwind ");
+      fprintf(stderr, "definition.\n");
+      return -1;
+    }
+  }
+  /* evaluate each fingering only where the analysis of its note needs
+  it (extrapolated, as below, when fingerings.fine is set) */
+  if ((spec != NULL) && (strncmp(spec, "targeted", 8) == 0)) {
+    if ((analysis == ANALYSIS_NONE) ||
+        ((spec[8] != '\0') && (spec[8] != ':')) ||
+        !analyseTargeted(grid,
+                         (spec[8] == ':') ? atof(spec + 9)
+                                          : NOTESAMPLING_TOLERANCE,
+                         &fingerings, analysis)) {
+      fprintf(stderr, "PlayedImpedance error: \"%s\" is an invalid "
+                      "sampling.\n",
+              spec);
+      return -1;
+    }
+    return 0;
+  }
+  /* choose the frequencies in spectrum range, and calculate the
+  impedance of every fingering (and the fine values when
+  extrapolating) */
+  sampling = createSampling(
+      grid, spec, (fingerings.fine != NULL) ? 2 * numFingerings : numFingerings,
+      evaluateFingerings, &fingerings);
+  if (sampling == NULL) {
+    fprintf(stderr, "PlayedImpedance error: \"%s\" is an invalid sampling.\n",
+            (spec != NULL) ? spec : "uniform");
     return -1;
   }
-  discretiseWoodwind(instrument, WW_MAX_LENGTH);
-  setAirProperties(instrument, WW_T_0, WW_T_AMB, WW_T_GRAD, WW_HUMID, WW_X_CO2);
+  evaluateSampling(sampling, evaluateFingerings, &fingerings);
+  /* analyse the spectra in memory rather than printing them */
+  if (analysis != ANALYSIS_NONE) {
+    analyseFingerings(sampling, midiv, analysis);
+    return 0;
+  }
   /* print the midi numbers as column labels */
-  for (i = 0; i < sizeVector(midiv); i++) {
+  for (i = 0; i < numFingerings; i++) {
     /* set midi from vector */
     midi = atoi((char *)elementAt(midiv, i));
     printf("\t%.d", midi);
+    if (fingerings.fine != NULL)
+      fprintf(stderr, "\t%.d", midi);
   }
   printf("\n");
-  /* for each frequency in spectrum range... */
-  for (f = flo; f <= fhi; f += fres) {
-    printf("%.2f", f);
-    /* for each fingering... */
-    for (i = 0; i < sizeVector(midiv); i++) {
-      /* print tab delimiter */
-      printf("\t");
-      /* set midi and holestring from vectors */
-      midi = atoi((char *)elementAt(midiv, i));
-      holestring = (char *)elementAt(holestringv, i);
-      /* set and validate fingering */
-      if (!setFingering(instrument, holestring)) {
-        fprintf(stderr, "PlayedImpedance error: \"%s\" ",
-                (char *)elementAt(holestringv, i));
-        fprintf(stderr, "is an invalid fingering for the given woodwind ");
-        fprintf(stderr, "definition.\n");
-        return -1;
-      }
-      /* calculate and output impedance */
-      z_dB = 20.0 * log10(modz(playedImpedance(f, instrument, midi)));
-      printf("%.3f", z_dB);
+  if (fingerings.fine != NULL)
+    fprintf(stderr, "\n");
+  /* for each sampled frequency... */
+  for (j = 0; j < sampling->numSamples; j++) {
+    Z = sampling->Z + j * sampling->numValues;
+    printf("%.2f", sampling->f[j]);
+    if (fingerings.fine != NULL)
+      fprintf(stderr, "%.2f", sampling->f[j]);
+    /* for each fingering, output the impedance (and the error estimate
+    of the fine value) */
+    for (i = 0; i < numFingerings; i++) {
+      z_dB = 20.0 * log10(modz(Z[i]));
+      printf("\t%.3f", z_dB);
+      if (fingerings.fine == NULL)
+        continue;
+      error_dB = fabs(z_dB - 20.0 * log10(modz(Z[numFingerings + i])));
+      fprintf(stderr, "\t%.3f", error_dB);
     }
     /* print new line */
     printf("\n");
+    if (fingerings.fine != NULL)
+      fprintf(stderr, "\n");
   }
+  if (sampling->numEvaluations < grid->numBins)
+    fprintf(stderr, "PlayedImpedance: evaluated %d of %d frequencies\n",
+            sampling->numEvaluations, grid->numBins);
   return 0;
 }
+void evaluateFingerings(const double *f, int n, complex *Z, void *context) {
+  Fingerings *fingerings = (Fingerings *)context;
+  int numFingerings = sizeVector(fingerings->midiv);
+  int numValues =
+      (fingerings->fine != NULL) ? 2 * numFingerings : numFingerings;
+  int i, j, midi;
+  char *holestring;
+  complex *values;
+  /* for each fingering (validated by main)... */
+  for (i = 0; i < numFingerings; i++) {
+    midi = atoi((char *)elementAt(fingerings->midiv, i));
+    holestring = (char *)elementAt(fingerings->holestringv, i);
+    setFingering(fingerings->instrument, holestring);
+    if (fingerings->fine != NULL)
+      setFingering(fingerings->fine, holestring);
+    /* ...calculate the impedance at each frequency */
+    for (j = 0; j < n; j++) {
+      values = Z + j * numValues;
+      values[i] = playedImpedance(f[j], fingerings->instrument, midi);
+      if (fingerings->fine == NULL)
+        continue;
+      /* extrapolate, keeping the fine value for the error estimate */
+      values[numFingerings + i] = playedImpedance(f[j], fingerings->fine, midi);
+      values[i] = richardsonExtrapolate(values[i], values[numFingerings + i]);
+    }
+  }
+}
+void evaluateFingering(const double *f, int n, complex *Z, void *context) {
+  Fingering *fingering = (Fingering *)context;
+  Fingerings *fingerings = fingering->fingerings;
+  int j, midi = atoi((char *)elementAt(fingerings->midiv, fingering->index));
+  char *holestring =
+      (char *)elementAt(fingerings->holestringv, fingering->index);
+  setFingering(fingerings->instrument, holestring);
+  if (fingerings->fine != NULL)
+    setFingering(fingerings->fine, holestring);
+  /* calculate the (extrapolated) impedance at each frequency */
+  for (j = 0; j < n; j++) {
+    Z[j] = playedImpedance(f[j], fingerings->instrument, midi);
+    if (fingerings->fine != NULL)
+      Z[j] = richardsonExtrapolate(
+          Z[j], playedImpedance(f[j], fingerings->fine, midi));
+  }
+}
+int analyseTargeted(FrequencyGrid grid, double tolerance,
+                    Fingerings *fingerings, int analysis) {
+  struct point_str *data =
+      (struct point_str *)malloc(grid->numBins * sizeof(*data));
+  double *dB = (double *)malloc(grid->numBins * sizeof(double));
+  Vector points;
+  Fingering fingering;
+  int i, bin, midi, n, numEvaluations = 0;
+  if (tolerance <= 0.0) {
+    free(data);
+    free(dB);
+    return 0;
+  }
+  points = createVector();
+  for (bin = 0; bin < grid->numBins; bin++) {
+    data[bin].x = gridFrequency(grid, bin);
+    addElement(points, &data[bin]);
+  }
+  fingering.fingerings = fingerings;
+  /* for each fingering, evaluate and analyse the spectrum about its
+  note */
+  for (i = 0; i < sizeVector(fingerings->midiv); i++) {
+    midi = atoi((char *)elementAt(fingerings->midiv, i));
+    fingering.index = i;
+    n = noteSpectrum(grid, midi, tolerance, evaluateFingering, &fingering, dB);
+    for (bin = 0; bin < grid->numBins; bin++)
+      data[bin].y = dB[bin];
+    analyseSpectrum(midi, points, 0, analysis == ANALYSIS_HARMONICITY, NOTES);
+    numEvaluations += n;
+  }
+  fprintf(stderr, "PlayedImpedance: evaluated %d of %d frequencies\n",
+          numEvaluations, grid->numBins * sizeVector(fingerings->midiv));
+  freeVector(points);
+  free(data);
+  free(dB);
+  return 1;
+}
+void analyseFingerings(Sampling sampling, Vector midiv, int analysis) {
+  struct point_str *data = (struct point_str *)malloc(
+      (sampling->numSamples > 0 ? sampling->numSamples : 1) * sizeof(*data));
+  Vector points = createVector();
+  int i, j;
+  for (j = 0; j < sampling->numSamples; j++) {
+    data[j].x = sampling->f[j];
+    addElement(points, &data[j]);
+  }
+  /* for each fingering, analyse its spectrum at full precision */
+  for (i = 0; i < sizeVector(midiv); i++) {
+    for (j = 0; j < sampling->numSamples; j++)
+      data[j].y =
+          20.0 * log10(modz(sampling->Z[j * sampling->numValues + i]));
+    analyseSpectrum(atoi((char *)elementAt(midiv, i)), points, 0,
+                    analysis == ANALYSIS_HARMONICITY, NOTES);
+  }
+  freeVector(points);
+  free(data);
+}
+int prepareInstrument(char *xml_filename, double tolerance, double fhi,
+                      double maxLength, int halve, FrequencyGrid grid,
+                      Woodwind *instrument) {
+  double entryradius = WW_EMB_RADIUS;
+  /* retrieve data structures from XML file */
+  if (!parseXMLFile(xml_filename, instrument)) {
+    fprintf(stderr, "PlayedImpedance error: ");
+    fprintf(stderr, "PlayedImpedance failed to parse XML file.\n");
+    return 0;
+  }
+  if (tolerance > 0.0) {
+    /* cut the bore only as finely as the gradient and fhi require */
+    discretiseWoodwindAdaptive(*instrument, fhi, tolerance, WW_T_0, WW_T_AMB,
+                               WW_T_GRAD, WW_HUMID, WW_X_CO2);
+    fprintSegmentation(stderr, *instrument);
+  } else {
+    /* the cylinders follow the gradient whole, so by default only the
+    cones are cut up */
+    if (maxLength > 0.0)
+      discretiseWoodwind(*instrument, maxLength);
+    else
+      discretiseWoodwindCones(*instrument, WW_MAX_LENGTH);
+    if (halve)
+      halveWoodwind(*instrument);
+    setAirProperties(*instrument, WW_T_0, WW_T_AMB, WW_T_GRAD, WW_HUMID,
+                     WW_X_CO2);
+  }
+  /* precompute the frequency-independent terms of every element */
+  compileWoodwind(*instrument, entryradius / woodwindEntryRadius(*instrument));
+  /* cache the head and unit cell matrices on the spectrum grid */
+  setFrequencyGrid(*instrument, grid);
+  return 1;
+}
 int parseCommandLine(int argc, char **argv, double *flo, double *fhi,
-                     double *fres, char **input_filename, char **xml_filename) {
+                     double *fres, double *tolerance, double *maxLength,
+                     char **sampling, int *analysis, char **input_filename,
+                     char **xml_filename) {
   int i;
   double d;
-  int lflag = 0, hflag = 0, rflag = 0;
-  int numoptions = 3, numinputfiles = 2;
+  int lflag = 0, hflag = 0, rflag = 0, aflag = 0, xflag = 0, gflag = 0;
+  int nflag = 0;
+  int numoptions = 7, numinputfiles = 2;
   int minargc = 1 + numinputfiles;
   int maxargc = minargc + 2 * numoptions;
   /* Check correct number of parameters */
@@ -104,6 +346,10 @@ int parseCommandLine(int argc, char **argv, double *flo, double *fhi,
   *flo = FLO;
   *fhi = FHI;
   *fres = FRES;
+  *tolerance = 0.0;
+  *maxLength = 0.0;
+  *sampling = NULL;
+  *analysis = ANALYSIS_NONE;
   /* Check and set options */
   for (i = 1; i < (argc - numinputfiles); i += 2) {
     if (strcmp(argv[i], "-l") == 0) {
@@ -139,10 +385,58 @@ int parseCommandLine(int argc, char **argv, double *flo, double *fhi,
       rflag = 1;
       continue;
     }
+    if (strcmp(argv[i], "-a") == 0) {
+      if (aflag)
+        return 0;
+      *tolerance = atof(argv[i + 1]);
+      if (*tolerance <= 0.0) {
+        fprintf(stderr, "Invalid -a option\n");
+        return 0;
+      }
+      aflag = 1;
+      continue;
+    }
+    if (strcmp(argv[i], "-x") == 0) {
+      if (xflag)
+        return 0;
+      *maxLength = atof(argv[i + 1]);
+      if (*maxLength <= 0.0) {
+        fprintf(stderr, "Invalid -x option\n");
+        return 0;
+      }
+      xflag = 1;
+      continue;
+    }
+    if (strcmp(argv[i], "-g") == 0) {
+      if (gflag)
+        return 0;
+      *sampling = argv[i + 1];
+      gflag = 1;
+      continue;
+    }
+    if (strcmp(argv[i], "-n") == 0) {
+      if (nflag)
+        return 0;
+      if (strcmp(argv[i + 1], "notes") == 0)
+        *analysis = ANALYSIS_NOTES;
+      else if (strcmp(argv[i + 1], "harmonicity") == 0)
+        *analysis = ANALYSIS_HARMONICITY;
+      else {
+        fprintf(stderr, "Invalid -n option\n");
+        return 0;
+      }
+      nflag = 1;
+      continue;
+    }
     /* else invalid option */
     fprintf(stderr, "Invalid option: %s\n", argv[i]);
     return 0;
   }
+  /* Extrapolation needs the fixed discretisation */
+  if (aflag && xflag) {
+    fprintf(stderr, "The -a and -x options cannot be combined\n");
+    return 0;
+  }
   /* Swap frequency low and high values if inverted */
   if ((*flo > *fhi) && (*flo != 0.0) && (*fhi != 0.0)) {
     d = *flo;
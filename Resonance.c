@@ -0,0 +1,314 @@
+/*
+Resonance.c
+Locates the resonances of a model directly. Refer to Resonance.h for
+interface details.
+The minimisation and root finding follow Brent (1973), "Algorithms
+for Minimization without Derivatives".
+*/
+#include "Resonance.h"
+#include <float.h>
+#include <math.h>
+#include <stdlib.h>
+/* golden section ratio used by the minimisation */
+#define CGOLD 0.3819660
+/* rise in dB defining the bandwidth */
+#define BANDWIDTH_DB 3.0
+/* Model: an ImpedanceFunction, its ImpedanceDerivativeFunction (may be
+NULL) and the number of times either has been evaluated */
+typedef struct model_str {
+  ImpedanceFunction impedance;
+  ImpedanceDerivativeFunction derivative;
+  void *context;
+  int numEvaluations;
+} Model;
+/* the functions whose roots are found: the reactance, the slope of the
+magnitude, or the magnitude in dB less a level */
+typedef enum { REACTANCE, SLOPE, MAGNITUDE } rootType;
+/* evaluates the magnitude in dB and the reactance at f */
+static double evaluate(Model *model, double f, double *reactance) {
+  complex Z = model->impedance(f, model->context);
+  model->numEvaluations++;
+  if (reactance != NULL)
+    *reactance = Z.Im;
+  return 20.0 * log10(modz(Z));
+}
+/* evaluates the slope of the log magnitude at f, d ln|Z| / df =
+Re((dZ / df) / Z) */
+static double evaluateSlope(Model *model, double f) {
+  complex dZdf, Z = model->derivative(f, model->context, &dZdf);
+  model->numEvaluations++;
+  return divz(dZdf, Z).Re;
+}
+/* the tolerance in frequency about x */
+static double tolerance(double x, double ftol) {
+  return ftol + RESONANCE_MIN_PRECISION * fabs(x);
+}
+/* the value at f of the function whose root is sought */
+static double rootFunction(Model *model, rootType type, double level,
+                           double f) {
+  double X, dB;
+  if (type == SLOPE)
+    return evaluateSlope(model, f);
+  dB = evaluate(model, f, &X);
+  return (type == REACTANCE) ? X : dB - level;
+}
+/* finds the root of a function between a and b, given its values fa
+and fb at them of opposite signs */
+static double brentRoot(Model *model, rootType type, double level, double a,
+                        double b, double fa, double fb, double ftol) {
+  double c = b, fc = fb, d = b - a, e = d;
+  double p, q, r, s, tol1, xm, min1, min2;
+  int iter;
+  for (iter = 0; iter < RESONANCE_MAX_ITERATIONS; iter++) {
+    /* keep the root between b and c */
+    if (((fb > 0.0) && (fc > 0.0)) || ((fb < 0.0) && (fc < 0.0))) {
+      c = a;
+      fc = fa;
+      d = e = b - a;
+    }
+    /* b is the best estimate */
+    if (fabs(fc) < fabs(fb)) {
+      a = b;
+      b = c;
+      c = a;
+      fa = fb;
+      fb = fc;
+      fc = fa;
+    }
+    tol1 = 2.0 * DBL_EPSILON * fabs(b) + 0.5 * tolerance(b, ftol);
+    xm = 0.5 * (c - b);
+    if ((fabs(xm) <= tol1) || (fb == 0.0))
+      return b;
+    if ((fabs(e) >= tol1) && (fabs(fa) > fabs(fb))) {
+      /* inverse quadratic (or linear) interpolation */
+      s = fb / fa;
+      if (a == c) {
+        p = 2.0 * xm * s;
+        q = 1.0 - s;
+      } else {
+        q = fa / fc;
+        r = fb / fc;
+        p = s * (2.0 * xm * q * (q - r) - (b - a) * (r - 1.0));
+        q = (q - 1.0) * (r - 1.0) * (s - 1.0);
+      }
+      if (p > 0.0)
+        q = -q;
+      p = fabs(p);
+      min1 = 3.0 * xm * q - fabs(tol1 * q);
+      min2 = fabs(e * q);
+      if (2.0 * p < ((min1 < min2) ? min1 : min2)) {
+        e = d;
+        d = p / q;
+      } else {
+        /* bisection */
+        d = xm;
+        e = d;
+      }
+    } else {
+      d = xm;
+      e = d;
+    }
+    a = b;
+    fa = fb;
+    if (fabs(d) > tol1)
+      b += d;
+    else
+      b += (xm > 0.0) ? tol1 : -tol1;
+    fb = rootFunction(model, type, level, b);
+  }
+  return b;
+}
+/* finds the minimum of the magnitude between lo and hi, given a point
+x between them with value fx lower than at both, returning its
+frequency and setting its value */
+static double brentMinimum(Model *model, double lo, double x, double hi,
+                           double fx, double ftol, double *fmin) {
+  double w = x, v = x, fw = fx, fv = fx, d = 0.0, e = 0.0;
+  double p, q, r, etemp, tol1, tol2, xm, u, fu;
+  int iter;
+  for (iter = 0; iter < RESONANCE_MAX_ITERATIONS; iter++) {
+    xm = 0.5 * (lo + hi);
+    tol1 = tolerance(x, ftol);
+    tol2 = 2.0 * tol1;
+    if (fabs(x - xm) <= tol2 - 0.5 * (hi - lo))
+      break;
+    if (fabs(e) > tol1) {
+      /* parabola through x, w and v */
+      r = (x - w) * (fx - fv);
+      q = (x - v) * (fx - fw);
+      p = (x - v) * q - (x - w) * r;
+      q = 2.0 * (q - r);
+      if (q > 0.0)
+        p = -p;
+      q = fabs(q);
+      etemp = e;
+      e = d;
+      if ((fabs(p) >= fabs(0.5 * q * etemp)) || (p <= q * (lo - x)) ||
+          (p >= q * (hi - x))) {
+        /* golden section instead */
+        e = (x >= xm) ? lo - x : hi - x;
+        d = CGOLD * e;
+      } else {
+        d = p / q;
+        u = x + d;
+        if ((u - lo < tol2) || (hi - u < tol2))
+          d = (xm > x) ? tol1 : -tol1;
+      }
+    } else {
+      e = (x >= xm) ? lo - x : hi - x;
+      d = CGOLD * e;
+    }
+    u = (fabs(d) >= tol1) ? x + d : x + ((d > 0.0) ? tol1 : -tol1);
+    fu = evaluate(model, u, NULL);
+    if (fu <= fx) {
+      if (u >= x)
+        lo = x;
+      else
+        hi = x;
+      v = w;
+      w = x;
+      x = u;
+      fv = fw;
+      fw = fx;
+      fx = fu;
+    } else {
+      if (u < x)
+        lo = u;
+      else
+        hi = u;
+      if ((fu <= fw) || (w == x)) {
+        v = w;
+        w = u;
+        fv = fw;
+        fw = fu;
+      } else if ((fu <= fv) || (v == x) || (v == w)) {
+        v = u;
+        fv = fu;
+      }
+    }
+  }
+  *fmin = fx;
+  return x;
+}
+/* finds the minimum of the magnitude between lo and hi, given a point
+x between them lower than both, as the root of the slope of the
+magnitude, returning its frequency and setting its value. Returns NaN
+if the slope does not change sign across the bracket. */
+static double slopeMinimum(Model *model, double lo, double x, double hi,
+                           double ftol, double *fmin) {
+  double slope = evaluateSlope(model, x), end;
+  if (slope < 0.0) {
+    /* the magnitude falls towards hi */
+    end = evaluateSlope(model, hi);
+    if (end <= 0.0)
+      return NAN;
+    x = brentRoot(model, SLOPE, 0.0, x, hi, slope, end, ftol);
+  } else if (slope > 0.0) {
+    end = evaluateSlope(model, lo);
+    if (end >= 0.0)
+      return NAN;
+    x = brentRoot(model, SLOPE, 0.0, lo, x, end, slope, ftol);
+  }
+  *fmin = evaluate(model, x, NULL);
+  return x;
+}
+/* finds the frequency beside a minimum at which the magnitude has
+risen to level, searching from the minimum at f0 past the end of its
+bracket at f1 (value dB1) and on through the scan in the direction
+step (1 or -1) from scan index i, while the magnitude keeps rising.
+Returns NaN if the magnitude falls again first. */
+static double bandEdge(Model *model, const double *f, const double *dB,
+                       int n, int i, int step, double f0, double dB0,
+                       double f1, double dB1, double level, double ftol) {
+  double prevf = f0, prevdB = dB0;
+  for (;;) {
+    if (dB1 >= level)
+      return brentRoot(model, MAGNITUDE, level, prevf, f1, prevdB - level,
+                       dB1 - level, ftol);
+    if (dB1 < prevdB)
+      return NAN;
+    prevf = f1;
+    prevdB = dB1;
+    i += step;
+    if ((i < 0) || (i >= n))
+      return NAN;
+    f1 = f[i];
+    dB1 = dB[i];
+  }
+}
+/* whether the magnitude at scan index i is lower than at both its
+neighbours */
+static int scanMinimum(const double *dB, int n, int i) {
+  return (i > 0) && (i < n - 1) && (dB[i] < dB[i - 1]) &&
+         (dB[i] <= dB[i + 1]);
+}
+Vector findResonances(ImpedanceFunction impedance,
+                      ImpedanceDerivativeFunction derivative, void *context,
+                      double flo, double fhi, double fstep, double ftol,
+                      int *numEvaluations) {
+  Vector resonances = createVector();
+  Model model;
+  Resonance res;
+  double *f, *dB, *X;
+  double lo, mid, hi, dBmid, fmin, dBmin, fup, fdown;
+  int n, i, ilo, ihi;
+  model.impedance = impedance;
+  model.derivative = derivative;
+  model.context = context;
+  model.numEvaluations = 0;
+  /* scan */
+  n = (int)floor((fhi - flo) / fstep + 1.0e-6) + 1;
+  f = (double *)malloc((n > 0 ? n : 1) * sizeof(double));
+  dB = (double *)malloc((n > 0 ? n : 1) * sizeof(double));
+  X = (double *)malloc((n > 0 ? n : 1) * sizeof(double));
+  for (i = 0; i < n; i++) {
+    f[i] = flo + i * fstep;
+    dB[i] = evaluate(&model, f[i], &X[i]);
+  }
+  for (i = 0; i < n - 1; i++) {
+    /* bracket a minimum at a scanned frequency (i is its lower
+    neighbour)... */
+    if (scanMinimum(dB, n, i + 1)) {
+      ilo = i;
+      ihi = i + 2;
+      mid = f[i + 1];
+      dBmid = dB[i + 1];
+    }
+    /* ...or at the root of the reactance between two scanned
+    frequencies which are not themselves minima */
+    else if ((X[i] < 0.0) && (X[i + 1] >= 0.0) &&
+             !scanMinimum(dB, n, i) && !scanMinimum(dB, n, i + 1)) {
+      ilo = i;
+      ihi = i + 1;
+      mid = brentRoot(&model, REACTANCE, 0.0, f[i], f[i + 1], X[i],
+                      X[i + 1], fstep * 1.0e-3);
+      dBmid = evaluate(&model, mid, NULL);
+      if ((dBmid >= dB[i]) || (dBmid >= dB[i + 1]))
+        continue;
+    } else
+      continue;
+    lo = f[ilo];
+    hi = f[ihi];
+    fmin = (derivative != NULL)
+               ? slopeMinimum(&model, lo, mid, hi, ftol, &dBmin)
+               : NAN;
+    if (isnan(fmin))
+      fmin = brentMinimum(&model, lo, mid, hi, dBmid, ftol, &dBmin);
+    /* the bandwidth */
+    fdown = bandEdge(&model, f, dB, n, ilo, -1, fmin, dBmin, lo, dB[ilo],
+                     dBmin + BANDWIDTH_DB, ftol);
+    fup = bandEdge(&model, f, dB, n, ihi, 1, fmin, dBmin, hi, dB[ihi],
+                   dBmin + BANDWIDTH_DB, ftol);
+    res = (Resonance)malloc(sizeof(*res));
+    res->f = fmin;
+    res->Z = dBmin;
+    res->B = fup - fdown;
+    addElement(resonances, res);
+  }
+  free(f);
+  free(dB);
+  free(X);
+  if (numEvaluations != NULL)
+    *numEvaluations = model.numEvaluations;
+  return resonances;
+}
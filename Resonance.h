@@ -0,0 +1,62 @@
+/*
+Resonance.h
+Locates the resonances (minima of the magnitude of the input
+impedance) of a model directly: a coarse scan brackets each minimum,
+which is then refined by iterations on the model itself rather than by
+fitting a dense, rounded spectrum.
+*/
+#ifndef RESONANCE_H_PROTECTOR
+#define RESONANCE_H_PROTECTOR
+#include "Complex.h"
+#include "Vector.h"
+/* Smallest relative precision to which a frequency is refined (about
+the square root of the machine precision, below which the magnitude
+near a minimum no longer changes measurably) */
+#define RESONANCE_MIN_PRECISION 1.0e-8
+/* Maximum number of iterations of a refinement */
+#define RESONANCE_MAX_ITERATIONS 100
+/* ImpedanceFunction: evaluates an input impedance at frequency f */
+typedef complex (*ImpedanceFunction)(double f, void *context);
+/* ImpedanceDerivativeFunction: evaluates an input impedance at
+frequency f, setting its derivative with respect to frequency */
+typedef complex (*ImpedanceDerivativeFunction)(double f, void *context,
+                                               complex *dZdf);
+/* Resonance: { frequency, impedance in dB, bandwidth (full width at
+3 dB above the minimum, NaN if the minimum is too shallow) } */
+typedef struct resonance_str {
+  double f;
+  double Z;
+  double B;
+} * Resonance;
+Vector findResonances(ImpedanceFunction impedance,
+                      ImpedanceDerivativeFunction derivative, void *context,
+                      double flo, double fhi, double fstep, double ftol,
+                      int *numEvaluations);
+/*
+Finds the resonances between two frequencies. The impedance is
+scanned every fstep Hz; a minimum is bracketed either by a scanned
+frequency at which the magnitude is lower than at both neighbours, or
+by a pair of neighbours between which the reactance changes from
+negative to positive and at whose root the magnitude is lower than at
+both. Each minimum is then located by Brent's method: given the
+derivative, as the root of the slope of the magnitude by Brent's root
+finder, otherwise by Brent's minimisation. The frequencies at which
+the magnitude is 3 dB higher either side are found by Brent's root
+finder, bracketed by the scan.
+Parameters:
+impedance: the ImpedanceFunction
+derivative: the ImpedanceDerivativeFunction of the same impedance (may
+be NULL)
+context: passed to impedance and derivative
+flo: the lowest frequency in Hz
+fhi: the highest frequency in Hz
+fstep: the spacing of the scan in Hz (smaller than half the distance
+between a minimum and its neighbouring maxima)
+ftol: the precision of the frequencies in Hz (limited to
+RESONANCE_MIN_PRECISION relative)
+numEvaluations: the return variable for the number of evaluations of
+the impedance (may be NULL)
+Returns:
+a Vector of Resonance structs in increasing order of frequency
+*/
+#endif
@@ -0,0 +1,213 @@
+/*
+Resonances.c
+Locates the resonances of a played flute directly from the physical
+model, for each fingering of an input file.
+*/
+#include "ParseXML.h"
+#include "Resonance.h"
+#include "Vector.h"
+#include "WoodwindProgram.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+/* Played: the played impedance evaluated by playedZ and
+playedZDerivative { instrument, midi number of the fingering } */
+typedef struct played_str {
+  Woodwind instrument;
+  int midi;
+} Played;
+int parseCommandLine(int argc, char **argv, double *flo, double *fhi,
+                     double *fstep, double *ftol, char **input_filename,
+                     char **xml_filename);
+int prepareInstrument(char *xml_filename, Woodwind *instrument);
+int parseInputFile(Vector midiv, Vector holestringv, char *input_filename);
+complex playedZ(double f, void *context);
+complex playedZDerivative(double f, void *context, complex *dZdf);
+/* Default spectrum range, scan spacing and precision */
+#define FLO 200.0
+#define FHI 4000.0
+#define FSTEP 50.0
+#define FTOL 1.0e-6
+int main(int argc, char **argv) {
+  double flo, fhi, fstep, ftol;
+  char *input_filename;
+  char *xml_filename;
+  Vector midiv = createVector();
+  Vector holestringv = createVector();
+  Vector resonances;
+  Played played;
+  Resonance res;
+  char *holestring;
+  int i, j, numEvaluations;
+  /* check correct usage */
+  if (!parseCommandLine(argc, argv, &flo, &fhi, &fstep, &ftol,
+                        &input_filename, &xml_filename)) {
+    fprintf(stderr, "Usage: Resonances [OPTIONS] <input file> <XML file>\n\n");
+    fprintf(stderr, " Options:\n");
+    fprintf(stderr, "\t-l <flo> (default 200.0)\n");
+    fprintf(stderr, "\t-h <fhi> (default 4000.0)\n");
+    fprintf(stderr, "\t-r <scan spacing> (default 50.0)\n");
+    fprintf(stderr, "\t-p <precision in Hz> (default 1e-6)\n\n");
+    fprintf(stderr, " <input file>:\n");
+    fprintf(stderr, "\t- Must be a tab-delimited list of midi numbers and\n");
+    fprintf(stderr, "\t holestrings, one set per line.\n\n");
+    fprintf(stderr, " Output:\n");
+    fprintf(stderr, "\t- One line per resonance: midi number, frequency,\n");
+    fprintf(stderr, "\t impedance (dB) and 3 dB bandwidth (Hz).\n\n");
+    return -1;
+  }
+  /* parse input file */
+  if (!parseInputFile(midiv, holestringv, input_filename)) {
+    fprintf(stderr, "Resonances error: ");
+    fprintf(stderr, "Resonances failed to parse input file.\n");
+    return -1;
+  }
+  if (!prepareInstrument(xml_filename, &played.instrument))
+    return -1;
+  /* for each fingering... */
+  for (i = 0; i < sizeVector(midiv); i++) {
+    /* set midi and holestring from vectors */
+    played.midi = atoi((char *)elementAt(midiv, i));
+    holestring = (char *)elementAt(holestringv, i);
+    /* set and validate fingering */
+    if (!setFingering(played.instrument, holestring)) {
+      fprintf(stderr, "Resonances error: \"%s\" ", holestring);
+      fprintf(stderr, "is an invalid fingering for the given woodwind ");
+      fprintf(stderr, "definition.\n");
+      return -1;
+    }
+    /* locate and output the resonances */
+    resonances = findResonances(playedZ, playedZDerivative, &played, flo,
+                                fhi, fstep, ftol, &numEvaluations);
+    for (j = 0; j < sizeVector(resonances); j++) {
+      res = (Resonance)elementAt(resonances, j);
+      printf("%d\t%.6f\t%.3f\t%.6f\n", played.midi, res->f, res->Z, res->B);
+      free(res);
+    }
+    fprintf(stderr, "Resonances: %d resonances of %d in %d evaluations\n",
+            sizeVector(resonances), played.midi, numEvaluations);
+  }
+  return 0;
+}
+complex playedZ(double f, void *context) {
+  Played *played = (Played *)context;
+  return playedImpedance(f, played->instrument, played->midi);
+}
+complex playedZDerivative(double f, void *context, complex *dZdf) {
+  Played *played = (Played *)context;
+  return playedImpedanceDerivative(f, played->instrument, played->midi, dZdf);
+}
+int prepareInstrument(char *xml_filename, Woodwind *instrument) {
+  double entryradius = WW_EMB_RADIUS;
+  /* retrieve data structures from XML file */
+  if (!parseXMLFile(xml_filename, instrument)) {
+    fprintf(stderr, "Resonances error: ");
+    fprintf(stderr, "Resonances failed to parse XML file.\n");
+    return 0;
+  }
+  discretiseWoodwindCones(*instrument, WW_MAX_LENGTH);
+  setAirProperties(*instrument, WW_T_0, WW_T_AMB, WW_T_GRAD, WW_HUMID,
+                   WW_X_CO2);
+  /* precompute the frequency-independent terms of every element */
+  compileWoodwind(*instrument, entryradius / woodwindEntryRadius(*instrument));
+  return 1;
+}
+int parseCommandLine(int argc, char **argv, double *flo, double *fhi,
+                     double *fstep, double *ftol, char **input_filename,
+                     char **xml_filename) {
+  int i;
+  double d;
+  int lflag = 0, hflag = 0, rflag = 0, pflag = 0;
+  int numoptions = 4, numinputfiles = 2;
+  int minargc = 1 + numinputfiles;
+  int maxargc = minargc + 2 * numoptions;
+  /* Check correct number of parameters */
+  if ((argc < minargc) || (argc % 2 != minargc % 2) || (argc > maxargc))
+    return 0;
+  /* Set default options */
+  *flo = FLO;
+  *fhi = FHI;
+  *fstep = FSTEP;
+  *ftol = FTOL;
+  /* Check and set options */
+  for (i = 1; i < (argc - numinputfiles); i += 2) {
+    if (strcmp(argv[i], "-l") == 0) {
+      if (lflag)
+        return 0;
+      *flo = atof(argv[i + 1]);
+      if (*flo <= 0.0) {
+        fprintf(stderr, "Invalid -l option\n");
+        return 0;
+      }
+      lflag = 1;
+      continue;
+    }
+    if (strcmp(argv[i], "-h") == 0) {
+      if (hflag)
+        return 0;
+      *fhi = atof(argv[i + 1]);
+      if (*fhi <= 0.0) {
+        fprintf(stderr, "Invalid -h option\n");
+        return 0;
+      }
+      hflag = 1;
+      continue;
+    }
+    if (strcmp(argv[i], "-r") == 0) {
+      if (rflag)
+        return 0;
+      *fstep = atof(argv[i + 1]);
+      if (*fstep <= 0.0) {
+        fprintf(stderr, "Invalid -r option\n");
+        return 0;
+      }
+      rflag = 1;
+      continue;
+    }
+    if (strcmp(argv[i], "-p") == 0) {
+      if (pflag)
+        return 0;
+      *ftol = atof(argv[i + 1]);
+      if (*ftol <= 0.0) {
+        fprintf(stderr, "Invalid -p option\n");
+        return 0;
+      }
+      pflag = 1;
+      continue;
+    }
+    /* else invalid option */
+    fprintf(stderr, "Invalid option: %s\n", argv[i]);
+    return 0;
+  }
+  /* Swap frequency low and high values if inverted */
+  if ((*flo > *fhi) && (*flo != 0.0) && (*fhi != 0.0)) {
+    d = *flo;
+    *flo = *fhi;
+    *fhi = d;
+  }
+  /* Set input filename and XML filename */
+  *input_filename = argv[argc - numinputfiles];
+  *xml_filename = argv[argc - numinputfiles + 1];
+  return 1;
+}
+int parseInputFile(Vector midiv, Vector holestringv, char *input_filename) {
+  FILE *fp;
+  char *line;
+  char *delimiters = "\t\n";
+  char *token;
+  /* open input file */
+  if ((fp = fopen(input_filename, "r")) == NULL)
+    return 0;
+  /* add each line (without newline) to hole string vector */
+  while (1) {
+    line = (char *)malloc(BUFSIZ * sizeof(char));
+    if (fgets(line, BUFSIZ, fp) == NULL)
+      break;
+    token = strtok(line, delimiters);
+    addElement(midiv, token);
+    token = strtok(NULL, delimiters);
+    addElement(holestringv, token);
+  }
+  return 1;
+}
@@ -0,0 +1,289 @@
+/*
+Sampling.c
+Selections of the bins of a FrequencyGrid at which to evaluate a
+spectrum. Refer to Sampling.h for interface details.
+*/
+#include "Sampling.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+/* creates a Sampling of the bins selected in a grid */
+static Sampling selectedSampling(FrequencyGrid g, const char *selected,
+                                 int numValues) {
+  Sampling s = (Sampling)malloc(sizeof(*s));
+  int bin, n = 0;
+  for (bin = 0; bin < g->numBins; bin++)
+    n += selected[bin];
+  s->numSamples = n;
+  s->bin = (int *)malloc((n > 0 ? n : 1) * sizeof(int));
+  s->f = (double *)malloc((n > 0 ? n : 1) * sizeof(double));
+  s->numValues = numValues;
+  s->Z = NULL;
+  s->numEvaluations = 0;
+  for (bin = 0, n = 0; bin < g->numBins; bin++) {
+    if (!selected[bin])
+      continue;
+    s->bin[n] = bin;
+    s->f[n] = gridFrequency(g, bin);
+    n++;
+  }
+  return s;
+}
+/* selects n samples per octave, at least a bin apart */
+static void selectLog(FrequencyGrid g, double n, char *selected) {
+  double f, ratio = pow(2, 1 / n);
+  int bin;
+  for (f = g->flo;; f *= ratio) {
+    bin = (int)floor((f - g->flo) / g->fres + 0.5);
+    if (bin >= g->numBins)
+      break;
+    selected[bin] = 1;
+  }
+  selected[g->numBins - 1] = 1;
+}
+/* selects samples every res[i] Hz from edge[i] up to edge[i + 1] */
+static void selectPiecewise(FrequencyGrid g, int numPieces,
+                            const double *edge, const double *res,
+                            char *selected) {
+  int i, bin, first, last, step;
+  for (i = 0; i < numPieces; i++) {
+    first = (int)ceil((edge[i] - g->flo) / g->fres - 1e-6);
+    last = (int)floor((edge[i + 1] - g->flo) / g->fres + 1e-6);
+    step = (int)floor(res[i] / g->fres + 0.5);
+    if (first < 0)
+      first = 0;
+    if (last >= g->numBins)
+      last = g->numBins - 1;
+    if (step < 1)
+      step = 1;
+    for (bin = first; bin <= last; bin += step)
+      selected[bin] = 1;
+    if (last >= first)
+      selected[last] = 1;
+  }
+}
+/* whether the spectrum is not smooth over the interval between the
+samples at bins a and b, given the values at them and at the midpoint
+m */
+static int roughInterval(const complex *Z, int numValues, int a, int m,
+                         int b, double tolerance) {
+  double dBa, dBm, dBb;
+  int v;
+  for (v = 0; v < numValues; v++) {
+    dBa = 20 * log10(modz(Z[a * numValues + v]));
+    dBm = 20 * log10(modz(Z[m * numValues + v]));
+    dBb = 20 * log10(modz(Z[b * numValues + v]));
+    /* curvature */
+    if (fabs(dBm - (dBa + dBb) / 2) > tolerance)
+      return 1;
+    /* phase change */
+    if (fabs(argz(divz(Z[b * numValues + v], Z[a * numValues + v]))) >
+        SAMPLING_MAX_PHASE)
+      return 1;
+  }
+  return 0;
+}
+/* whether the sample at a bin is a peak or dip of any value, compared
+with the nearest samples either side */
+static int isExtremum(const complex *Z, int numValues, const char *selected,
+                      int numBins, int bin) {
+  double mod, below, above;
+  int lo = bin - 1, hi = bin + 1, v;
+  while ((lo >= 0) && !selected[lo])
+    lo--;
+  while ((hi < numBins) && !selected[hi])
+    hi++;
+  if ((lo < 0) || (hi >= numBins))
+    return 0;
+  for (v = 0; v < numValues; v++) {
+    mod = modz(Z[bin * numValues + v]);
+    below = modz(Z[lo * numValues + v]);
+    above = modz(Z[hi * numValues + v]);
+    if (((mod > below) && (mod > above)) || ((mod < below) && (mod < above)))
+      return 1;
+  }
+  return 0;
+}
+/* evaluates the spectrum at the bins in list, storing the values by
+bin */
+static void evaluateBins(FrequencyGrid g, const int *list, int n,
+                         int numValues, SpectrumFunction evaluate,
+                         void *context, complex *Z) {
+  /* zeroed, so that evaluate never reads an unset frequency */
+  double *f = (double *)calloc(n > 0 ? n : 1, sizeof(double));
+  complex *values =
+      (complex *)malloc((n > 0 ? n : 1) * numValues * sizeof(complex));
+  int i;
+  for (i = 0; i < n; i++)
+    f[i] = gridFrequency(g, list[i]);
+  evaluate(f, n, values, context);
+  for (i = 0; i < n; i++)
+    memcpy(Z + list[i] * numValues, values + i * numValues,
+           numValues * sizeof(complex));
+  free(f);
+  free(values);
+}
+/* creates an adaptive Sampling, evaluating each round of midpoints
+together. The intervals beside a sample which is a peak or dip of its
+neighbouring samples are halved down to single bins, so that the true
+extremum is found even if the spectrum is smooth around it. */
+static Sampling adaptiveSampling(FrequencyGrid g, double tolerance,
+                                 int numValues, SpectrumFunction evaluate,
+                                 void *context) {
+  char *selected = (char *)calloc(g->numBins, sizeof(char));
+  complex *Z = (complex *)malloc(g->numBins * numValues * sizeof(complex));
+  /* pending intervals as pairs of bins, and the bins to evaluate */
+  int *interval = (int *)malloc(2 * g->numBins * sizeof(int));
+  int *next = (int *)malloc(2 * g->numBins * sizeof(int));
+  int *list = (int *)malloc(g->numBins * sizeof(int));
+  int *swap;
+  int numIntervals = 0, numNext, n = 0, numEvaluations, i, a, b, m, rough;
+  Sampling s;
+  /* the coarse samples */
+  for (a = 0; a < g->numBins; a += SAMPLING_COARSE_BINS)
+    list[n++] = a;
+  if ((g->numBins > 0) && (list[n - 1] != g->numBins - 1))
+    list[n++] = g->numBins - 1;
+  for (i = 0; i < n; i++) {
+    selected[list[i]] = 1;
+    if ((i > 0) && (list[i] - list[i - 1] > 1)) {
+      interval[2 * numIntervals] = list[i - 1];
+      interval[2 * numIntervals + 1] = list[i];
+      numIntervals++;
+    }
+  }
+  evaluateBins(g, list, n, numValues, evaluate, context, Z);
+  numEvaluations = n;
+  while (numIntervals > 0) {
+    /* evaluate the midpoints of the pending intervals */
+    for (i = 0; i < numIntervals; i++) {
+      m = (interval[2 * i] + interval[2 * i + 1]) / 2;
+      list[i] = m;
+      selected[m] = 1;
+    }
+    evaluateBins(g, list, numIntervals, numValues, evaluate, context, Z);
+    numEvaluations += numIntervals;
+    /* halve the intervals which are not yet smooth, or which end at a
+    peak or dip */
+    numNext = 0;
+    for (i = 0; i < numIntervals; i++) {
+      a = interval[2 * i];
+      b = interval[2 * i + 1];
+      m = (a + b) / 2;
+      rough = roughInterval(Z, numValues, a, m, b, tolerance) ||
+              isExtremum(Z, numValues, selected, g->numBins, m);
+      if ((m - a > 1) &&
+          (rough || isExtremum(Z, numValues, selected, g->numBins, a))) {
+        next[2 * numNext] = a;
+        next[2 * numNext + 1] = m;
+        numNext++;
+      }
+      if ((b - m > 1) &&
+          (rough || isExtremum(Z, numValues, selected, g->numBins, b))) {
+        next[2 * numNext] = m;
+        next[2 * numNext + 1] = b;
+        numNext++;
+      }
+    }
+    swap = interval;
+    interval = next;
+    next = swap;
+    numIntervals = numNext;
+  }
+  s = selectedSampling(g, selected, numValues);
+  s->numEvaluations = numEvaluations;
+  s->Z = (complex *)malloc((s->numSamples > 0 ? s->numSamples : 1) *
+                           numValues * sizeof(complex));
+  for (i = 0; i < s->numSamples; i++)
+    memcpy(s->Z + i * numValues, Z + s->bin[i] * numValues,
+           numValues * sizeof(complex));
+  free(selected);
+  free(Z);
+  free(interval);
+  free(next);
+  free(list);
+  return s;
+}
+/* parses a list of numbers separated by ':', returning their number
+or -1 if the list is invalid */
+static int parseNumbers(const char *list, double *x, int max) {
+  char *end;
+  int n = 0;
+  while (n < max) {
+    x[n++] = strtod(list, &end);
+    if (end == list)
+      return -1;
+    if (*end == '\0')
+      return n;
+    if (*end != ':')
+      return -1;
+    list = end + 1;
+  }
+  return -1;
+}
+Sampling createSampling(FrequencyGrid g, const char *spec, int numValues,
+                        SpectrumFunction evaluate, void *context) {
+  double x[2 * SAMPLING_MAX_PIECES + 1], edge[SAMPLING_MAX_PIECES + 1],
+      res[SAMPLING_MAX_PIECES];
+  char *selected;
+  Sampling s;
+  int n, i;
+  if (g->numBins <= 0)
+    return NULL;
+  if ((spec != NULL) && (strncmp(spec, "adaptive:", 9) == 0)) {
+    if ((parseNumbers(spec + 9, x, 1) != 1) || (x[0] <= 0.0))
+      return NULL;
+    return adaptiveSampling(g, x[0], numValues, evaluate, context);
+  }
+  selected = (char *)calloc(g->numBins, sizeof(char));
+  if ((spec == NULL) || (strcmp(spec, "uniform") == 0))
+    memset(selected, 1, g->numBins * sizeof(char));
+  else if (strncmp(spec, "log:", 4) == 0) {
+    if ((parseNumbers(spec + 4, x, 1) != 1) || (x[0] <= 0.0)) {
+      free(selected);
+      return NULL;
+    }
+    selectLog(g, x[0], selected);
+  } else if (strncmp(spec, "piecewise:", 10) == 0) {
+    /* edges and resolutions alternate, starting and ending with an
+    edge */
+    n = parseNumbers(spec + 10, x, 2 * SAMPLING_MAX_PIECES + 1);
+    if ((n < 3) || (n % 2 == 0)) {
+      free(selected);
+      return NULL;
+    }
+    for (i = 0; i < n / 2; i++) {
+      edge[i] = x[2 * i];
+      res[i] = x[2 * i + 1];
+      if ((res[i] <= 0.0) || (x[2 * i + 2] <= edge[i])) {
+        free(selected);
+        return NULL;
+      }
+    }
+    edge[n / 2] = x[n - 1];
+    selectPiecewise(g, n / 2, edge, res, selected);
+  } else {
+    free(selected);
+    return NULL;
+  }
+  s = selectedSampling(g, selected, numValues);
+  free(selected);
+  return s;
+}
+void evaluateSampling(Sampling s, SpectrumFunction evaluate,
+                      void *context) {
+  if (s->Z != NULL)
+    return;
+  s->Z = (complex *)malloc((s->numSamples > 0 ? s->numSamples : 1) *
+                           s->numValues * sizeof(complex));
+  evaluate(s->f, s->numSamples, s->Z, context);
+  s->numEvaluations += s->numSamples;
+}
+void freeSampling(Sampling s) {
+  if (s == NULL)
+    return;
+  free(s->bin);
+  free(s->f);
+  free(s->Z);
+  free(s);
+}
@@ -0,0 +1,77 @@
+/*
+Sampling.h
+Selections of the bins of a FrequencyGrid at which to evaluate a
+spectrum: every bin (uniform), log-spaced, piecewise uniform with a
+resolution per frequency band, or adaptive, refined only where the
+spectrum is not smooth. The samples always lie on bins of the grid, so
+they share its per-bin caches.
+*/
+#ifndef SAMPLING_H_PROTECTOR
+#define SAMPLING_H_PROTECTOR
+#include "Complex.h"
+#include "FrequencyGrid.h"
+/* Initial spacing of adaptive samples in bins */
+#define SAMPLING_COARSE_BINS 16
+/* Largest change of phase between adjacent adaptive samples (rad) */
+#define SAMPLING_MAX_PHASE 1.0
+/* Maximum number of bands of a piecewise sampling */
+#define SAMPLING_MAX_PIECES 64
+/* SpectrumFunction: evaluates numValues complex values of a spectrum
+at each of n frequencies f, value v of frequency i in Z[i * numValues
++ v] */
+typedef void (*SpectrumFunction)(const double *f, int n, complex *Z,
+                                 void *context);
+/* Sampling: { number of samples, bin and frequency of each sample, in
+increasing order, number of values per sample, the values at each
+sample (adaptive samplings only, otherwise NULL), number of
+evaluations of the spectrum } */
+typedef struct sampling_str {
+  int numSamples;
+  int *bin;
+  double *f;
+  int numValues;
+  complex *Z;
+  int numEvaluations;
+} * Sampling;
+Sampling createSampling(FrequencyGrid g, const char *spec, int numValues,
+                        SpectrumFunction evaluate, void *context);
+/*
+Creates a Sampling of a grid from a specification:
+"uniform": every bin
+"log:<n>": n samples per octave (and at least a bin apart)
+"piecewise:<f0>:<res0>:<f1>:<res1>:...:<fn>": samples every res_i Hz
+(rounded to a whole number of bins) from f_i up to f_i+1
+"adaptive:<tolerance>": samples SAMPLING_COARSE_BINS apart, with
+intervals halved while, in any of the values, the magnitude at the
+midpoint differs by more than tolerance dB from the mean of the ends,
+the phase changes by more than SAMPLING_MAX_PHASE, or either end or the
+midpoint is a peak or dip of the samples. Peaks and dips are therefore
+located to a single bin.
+Only adaptive samplings evaluate the spectrum.
+Parameters:
+g: the FrequencyGrid
+spec: the specification (NULL for uniform)
+numValues: the number of values of the spectrum at each frequency
+evaluate: the SpectrumFunction (used by adaptive samplings only)
+context: passed to evaluate
+Returns:
+a new Sampling
+NULL if spec is invalid
+*/
+void evaluateSampling(Sampling s, SpectrumFunction evaluate,
+                      void *context);
+/*
+Evaluates the spectrum at every sample of a Sampling which does not
+hold its values yet (that is, one which is not adaptive).
+Parameters:
+s: the Sampling
+evaluate: the SpectrumFunction
+context: passed to evaluate
+*/
+void freeSampling(Sampling s);
+/*
+Frees a Sampling.
+Parameters:
+s: the Sampling (may be NULL)
+*/
+#endif
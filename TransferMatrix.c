@@ -6,54 +6,151 @@ Refer to TransferMatrix.h for interface details.
 */
 #include "TransferMatrix.h"
 #include <stdlib.h>
-TransferMatrix createTransferMatrix(complex A, complex B, complex C,
-                                    complex D) {
-  TransferMatrix m = malloc(sizeof(*m));
-  m->A = A;
-  m->B = B;
-  m->C = C;
-  m->D = D;
+TransferMatrix makem(complex A, complex B, complex C, complex D) {
+  TransferMatrix m;
+  m.A = A;
+  m.B = B;
+  m.C = C;
+  m.D = D;
   return m;
 }
-TransferMatrix identitym() {
-  return createTransferMatrix(one, zero, zero, one);
-}
-void lmultm(TransferMatrix m, TransferMatrix mult) {
-  complex A, B, C, D;
-  A = addz(multz(mult->A, m->A), multz(mult->B, m->C));
-  B = addz(multz(mult->A, m->B), multz(mult->B, m->D));
-  C = addz(multz(mult->C, m->A), multz(mult->D, m->C));
-  D = addz(multz(mult->C, m->B), multz(mult->D, m->D));
-  m->A = A;
-  m->B = B;
-  m->C = C;
-  m->D = D;
-}
-void rmultm(TransferMatrix m, TransferMatrix mult) {
-  complex A, B, C, D;
-  A = addz(multz(m->A, mult->A), multz(m->B, mult->C));
-  B = addz(multz(m->A, mult->B), multz(m->B, mult->D));
-  C = addz(multz(m->C, mult->A), multz(m->D, mult->C));
-  D = addz(multz(m->C, mult->B), multz(m->D, mult->D));
-  m->A = A;
-  m->B = B;
-  m->C = C;
-  m->D = D;
+TransferMatrix identitym() { return makem(one, zero, zero, one); }
+TransferMatrix multm(TransferMatrix m1, TransferMatrix m2) {
+  TransferMatrix m;
+  m.A = addz(multz(m1.A, m2.A), multz(m1.B, m2.C));
+  m.B = addz(multz(m1.A, m2.B), multz(m1.B, m2.D));
+  m.C = addz(multz(m1.C, m2.A), multz(m1.D, m2.C));
+  m.D = addz(multz(m1.C, m2.B), multz(m1.D, m2.D));
+  return m;
 }
 complex calcZin(TransferMatrix m, complex Zload) {
   complex Zin, p1, p2, U1, U2;
   p2 = (equalz(Zload, inf)) ? one : divz(Zload, addz(Zload, one));
   U2 = (equalz(Zload, inf)) ? zero : divz(one, addz(Zload, one));
-  p1 = addz(multz(m->A, p2), multz(m->B, U2));
-  U1 = addz(multz(m->C, p2), multz(m->D, U2));
+  p1 = addz(multz(m.A, p2), multz(m.B, U2));
+  U1 = addz(multz(m.C, p2), multz(m.D, U2));
   Zin = divz(p1, U1);
   return Zin;
 }
-void invertm(TransferMatrix m) {
-  complex det = subz(multz(m->A, m->D), multz(m->B, m->C));
-  complex A = m->A;
-  m->A = divz(m->D, det);
-  m->B = divz(multz(real(-1.0), m->B), det);
-  m->C = divz(multz(real(-1.0), m->C), det);
-  m->D = divz(A, det);
+TransferMatrix invertm(TransferMatrix m) {
+  complex det = subz(multz(m.A, m.D), multz(m.B, m.C));
+  TransferMatrix inv;
+  inv.A = divz(m.D, det);
+  inv.B = divz(multz(real(-1.0), m.B), det);
+  inv.C = divz(multz(real(-1.0), m.C), det);
+  inv.D = divz(m.A, det);
+  return inv;
+}
+DualTransferMatrix identitydm() {
+  DualTransferMatrix m;
+  m.A = constdz(one);
+  m.B = constdz(zero);
+  m.C = constdz(zero);
+  m.D = constdz(one);
+  return m;
+}
+DualTransferMatrix multdm(DualTransferMatrix m1, DualTransferMatrix m2) {
+  DualTransferMatrix m;
+  m.A = adddz(multdz(m1.A, m2.A), multdz(m1.B, m2.C));
+  m.B = adddz(multdz(m1.A, m2.B), multdz(m1.B, m2.D));
+  m.C = adddz(multdz(m1.C, m2.A), multdz(m1.D, m2.C));
+  m.D = adddz(multdz(m1.C, m2.B), multdz(m1.D, m2.D));
+  return m;
+}
+dualcomplex calcZinDual(DualTransferMatrix m, dualcomplex Zload) {
+  dualcomplex p1, p2, U1, U2, denom;
+  if (equalz(Zload.v, inf)) {
+    p2 = constdz(one);
+    U2 = constdz(zero);
+  } else {
+    denom = adddz(Zload, constdz(one));
+    p2 = divdz(Zload, denom);
+    U2 = divdz(constdz(one), denom);
+  }
+  p1 = adddz(multdz(m.A, p2), multdz(m.B, U2));
+  U1 = adddz(multdz(m.C, p2), multdz(m.D, U2));
+  return divdz(p1, U1);
+}
+TransferMatrixBatch createTransferMatrixBatch(int n) {
+  TransferMatrixBatch m = malloc(sizeof(*m));
+  /* allocate all eight arrays in a single block */
+  m->n = n;
+  m->ARe = malloc(8 * (n > 0 ? n : 1) * sizeof(double));
+  m->AIm = m->ARe + n;
+  m->BRe = m->AIm + n;
+  m->BIm = m->BRe + n;
+  m->CRe = m->BIm + n;
+  m->CIm = m->CRe + n;
+  m->DRe = m->CIm + n;
+  m->DIm = m->DRe + n;
+  return m;
+}
+void freeTransferMatrixBatch(TransferMatrixBatch m) {
+  free(m->ARe);
+  free(m);
+}
+void identityBatch(TransferMatrixBatch m) {
+  int i;
+  for (i = 0; i < m->n; i++) {
+    m->ARe[i] = 1.0;
+    m->AIm[i] = 0.0;
+    m->BRe[i] = 0.0;
+    m->BIm[i] = 0.0;
+    m->CRe[i] = 0.0;
+    m->CIm[i] = 0.0;
+    m->DRe[i] = 1.0;
+    m->DIm[i] = 0.0;
+  }
+}
+void multBatch(TransferMatrixBatch m, TransferMatrixBatch mult) {
+  int i;
+  double ARe, AIm, BRe, BIm, CRe, CIm, DRe, DIm;
+  for (i = 0; i < m->n; i++) {
+    ARe = m->ARe[i] * mult->ARe[i] - m->AIm[i] * mult->AIm[i] +
+          m->BRe[i] * mult->CRe[i] - m->BIm[i] * mult->CIm[i];
+    AIm = m->ARe[i] * mult->AIm[i] + m->AIm[i] * mult->ARe[i] +
+          m->BRe[i] * mult->CIm[i] + m->BIm[i] * mult->CRe[i];
+    BRe = m->ARe[i] * mult->BRe[i] - m->AIm[i] * mult->BIm[i] +
+          m->BRe[i] * mult->DRe[i] - m->BIm[i] * mult->DIm[i];
+    BIm = m->ARe[i] * mult->BIm[i] + m->AIm[i] * mult->BRe[i] +
+          m->BRe[i] * mult->DIm[i] + m->BIm[i] * mult->DRe[i];
+    CRe = m->CRe[i] * mult->ARe[i] - m->CIm[i] * mult->AIm[i] +
+          m->DRe[i] * mult->CRe[i] - m->DIm[i] * mult->CIm[i];
+    CIm = m->CRe[i] * mult->AIm[i] + m->CIm[i] * mult->ARe[i] +
+          m->DRe[i] * mult->CIm[i] + m->DIm[i] * mult->CRe[i];
+    DRe = m->CRe[i] * mult->BRe[i] - m->CIm[i] * mult->BIm[i] +
+          m->DRe[i] * mult->DRe[i] - m->DIm[i] * mult->DIm[i];
+    DIm = m->CRe[i] * mult->BIm[i] + m->CIm[i] * mult->BRe[i] +
+          m->DRe[i] * mult->DIm[i] + m->DIm[i] * mult->DRe[i];
+    m->ARe[i] = ARe;
+    m->AIm[i] = AIm;
+    m->BRe[i] = BRe;
+    m->BIm[i] = BIm;
+    m->CRe[i] = CRe;
+    m->CIm[i] = CIm;
+    m->DRe[i] = DRe;
+    m->DIm[i] = DIm;
+  }
+}
+TransferMatrix getBatchMatrix(TransferMatrixBatch m, int i) {
+  TransferMatrix e;
+  e.A.Re = m->ARe[i];
+  e.A.Im = m->AIm[i];
+  e.B.Re = m->BRe[i];
+  e.B.Im = m->BIm[i];
+  e.C.Re = m->CRe[i];
+  e.C.Im = m->CIm[i];
+  e.D.Re = m->DRe[i];
+  e.D.Im = m->DIm[i];
+  return e;
+}
+void setBatchMatrix(TransferMatrixBatch m, int i, TransferMatrix e) {
+  m->ARe[i] = e.A.Re;
+  m->AIm[i] = e.A.Im;
+  m->BRe[i] = e.B.Re;
+  m->BIm[i] = e.B.Im;
+  m->CRe[i] = e.C.Re;
+  m->CIm[i] = e.C.Im;
+  m->DRe[i] = e.D.Re;
+  m->DIm[i] = e.D.Im;
 }
@@ -6,16 +6,37 @@ Complex transfer matrix library.
 #ifndef TRANSFERMATRIX_H_PROTECTOR
 #define TRANSFERMATRIX_H_PROTECTOR
 #include "Complex.h"
-/* TransferMatrix: { A, B, C, D } */
+/* TransferMatrix: { A, B, C, D }, passed and returned by value */
 typedef struct transferMatrix_str {
   complex A;
   complex B;
   complex C;
   complex D;
-} * TransferMatrix;
-TransferMatrix createTransferMatrix(complex A, complex B, complex C, complex D);
+} TransferMatrix;
+/* DualTransferMatrix: { A, B, C, D } as dualcomplex numbers, a
+TransferMatrix together with its derivative with respect to
+frequency */
+typedef struct dualTransferMatrix_str {
+  dualcomplex A;
+  dualcomplex B;
+  dualcomplex C;
+  dualcomplex D;
+} DualTransferMatrix;
+/* TransferMatrixBatch: { number of frequencies, the real and imaginary
+parts of A, B, C and D at each frequency as separate arrays } */
+typedef struct transferMatrixBatch_str {
+  int n;
+  double *ARe;
+  double *AIm;
+  double *BRe;
+  double *BIm;
+  double *CRe;
+  double *CIm;
+  double *DRe;
+  double *DIm;
+} * TransferMatrixBatch;
+TransferMatrix makem(complex A, complex B, complex C, complex D);
 /*
-Creates a new TransferMatrix given the complex elements
 Returns:
 The matrix (A, B, C, D).
 */
@@ -24,21 +45,60 @@ TransferMatrix identitym();
 Returns:
 The identity matrix (1, 0, 0, 1).
 */
-void lmultm(TransferMatrix m, TransferMatrix mult);
+TransferMatrix multm(TransferMatrix m1, TransferMatrix m2);
 /*
-Left-multiplies matrix m with matrix mult.
-*/
-void rmultm(TransferMatrix m, TransferMatrix mult);
-/*
-Right-multiplies matrix m with matrix mult.
+Returns:
+The matrix product m1 m2.
 */
-void invertm(TransferMatrix m);
+TransferMatrix invertm(TransferMatrix m);
 /*
-Inverts matrix m.
+Returns:
+The inverse of matrix m.
 */
 complex calcZin(TransferMatrix m, complex Zload);
 /*
 Calculates the input impedance given TransferMatrix m and load
 Zload.
 */
+DualTransferMatrix identitydm();
+/*
+Returns:
+The identity matrix (1, 0, 0, 1), with derivative 0.
+*/
+DualTransferMatrix multdm(DualTransferMatrix m1, DualTransferMatrix m2);
+/*
+Returns:
+The matrix product m1 m2, with its derivative.
+*/
+dualcomplex calcZinDual(DualTransferMatrix m, dualcomplex Zload);
+/*
+Calculates the input impedance and its derivative given
+DualTransferMatrix m and load Zload. Equivalent to calcZin.
+*/
+TransferMatrixBatch createTransferMatrixBatch(int n);
+/*
+Creates a new TransferMatrixBatch of n matrices (uninitialised).
+*/
+void freeTransferMatrixBatch(TransferMatrixBatch m);
+/*
+Frees a TransferMatrixBatch.
+*/
+void identityBatch(TransferMatrixBatch m);
+/*
+Sets every matrix in batch m to the identity matrix.
+*/
+void multBatch(TransferMatrixBatch m, TransferMatrixBatch mult);
+/*
+Right-multiplies each matrix in batch m with the corresponding matrix
+in batch mult.
+*/
+TransferMatrix getBatchMatrix(TransferMatrixBatch m, int i);
+/*
+Returns:
+Matrix i of batch m.
+*/
+void setBatchMatrix(TransferMatrixBatch m, int i, TransferMatrix e);
+/*
+Sets matrix i of batch m to e.
+*/
 #endif
@@ -7,149 +7,83 @@ Refer to Vector.h for interface details.
 #include "Vector.h"
 #include <stdio.h>
 #include <stdlib.h>
+/* initial number of slots (must be a power of two) */
+#define INITIAL_CAPACITY 8
+/* slot of the element at the given index */
+#define SLOT(v, index) (((v)->head + (index)) & ((v)->capacity - 1))
+/* doubles the capacity of a full Vector, unwrapping the ring buffer so
+that the head is at slot 0 */
+static void growVector(Vector v) {
+  int i;
+  void **slots = (void **)malloc(2 * v->capacity * sizeof(void *));
+  for (i = 0; i < v->num; i++)
+    slots[i] = v->slots[SLOT(v, i)];
+  free(v->slots);
+  v->slots = slots;
+  v->capacity *= 2;
+  v->head = 0;
+}
 Vector createVector(void) {
   /* allocate memory for *Vector */
   Vector v = (Vector)malloc(sizeof(*v));
-  /* initialise num to 0, pointers to NULL */
+  /* initialise num to 0 and allocate the initial slots */
   v->num = 0;
-  v->head = NULL;
-  v->tail = NULL;
+  v->capacity = INITIAL_CAPACITY;
+  v->head = 0;
+  v->slots = (void **)malloc(INITIAL_CAPACITY * sizeof(void *));
   return v;
 }
 void addElement(Vector v, void *object) {
-  /* if the Vector is empty, head and tail point to new object */
-  if (v->tail == NULL) {
-    v->tail = (Node)malloc(sizeof(*(v->tail)));
-    v->tail->object = object;
-    v->tail->next = NULL;
-    v->head = v->tail;
-  }
-  /* else, add to end of Vector and update tail */
-  else {
-    v->tail->next = (Node)malloc(sizeof(*(v->tail->next)));
-    v->tail->next->object = object;
-    v->tail->next->next = NULL;
-    v->tail = v->tail->next;
-  }
+  if (v->num == v->capacity)
+    growVector(v);
+  /* add to end of Vector */
+  v->slots[SLOT(v, v->num)] = object;
   /* increment size */
   v->num++;
   return;
 }
 void insertAt(Vector v, void *object, int index) {
   int i;
-  Node cur;
-  Node prev;
-  /* if Vector is empty and insert at 0, head and tail point to new
-  object */
-  if ((v->num == 0) && (index == 0)) {
-    v->tail = (Node)malloc(sizeof(*(v->tail)));
-    v->tail->object = object;
-    v->tail->next = NULL;
-    v->head = v->tail;
-  } else {
-    /* if inserted at beginning, update head */
-    if (index == 0) {
-      cur = v->head;
-      v->head = (Node)malloc(sizeof(*(v->head)));
-      v->head->object = object;
-      v->head->next = cur;
-    } else {
-      /* if inserted at end, update tail */
-      if (index == v->num) {
-        cur = v->tail;
-        v->tail = (Node)malloc(sizeof(*(v->tail)));
-        v->tail->object = object;
-        v->tail->next = NULL;
-        cur->next = v->tail;
-      }
-      /* otherwise, find position in Vector and update appropriately
-       */
-      else {
-        cur = v->head->next;
-        prev = v->head;
-        for (i = 1; i < index; i++) {
-          cur = cur->next;
-          prev = prev->next;
-        }
-        prev->next = (Node)malloc(sizeof(*(prev->next)));
-        prev->next->object = object;
-        prev->next->next = cur;
-      }
-    }
+  if (v->num == v->capacity)
+    growVector(v);
+  /* if inserted at beginning, move head back one slot */
+  if (index == 0) {
+    v->head = SLOT(v, v->capacity - 1);
+    v->slots[v->head] = object;
+  }
+  /* otherwise shift following pointers right by one */
+  else {
+    for (i = v->num; i > index; i--)
+      v->slots[SLOT(v, i)] = v->slots[SLOT(v, i - 1)];
+    v->slots[SLOT(v, index)] = object;
   }
   /* increment size */
   v->num++;
   return;
 }
 void setAt(Vector v, void *object, int index) {
-  int i;
-  Node cur;
-  cur = v->head;
-  /* find indexed element */
-  for (i = 0; i < index; i++) {
-    cur = cur->next;
-  }
-  /* update indexed element with given object */
-  cur->object = object;
+  v->slots[SLOT(v, index)] = object;
   return;
 }
 void popFront(Vector v) {
-  Node second_element;
   /* do nothing if empty vector */
   if (sizeVector(v) == 0)
     return;
-  /* if only 1 element, free head and reinitialise Vector */
-  if (sizeVector(v) == 1) {
-    free(v->head);
-    v->head = NULL;
-    v->tail = NULL;
-    v->num--;
-    return;
-  }
-  /* otherwise remove free head and update head pointer to second
-  element */
-  if (sizeVector(v) > 1) {
-    second_element = v->head->next;
-    free(v->head);
-    v->head = second_element;
-    v->num--;
-    return;
-  }
+  /* advance head to second element */
+  v->head = SLOT(v, 1);
+  v->num--;
+  return;
 }
 void popBack(Vector v) {
-  Node cur;
   /* do nothing if empty vector */
   if (sizeVector(v) == 0)
     return;
-  /* if only 1 element, free tail and reinitialise Vector */
-  if (sizeVector(v) == 1) {
-    free(v->tail);
-    v->head = NULL;
-    v->tail = NULL;
-    v->num--;
-    return;
-  }
-  /* otherwise remove free tail and update tail pointer to second last
-  element */
-  if (sizeVector(v) > 1) {
-    /* advance cur to second last element */
-    for (cur = v->head; cur->next != v->tail; cur = cur->next)
-      ;
-    free(v->tail);
-    v->tail = cur;
-    v->num--;
-    return;
-  }
-}
-void *elementAt(Vector v, int index) {
-  int i;
-  Node cur;
-  cur = v->head;
-  /* find indexed element */
-  for (i = 0; i < index; i++) {
-    cur = cur->next;
-  }
-  /* return found element */
-  return cur->object;
+  v->num--;
+  return;
 }
+void *elementAt(Vector v, int index) { return v->slots[SLOT(v, index)]; }
 int sizeVector(Vector v) { return v->num; }
+void freeVector(Vector v) {
+  free(v->slots);
+  free(v);
+}
@@ -5,21 +5,20 @@ Vector.c is a Vector ADT.
 */
 #ifndef VECTOR_H_PROTECTOR
 #define VECTOR_H_PROTECTOR
-/* Node: { pointer to data struct, pointer to next Node } */
-typedef struct Node_str {
-  void *object;
-  struct Node_str *next;
-} * Node;
 /* Vector:
-{ size count, pointer to head Node, pointer to tail Node } */
+{ size count, capacity, index of head slot, array of slots }
+The slots form a ring buffer whose capacity is a power of two and is
+doubled whenever it is exhausted, so that indexed access, adding to
+either end and removing from either end are all O(1). */
 typedef struct Root_str {
   int num;
-  Node head;
-  Node tail;
+  int capacity;
+  int head;
+  void **slots;
 } * Vector;
 Vector createVector(void);
 /*
-Initialises a vector with num = 0, head = NULL, tail = NULL.
+Initialises an empty vector.
 Returns:
 A Vector if successful, NULL otherwise.
 */
@@ -34,7 +33,8 @@ void insertAt(Vector v, void *object, int index);
 /*
 Inserts a data structure pointer within the given vector at the
 given position.
-All following pointers in the Vector are shifted right by index +1.
+All following pointers in the Vector are shifted right by index +1
+(O(n) in the number of following pointers).
 Parameters:
 v: the Vector to add to.
 object: a pointer to the data structure to be added.
@@ -54,15 +54,16 @@ NOTE: no bounds checking is performed.
 */
 void popFront(Vector v);
 /*
-Removes the Node at the head of the Vector (index 0).
+Removes the pointer at the head of the Vector (index 0).
 If Vector is empty, nothing is done.
-All pointers in the Vector are shifted left by index -1.
+The head of the ring buffer advances by one, so the pointers are not
+moved (the former index 1 becomes index 0).
 Parameters:
 v: the Vector to be updated.
 */
 void popBack(Vector v);
 /*
-Removes the Node at the tail of the Vector.
+Removes the pointer at the tail of the Vector.
 If Vector is empty, nothing is done.
 Parameters:
 v: the Vector to be updated.
@@ -87,4 +88,10 @@ v: the given Vector.
 Returns:
 The number of stored elements.
 */
+void freeVector(Vector v);
+/*
+Frees a Vector, but not the data structures its pointers refer to.
+Parameters:
+v: the Vector to be freed.
+*/
 #endif
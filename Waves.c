@@ -6,32 +6,44 @@ Calculates the pressure and flow distribution along a flute.
 #include "Acoustics.h"
 #include "ParseXML.h"
 #include "Woodwind.h"
+#include "WoodwindProgram.h"
 #include <math.h>
 #include <stdio.h>
 #include <string.h>
 int parseCommandLine(int argc, char **argv, char **holestring, double *xres,
-                     int *midi, double *f, char **xml_filename);
+                     double *tolerance, double *maxLength, int *midi,
+                     double *f, char **xml_filename);
+int prepareInstrument(char *xml_filename, char *holestring, double tolerance,
+                      double f, double maxLength, int halve,
+                      Woodwind *instrument);
+void inputWave(Woodwind w, double f, int midi, complex Z0, complex *pin,
+               complex *Uin);
+void waveAt(Woodwind w, double f, double x, complex pin, complex Uin,
+            complex *p, complex *U);
 /* Default x resolution */
 #define XRES 2.0e-3;
 int main(int argc, char **argv) {
   double f;
-  double x, xres, xmin, xmax;
+  double x, xres, xmin, xmax, tolerance, maxLength;
   int midi;
   char *holestring;
   char *xml_filename;
-  Woodwind instrument;
-  complex Z0, Zin, pin, Uin;
-  double c;
-  TransferMatrix m;
-  complex p, U;
+  Woodwind instrument, fine = NULL;
+  complex Z0, pin, Uin, pinFine, UinFine;
+  complex p, U, pFine, UFine;
   double entryradius = WW_EMB_RADIUS;
   /* check correct usage */
-  if (!parseCommandLine(argc, argv, &holestring, &xres, &midi, &f,
-                        &xml_filename)) {
+  if (!parseCommandLine(argc, argv, &holestring, &xres, &tolerance,
+                        &maxLength, &midi, &f, &xml_filename)) {
     fprintf(stderr, "Usage: Waves [OPTIONS] <midi> <frequency> <XML file>\n\n");
     fprintf(stderr, " Options:\n");
     fprintf(stderr, "\t-s <holestring>\n");
-    fprintf(stderr, "\t-r <xres> (default 2.0)\n\n");
+    fprintf(stderr, "\t-r <xres> (default 2.0)\n");
+    fprintf(stderr, "\t-a <tolerance> (adaptive discretisation, default "
+                    "off)\n");
+    fprintf(stderr, "\t-x <segment length> (Richardson extrapolation from\n");
+    fprintf(stderr, "\t   this and half this length, adding columns with\n");
+    fprintf(stderr, "\t   the error estimates; default off)\n\n");
     fprintf(stderr, " <holestring>:\n");
     fprintf(stderr, "\t- Optional if no holes are defined in XML file.\n");
     fprintf(stderr, "\t- Must be a sequence of 'O' (open hole) ");
@@ -41,50 +53,102 @@ int main(int argc, char **argv) {
     fprintf(stderr, "\t- e.g. \"XXOOOOOOXOOOOXOOO\"\n\n");
     return -1;
   }
+  if (!prepareInstrument(xml_filename, holestring, tolerance, f, maxLength, 0,
+                         &instrument))
+    return -1;
+  /* the same instrument with every segment halved, for extrapolation */
+  if ((maxLength > 0.0) && !prepareInstrument(xml_filename, holestring, 0.0, f,
+                                              maxLength, 1, &fine))
+    return -1;
+  /* calculate Z0, pin and Uin */
+  Z0 = charZ(instrument->head->embouchureHole->c,
+             instrument->head->embouchureHole->rho, entryradius);
+  inputWave(instrument, f, midi, Z0, &pin, &Uin);
+  if (fine != NULL)
+    inputWave(fine, f, midi, Z0, &pinFine, &UinFine);
+  /* calculate the limits of the instrument */
+  xmin = ceil(-woodwindLengthNeg(instrument) / xres) * xres;
+  xmax = ceil(woodwindLengthPos(instrument) / xres) * xres;
+  for (x = xmin; x < xmax; x += xres) {
+    waveAt(instrument, f, x, pin, Uin, &p, &U);
+    if (fine == NULL) {
+      printf("%.1f\t%.3f\t%.3f\n", x * 1e3, modz(p), modz(Z0) * modz(U));
+      continue;
+    }
+    /* extrapolate, and estimate the errors of the fine values */
+    waveAt(fine, f, x, pinFine, UinFine, &pFine, &UFine);
+    p = richardsonExtrapolate(p, pFine);
+    U = richardsonExtrapolate(U, UFine);
+    printf("%.1f\t%.3f\t%.3f\t%.2e\t%.2e\n", x * 1e3, modz(p),
+           modz(Z0) * modz(U), modz(subz(p, pFine)),
+           modz(Z0) * modz(subz(U, UFine)));
+  }
+  return 0;
+}
+int prepareInstrument(char *xml_filename, char *holestring, double tolerance,
+                      double f, double maxLength, int halve,
+                      Woodwind *instrument) {
+  double entryradius = WW_EMB_RADIUS;
   /* retrieve data structures from XML file */
-  if (!parseXMLFile(xml_filename, &instrument)) {
+  if (!parseXMLFile(xml_filename, instrument)) {
     fprintf(stderr, "Waves error: Waves failed to parse XML file.\n");
-    return -1;
+    return 0;
+  }
+  if (tolerance > 0.0) {
+    /* cut the bore only as finely as the gradient and f require */
+    discretiseWoodwindAdaptive(*instrument, f, tolerance, WW_T_0, WW_T_AMB,
+                               WW_T_GRAD, WW_HUMID, WW_X_CO2);
+    fprintSegmentation(stderr, *instrument);
+  } else {
+    /* the cylinders follow the gradient whole, so by default only the
+    cones are cut up */
+    if (maxLength > 0.0)
+      discretiseWoodwind(*instrument, maxLength);
+    else
+      discretiseWoodwindCones(*instrument, WW_MAX_LENGTH);
+    if (halve)
+      halveWoodwind(*instrument);
+    setAirProperties(*instrument, WW_T_0, WW_T_AMB, WW_T_GRAD, WW_HUMID,
+                     WW_X_CO2);
   }
-  discretiseWoodwind(instrument, WW_MAX_LENGTH);
-  setAirProperties(instrument, WW_T_0, WW_T_AMB, WW_T_GRAD, WW_HUMID, WW_X_CO2);
+  compileWoodwind(*instrument, entryradius / woodwindEntryRadius(*instrument));
+  /* a single-bin grid, so the downstream matrices are reused for each x */
+  setFrequencyGrid(*instrument, createFrequencyGrid(f, f, 1.0));
   /* set fingering from holestring and validate */
-  if (!setFingering(instrument, holestring)) {
+  if (!setFingering(*instrument, holestring)) {
     fprintf(stderr, "Waves error: \"%s\" ", holestring);
     fprintf(stderr,
             "is an invalid fingering for the given woodwind definition.\n");
-    return -1;
+    return 0;
   }
-  /* calculate Zin, c and Z0 */
-  Zin = playedImpedance(f, instrument, midi);
-  c = instrument->head->embouchureHole->c;
-  Z0 = charZ(c, instrument->head->embouchureHole->rho, entryradius);
-  /* calculate pin and Uin */
-  Uin = real(1 / sqrt(modz(Zin) * modz(Zin) + modz(Z0) * modz(Z0)));
+  return 1;
+}
+void inputWave(Woodwind w, double f, int midi, complex Z0, complex *pin,
+               complex *Uin) {
+  complex Zin = playedImpedance(f, w, midi);
+  *Uin = real(1 / sqrt(modz(Zin) * modz(Zin) + modz(Z0) * modz(Z0)));
   // Uin = real(sqrt(2 * modz(Z0) * c / (modz(Z0)*modz(Z0)
   // + modz(Zin)*modz(Zin))));
-  pin = multz(Zin, Uin);
+  *pin = multz(Zin, *Uin);
   /* change pin to account for face impedance */
-  pin = subz(pin, multz(faceZ(f, instrument->head, midi), Uin));
-  /* calculate the limits of the instrument */
-  xmin = ceil(-woodwindLengthNeg(instrument) / xres) * xres;
-  xmax = ceil(woodwindLengthPos(instrument) / xres) * xres;
-  for (x = xmin; x < xmax; x += xres) {
-    m = woodwindMatrix(f, instrument,
-                       entryradius / woodwindEntryRadius(instrument), x);
-    invertm(m);
-    p = addz(multz(m->A, pin), multz(m->B, Uin));
-    U = addz(multz(m->C, pin), multz(m->D, Uin));
-    // getZ0_c(instrument, x, &Z0, &c);
-    printf("%.1f\t%.3f\t%.3f\n", x * 1e3, modz(p), modz(Z0) * modz(U));
-  }
-  return 0;
+  *pin = subz(*pin, multz(faceZ(f, w, midi), *Uin));
+}
+void waveAt(Woodwind w, double f, double x, complex pin, complex Uin,
+            complex *p, complex *U) {
+  double entryradius = WW_EMB_RADIUS;
+  TransferMatrix m = woodwindMatrix(frequencyContext(f), w,
+                                    entryradius / woodwindEntryRadius(w), x);
+  m = invertm(m);
+  *p = addz(multz(m.A, pin), multz(m.B, Uin));
+  *U = addz(multz(m.C, pin), multz(m.D, Uin));
+  // getZ0_c(instrument, x, &Z0, &c);
 }
 int parseCommandLine(int argc, char **argv, char **holestring, double *xres,
-                     int *midi, double *f, char **xml_filename) {
+                     double *tolerance, double *maxLength, int *midi,
+                     double *f, char **xml_filename) {
   int i;
-  int sflag = 0, rflag = 0;
-  int numoptions = 2, numrequired = 3;
+  int sflag = 0, rflag = 0, aflag = 0, xflag = 0;
+  int numoptions = 4, numrequired = 3;
   int minargc = 1 + numrequired;
   int maxargc = minargc + 2 * numoptions;
   /* Check correct number of parameters */
@@ -92,6 +156,8 @@ int parseCommandLine(int argc, char **argv, char **holestring, double *xres,
     /* Set default options */
     *holestring = NULL;
   *xres = XRES;
+  *tolerance = 0.0;
+  *maxLength = 0.0;
   /* Check and set options */
   for (i = 1; i < (argc - numrequired); i += 2) {
     if (strcmp(argv[i], "-s") == 0) {
@@ -112,10 +178,37 @@ int parseCommandLine(int argc, char **argv, char **holestring, double *xres,
       rflag = 1;
       continue;
     }
+    if (strcmp(argv[i], "-a") == 0) {
+      if (aflag)
+        return 0;
+      *tolerance = atof(argv[i + 1]);
+      if (*tolerance <= 0.0) {
+        fprintf(stderr, "Invalid -a option\n");
+        return 0;
+      }
+      aflag = 1;
+      continue;
+    }
+    if (strcmp(argv[i], "-x") == 0) {
+      if (xflag)
+        return 0;
+      *maxLength = atof(argv[i + 1]);
+      if (*maxLength <= 0.0) {
+        fprintf(stderr, "Invalid -x option\n");
+        return 0;
+      }
+      xflag = 1;
+      continue;
+    }
     /* else invalid option */
     fprintf(stderr, "Invalid option: %s\n", argv[i]);
     return 0;
   }
+  /* Extrapolation needs the fixed discretisation */
+  if (aflag && xflag) {
+    fprintf(stderr, "The -a and -x options cannot be combined\n");
+    return 0;
+  }
   /* Set midi */
   *midi = atof(argv[argc - numrequired]);
   /* Set f */
@@ -5,8 +5,8 @@ A woodwind instrument. See Woodwind.h for interface details.
 */
 #include "Woodwind.h"
 #include "Acoustics.h"
-#include "Map.h"
-#include <float.h>
+#include "AcousticsBatch.h"
+#include "WoodwindProgram.h"
 #include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -17,8 +17,6 @@ BoreSegment createBoreSegment(double radius1, double radius2, double length) {
   s->radius1 = radius1;
   s->radius2 = radius2;
   s->length = length;
-  s->c = 0.0;
-  s->rho = 0.0;
   return s;
 }
 Hole createHole(double radius, double length, double boreRadius, Key key) {
@@ -60,15 +58,16 @@ Head createHead(EmbouchureHole embouchureHole, Vector upstreamBore,
   h->upstreamBore = upstreamBore;
   h->upstreamFlange = upstreamFlange;
   h->downstreamBore = downstreamBore;
-  h->matrixMap = createMap();
+  h->cache = NULL;
+  h->cacheEntryRatio = 0.0;
   return h;
 }
 UnitCell createUnitCell(Hole hole, Vector bore) {
   UnitCell c = (UnitCell)malloc(sizeof(*c));
   c->hole = hole;
   c->bore = bore;
-  c->openMatrixMap = createMap();
-  c->closedMatrixMap = createMap();
+  c->openCache = NULL;
+  c->closedCache = NULL;
   return c;
 }
 Woodwind createWoodwind(Head head, Vector cells, double flange) {
@@ -76,106 +75,446 @@ Woodwind createWoodwind(Head head, Vector cells, double flange) {
   w->head = head;
   w->cells = cells;
   w->flange = flange;
+  w->table = NULL;
+  w->grid = NULL;
+  w->fingering = 0;
+  w->program = NULL;
+  buildBoreTable(w);
   return w;
 }
+/* copies the segments of a bore vector into the table from index n,
+recording their range, and returns the index following the bore */
+static int tabulateBore(BoreTable t, Vector bore, int n, BoreRange *range) {
+  int i;
+  BoreSegment s;
+  range->first = n;
+  range->length = 0;
+  for (i = 0; i < sizeVector(bore); i++, n++) {
+    s = (BoreSegment)elementAt(bore, i);
+    t->radius1[n] = s->radius1;
+    t->radius2[n] = s->radius2;
+    t->length[n] = s->length;
+    t->c[n] = t->cIn[n] = t->cOut[n] = 0.0;
+    t->rho[n] = t->rhoIn[n] = t->rhoOut[n] = 0.0;
+    range->length += s->length;
+  }
+  range->last = n;
+  return n;
+}
+void buildBoreTable(Woodwind w) {
+  BoreTable t = w->table;
+  Head h = w->head;
+  int i, n;
+  if (t == NULL)
+    t = w->table = (BoreTable)calloc(1, sizeof(*t));
+  else {
+    free(t->radius1);
+    free(t->cells);
+    free(t->cellBore);
+  }
+  /* count the segments and cells of the instrument */
+  t->numCells = sizeVector(w->cells);
+  t->cells = (UnitCell *)malloc(t->numCells * sizeof(UnitCell));
+  t->cellBore = (BoreRange *)malloc(t->numCells * sizeof(BoreRange));
+  n = sizeVector(h->upstreamBore) + sizeVector(h->downstreamBore);
+  for (i = 0; i < t->numCells; i++) {
+    t->cells[i] = (UnitCell)elementAt(w->cells, i);
+    n += sizeVector(t->cells[i]->bore);
+  }
+  /* allocate all nine segment arrays in a single block */
+  t->numSegments = n;
+  t->radius1 = (double *)malloc(9 * (n > 0 ? n : 1) * sizeof(double));
+  t->radius2 = t->radius1 + n;
+  t->length = t->radius2 + n;
+  t->c = t->length + n;
+  t->rho = t->c + n;
+  t->cIn = t->rho + n;
+  t->rhoIn = t->cIn + n;
+  t->cOut = t->rhoIn + n;
+  t->rhoOut = t->cOut + n;
+  /* copy the segments in instrument order */
+  n = tabulateBore(t, h->upstreamBore, 0, &t->upstream);
+  n = tabulateBore(t, h->downstreamBore, n, &t->downstream);
+  for (i = 0; i < t->numCells; i++)
+    n = tabulateBore(t, t->cells[i]->bore, n, &t->cellBore[i]);
+  clearWoodwindCaches(w);
+  freeWoodwindProgram(w->program);
+  w->program = NULL;
+}
+void setFrequencyGrid(Woodwind w, FrequencyGrid g) {
+  Head h = w->head;
+  UnitCell cell;
+  int cellCount;
+  w->grid = g;
+  freeSpectralCache(h->cache);
+  h->cache = (g != NULL) ? createSpectralCache(g) : NULL;
+  for (cellCount = 0; cellCount < sizeVector(w->cells); cellCount++) {
+    cell = (UnitCell)elementAt(w->cells, cellCount);
+    freeSpectralCache(cell->openCache);
+    freeSpectralCache(cell->closedCache);
+    cell->openCache = (g != NULL) ? createSpectralCache(g) : NULL;
+    cell->closedCache = (g != NULL) ? createSpectralCache(g) : NULL;
+  }
+}
+void clearWoodwindCaches(Woodwind w) {
+  UnitCell cell;
+  int cellCount;
+  if (w->grid == NULL)
+    return;
+  clearSpectralCache(w->head->cache);
+  for (cellCount = 0; cellCount < sizeVector(w->cells); cellCount++) {
+    cell = (UnitCell)elementAt(w->cells, cellCount);
+    clearSpectralCache(cell->openCache);
+    clearSpectralCache(cell->closedCache);
+  }
+}
+/* the temperature at position x of the profile */
+static double profileTemperature(double x, double t_0, double t_amb,
+                                 double t_grad) {
+  double temp = t_0 + t_grad * x;
+  return (temp < t_amb) ? t_amb : temp;
+}
+/* sets c and rho at the input, middle and output of each segment in a
+range of the table, given the temperature profile and the position x
+at the start of the range, and returns the position at the end of the
+range */
+static double setBoreAirProperties(BoreTable t, BoreRange bore, double x,
+                                   AirTable air, double t_0, double t_amb,
+                                   double t_grad) {
+  AirProperties props;
+  int n;
+  for (n = bore.first; n < bore.last; n++) {
+    props = airTableProperties(
+        air, profileTemperature(x, t_0, t_amb, t_grad));
+    t->cIn[n] = props.c;
+    t->rhoIn[n] = props.rho;
+    props = airTableProperties(
+        air, profileTemperature(x + t->length[n] / 2, t_0, t_amb, t_grad));
+    t->c[n] = props.c;
+    t->rho[n] = props.rho;
+    props = airTableProperties(
+        air, profileTemperature(x + t->length[n], t_0, t_amb, t_grad));
+    t->cOut[n] = props.c;
+    t->rhoOut[n] = props.rho;
+    x += t->length[n];
+  }
+  return x;
+}
 void setAirProperties(Woodwind w, double t_0, double t_amb, double t_grad,
                       double humid, double x_CO2) {
+  double length, t_end, tmin, tmax;
+  AirTable air;
+  /* the temperatures along the instrument lie between those at its
+  ends, but not below ambient */
+  length = woodwindLengthPos(w);
+  if (woodwindLengthNeg(w) > length)
+    length = woodwindLengthNeg(w);
+  t_end = t_0 + t_grad * length;
+  tmin = (t_end < t_0) ? t_end : t_0;
+  tmax = (t_end < t_0) ? t_0 : t_end;
+  if (tmin < t_amb)
+    tmin = t_amb;
+  if (tmax < t_amb)
+    tmax = t_amb;
+  air = createAirTable(tmin, tmax, P_ATM, humid, x_CO2);
+  setAirPropertiesTable(w, air, t_0, t_amb, t_grad);
+  freeAirTable(air);
+}
+void setAirPropertiesTable(Woodwind w, AirTable air, double t_0, double t_amb,
+                           double t_grad) {
   Head h = w->head;
-  double temp, x;
-  int segmentCount, cellCount;
-  BoreSegment s;
-  UnitCell cell;
-  temp = t_0;
+  BoreTable t = w->table;
+  AirProperties props;
+  double x;
+  int cellCount;
+  Hole hole;
+  clearWoodwindCaches(w);
+  freeWoodwindProgram(w->program);
+  w->program = NULL;
   if (w->head->embouchureHole != NULL) {
     /* set c and rho for the embouchure hole */
-    h->embouchureHole->c = speedSound(temp, P_ATM, humid, x_CO2);
-    h->embouchureHole->rho = densityAirGiacomo(temp, P_ATM, humid, x_CO2);
-    x = 0;
+    props = airTableProperties(air, t_0);
+    h->embouchureHole->c = props.c;
+    h->embouchureHole->rho = props.rho;
     /* for each bore segment in upstream */
-    for (segmentCount = 0; segmentCount < sizeVector(h->upstreamBore);
-         segmentCount++) {
-      s = (BoreSegment)elementAt(h->upstreamBore, segmentCount);
-      temp = t_0 + t_grad * (x + s->length / 2);
-      if (temp < t_amb)
-        temp = t_amb;
-      s->c = speedSound(temp, P_ATM, humid, x_CO2);
-      s->rho = densityAirGiacomo(temp, P_ATM, humid, x_CO2);
-      x += s->length;
-    }
+    setBoreAirProperties(t, t->upstream, 0, air, t_0, t_amb, t_grad);
   }
-  x = 0;
   /* for each bore segment in downstream */
-  for (segmentCount = 0; segmentCount < sizeVector(h->downstreamBore);
-       segmentCount++) {
-    s = (BoreSegment)elementAt(h->downstreamBore, segmentCount);
-    temp = t_0 + t_grad * (x + s->length / 2);
-    if (temp < t_amb)
-      temp = t_amb;
-    s->c = speedSound(temp, P_ATM, humid, x_CO2);
-    s->rho = densityAirGiacomo(temp, P_ATM, humid, x_CO2);
-    x += s->length;
-  }
+  x = setBoreAirProperties(t, t->downstream, 0, air, t_0, t_amb, t_grad);
   /* for each unit cell */
-  for (cellCount = 0; cellCount < sizeVector(w->cells); cellCount++) {
-    cell = (UnitCell)elementAt(w->cells, cellCount);
-    temp = t_0 + t_grad * x;
-    if (temp < t_amb)
-      temp = t_amb;
-    cell->hole->c = speedSound(temp, P_ATM, humid, x_CO2);
-    cell->hole->rho = densityAirGiacomo(temp, P_ATM, humid, x_CO2);
+  for (cellCount = 0; cellCount < t->numCells; cellCount++) {
+    hole = t->cells[cellCount]->hole;
+    props = airTableProperties(air, profileTemperature(x, t_0, t_amb, t_grad));
+    hole->c = props.c;
+    hole->rho = props.rho;
     /* for each bore segment in unit cell */
-    for (segmentCount = 0; segmentCount < sizeVector(cell->bore);
-         segmentCount++) {
-      s = (BoreSegment)elementAt(cell->bore, segmentCount);
-      temp = t_0 + t_grad * (x + s->length / 2);
-      if (temp < t_amb)
-        temp = t_amb;
-      s->c = speedSound(temp, P_ATM, humid, x_CO2);
-      s->rho = densityAirGiacomo(temp, P_ATM, humid, x_CO2);
-      x += s->length;
-    }
+    x = setBoreAirProperties(t, t->cellBore[cellCount], x, air, t_0, t_amb,
+                             t_grad);
   }
 }
-void discretiseWoodwind(Woodwind w, double maxLength) {
+/* whether the air is the same throughout segment n of the table */
+static int uniformAir(BoreTable t, int n) {
+  return (t->cIn[n] == t->c[n]) && (t->cOut[n] == t->c[n]) &&
+         (t->rhoIn[n] == t->rho[n]) && (t->rhoOut[n] == t->rho[n]);
+}
+/* cuts segment index of a bore into numSegments equal pieces, and
+returns the index of the last piece */
+static int splitSegment(Vector bore, int index, int numSegments) {
+  BoreSegment s = (BoreSegment)elementAt(bore, index);
+  BoreSegment newSegment;
+  double radius1, radius2, length;
+  int newSegmentCount;
+  radius1 = s->radius1;
+  length = s->length / numSegments;
+  for (newSegmentCount = 1; newSegmentCount <= numSegments;
+       newSegmentCount++) {
+    radius2 = (newSegmentCount * s->radius2 +
+               (numSegments - newSegmentCount) * s->radius1) /
+              numSegments;
+    newSegment = createBoreSegment(radius1, radius2, length);
+    if (newSegmentCount == 1)
+      setAt(bore, newSegment, index);
+    else
+      insertAt(bore, newSegment, ++index);
+    radius1 = radius2;
+  }
+  return index;
+}
+/* cuts every segment of a bore in two */
+static void halveBore(Vector bore) {
+  int segmentCount;
+  for (segmentCount = 0; segmentCount < sizeVector(bore); segmentCount++)
+    segmentCount = splitSegment(bore, segmentCount, 2);
+}
+void halveWoodwind(Woodwind w) {
   int cellCount;
   UnitCell cell;
-  discretiseBore(w->head->upstreamBore, maxLength);
-  discretiseBore(w->head->downstreamBore, maxLength);
+  halveBore(w->head->upstreamBore);
+  halveBore(w->head->downstreamBore);
   for (cellCount = 0; cellCount < sizeVector(w->cells); cellCount++) {
     cell = (UnitCell)elementAt(w->cells, cellCount);
-    discretiseBore(cell->bore, maxLength);
+    halveBore(cell->bore);
   }
+  buildBoreTable(w);
 }
-void discretiseBore(Vector bore, double maxLength) {
-  int segmentCount, newSegmentCount, numSegments;
-  BoreSegment s, newSegment;
-  double radius1, radius2, length;
+/* cuts up the segments of a bore longer than maxLength, cylinders
+only if cylinders is true */
+static void cutBore(Vector bore, double maxLength, int cylinders) {
+  int segmentCount;
+  BoreSegment s;
   /* for each bore segment in bore */
   for (segmentCount = 0; segmentCount < sizeVector(bore); segmentCount++) {
     s = (BoreSegment)elementAt(bore, segmentCount);
-    if (s->length <= maxLength)
+    if ((s->length <= maxLength) ||
+        (!cylinders && (s->radius1 == s->radius2)))
       continue;
-    numSegments = ceil(s->length / maxLength);
-    radius1 = s->radius1;
-    length = s->length / numSegments;
-    for (newSegmentCount = 1; newSegmentCount <= numSegments;
-         newSegmentCount++) {
-      radius2 = (newSegmentCount * s->radius2 +
-                 (numSegments - newSegmentCount) * s->radius1) /
-                numSegments;
-      newSegment = createBoreSegment(radius1, radius2, length);
-      if (newSegmentCount == 1)
-        setAt(bore, newSegment, segmentCount);
-      else
-        insertAt(bore, newSegment, ++segmentCount);
-      radius1 = radius2;
-    }
+    segmentCount =
+        splitSegment(bore, segmentCount, ceil(s->length / maxLength));
   }
 }
-int setFingering(Woodwind w, char *holestring) {
-  int numholes = sizeVector(w->cells);
+/* cuts up every bore of the instrument and rebuilds its BoreTable */
+static void cutWoodwind(Woodwind w, double maxLength, int cylinders) {
+  int cellCount;
+  UnitCell cell;
+  cutBore(w->head->upstreamBore, maxLength, cylinders);
+  cutBore(w->head->downstreamBore, maxLength, cylinders);
+  for (cellCount = 0; cellCount < sizeVector(w->cells); cellCount++) {
+    cell = (UnitCell)elementAt(w->cells, cellCount);
+    cutBore(cell->bore, maxLength, cylinders);
+  }
+  buildBoreTable(w);
+}
+void discretiseWoodwind(Woodwind w, double maxLength) {
+  cutWoodwind(w, maxLength, 1);
+}
+void discretiseWoodwindCones(Woodwind w, double maxLength) {
+  cutWoodwind(w, maxLength, 0);
+}
+/* the transfer matrix of segment n of the table cut into m pieces */
+static TransferMatrix piecesMatrix(FrequencyContext fc, BoreTable t, int n,
+                                   int m) {
+  TransferMatrix product = identitym();
+  ProgramElement e;
   int i;
+  for (i = 0; i < m; i++) {
+    e = compileBorePiece(t, n, t->length[n] * i / m,
+                         t->length[n] * (i + 1) / m);
+    product = multm(product, elementMatrix(fc, &e, 0));
+  }
+  return product;
+}
+/* the change in the transfer matrix of segment n when its m pieces
+are halved, with B and C scaled by the characteristic impedance */
+static double discretisationError(FrequencyContext fc, BoreTable t, int n,
+                                  int m) {
+  TransferMatrix m1 = piecesMatrix(fc, t, n, m);
+  TransferMatrix m2 = piecesMatrix(fc, t, n, 2 * m);
+  double Z0 = modz(charZ(t->c[n], t->rho[n],
+                         sqrt(t->radius1[n] * t->radius2[n])));
+  double error = modz(subz(m1.A, m2.A));
+  error = fmax(error, modz(subz(m1.B, m2.B)) / Z0);
+  error = fmax(error, modz(subz(m1.C, m2.C)) * Z0);
+  return fmax(error, modz(subz(m1.D, m2.D)));
+}
+/* the number of pieces segment n of the table needs for an error
+within tolerance (assuming the error falls with the square of the
+piece length) */
+static int segmentPieces(FrequencyContext fc, BoreTable t, int n,
+                         double tolerance) {
+  int m, next;
+  int maxPieces = (int)ceil(t->length[n] / WW_MIN_LENGTH);
+  double error;
+  int cylinder = (t->radius1[n] == t->radius2[n]);
+  /* the matrix of a cylinder of uniform air is exact */
+  if (cylinder && uniformAir(t, n))
+    return 1;
+  /* start from pieces of at most a radian of phase, for which the
+  error estimate holds (at any phase for a cylinder, whose matrix
+  follows the gradient) */
+  m = cylinder ? 1 : (int)ceil(fc.omega * t->length[n] / t->c[n]);
+  if (m < 1)
+    m = 1;
+  while (m < maxPieces) {
+    error = discretisationError(fc, t, n, m);
+    if (error <= tolerance)
+      break;
+    next = (int)ceil(m * sqrt(error / tolerance));
+    m = (next > m) ? next : m + 1;
+  }
+  return (m < maxPieces) ? m : maxPieces;
+}
+/* cuts the segments of a bore into the given numbers of pieces,
+starting from pieces[n], and returns the index following the bore */
+static int splitBore(Vector bore, const int *pieces, int n) {
+  int segmentCount, numSegments = sizeVector(bore);
+  for (segmentCount = 0; numSegments > 0; numSegments--, n++)
+    segmentCount = splitSegment(bore, segmentCount, pieces[n]) + 1;
+  return n;
+}
+int discretiseWoodwindAdaptive(Woodwind w, double fhi, double tolerance,
+                               double t_0, double t_amb, double t_grad,
+                               double humid, double x_CO2) {
+  FrequencyContext fc = frequencyContext(fhi);
+  BoreTable t;
   UnitCell cell;
+  double length = 0;
+  int *pieces;
+  int n, cellCount;
+  /* the air along the undivided segments */
+  buildBoreTable(w);
+  setAirProperties(w, t_0, t_amb, t_grad, humid, x_CO2);
+  t = w->table;
+  for (n = 0; n < t->numSegments; n++)
+    length += t->length[n];
+  pieces = (int *)malloc((t->numSegments > 0 ? t->numSegments : 1) *
+                         sizeof(int));
+  /* share the tolerance between the segments by length */
+  for (n = 0; n < t->numSegments; n++)
+    pieces[n] = segmentPieces(fc, t, n, tolerance * t->length[n] / length);
+  /* cut up the bores in table order */
+  n = splitBore(w->head->upstreamBore, pieces, 0);
+  n = splitBore(w->head->downstreamBore, pieces, n);
+  for (cellCount = 0; cellCount < sizeVector(w->cells); cellCount++) {
+    cell = (UnitCell)elementAt(w->cells, cellCount);
+    n = splitBore(cell->bore, pieces, n);
+  }
+  free(pieces);
+  buildBoreTable(w);
+  setAirProperties(w, t_0, t_amb, t_grad, humid, x_CO2);
+  return w->table->numSegments;
+}
+/* prints the number and range of lengths of the segments of a bore */
+static void fprintBore(FILE *stream, BoreTable t, BoreRange bore,
+                       const char *name, int index) {
+  double shortest = 0, longest = 0;
+  int n;
+  for (n = bore.first; n < bore.last; n++) {
+    if ((n == bore.first) || (t->length[n] < shortest))
+      shortest = t->length[n];
+    if (t->length[n] > longest)
+      longest = t->length[n];
+  }
+  fprintf(stream, "%s", name);
+  if (index >= 0)
+    fprintf(stream, " %d", index);
+  fprintf(stream, ": %d segments, %.1f mm, %.2f-%.2f mm each\n",
+          bore.last - bore.first, bore.length * 1e3, shortest * 1e3,
+          longest * 1e3);
+}
+void fprintSegmentation(FILE *stream, Woodwind w) {
+  BoreTable t = w->table;
+  int i;
+  if (w->head->embouchureHole != NULL)
+    fprintBore(stream, t, t->upstream, "upstream", -1);
+  fprintBore(stream, t, t->downstream, "downstream", -1);
+  for (i = 0; i < t->numCells; i++)
+    fprintBore(stream, t, t->cellBore[i], "cell", i);
+}
+/* whether segment k of the table continues segment n as one piece */
+static int continuesSegment(BoreTable t, int n, int k, double maxConeLength) {
+  double taper1, taper2;
+  if (!uniformAir(t, n) || !uniformAir(t, k) || (t->c[n] != t->c[k]) ||
+      (t->rho[n] != t->rho[k]) || (t->radius2[n] != t->radius1[k]))
+    return 0;
+  /* cylinders of equal radius */
+  if ((t->radius1[n] == t->radius2[n]) && (t->radius1[k] == t->radius2[k]))
+    return 1;
+  if ((t->radius1[n] == t->radius2[n]) || (t->radius1[k] == t->radius2[k]) ||
+      (t->length[n] + t->length[k] > maxConeLength))
+    return 0;
+  /* cones of equal taper */
+  taper1 = (t->radius2[n] - t->radius1[n]) / t->length[n];
+  taper2 = (t->radius2[k] - t->radius1[k]) / t->length[k];
+  return fabs(taper1 - taper2) <= WW_TAPER_TOLERANCE * fabs(taper1);
+}
+/* merges the segments of a range of the table, moving them down to
+index n, and returns the index following the range */
+static int coalesceBore(BoreTable t, BoreRange *bore, int n,
+                        double maxConeLength) {
+  int k, first = n;
+  for (k = bore->first; k < bore->last; k++) {
+    if ((n > first) && continuesSegment(t, n - 1, k, maxConeLength)) {
+      t->radius2[n - 1] = t->radius2[k];
+      t->length[n - 1] += t->length[k];
+      continue;
+    }
+    t->radius1[n] = t->radius1[k];
+    t->radius2[n] = t->radius2[k];
+    t->length[n] = t->length[k];
+    t->c[n] = t->c[k];
+    t->rho[n] = t->rho[k];
+    t->cIn[n] = t->cIn[k];
+    t->rhoIn[n] = t->rhoIn[k];
+    t->cOut[n] = t->cOut[k];
+    t->rhoOut[n] = t->rhoOut[k];
+    n++;
+  }
+  bore->first = first;
+  bore->last = n;
+  return n;
+}
+int coalesceWoodwind(Woodwind w, double maxConeLength) {
+  BoreTable t = w->table;
+  int i, n, removed;
+  clearWoodwindCaches(w);
+  freeWoodwindProgram(w->program);
+  w->program = NULL;
+  /* the ranges are in table order, so each moves down in place */
+  n = coalesceBore(t, &t->upstream, 0, maxConeLength);
+  n = coalesceBore(t, &t->downstream, n, maxConeLength);
+  for (i = 0; i < t->numCells; i++)
+    n = coalesceBore(t, &t->cellBore[i], n, maxConeLength);
+  removed = t->numSegments - n;
+  t->numSegments = n;
+  return removed;
+}
+void discretiseBore(Vector bore, double maxLength) {
+  cutBore(bore, maxLength, 1);
+}
+int fingeringMask(Woodwind w, char *holestring, uint64_t *mask) {
+  int numholes = w->table->numCells;
+  int i;
+  *mask = 0;
   /* check for no holes */
   if ((holestring == NULL) || (numholes == 0)) {
     if ((holestring == NULL) && (numholes == 0))
@@ -184,140 +523,236 @@ int setFingering(Woodwind w, char *holestring) {
       return 0;
   }
   /* check for wrong number of holes entered */
-  if (strlen(holestring) != numholes)
+  if ((strlen(holestring) != (size_t)numholes) || (numholes > WW_MAX_HOLES))
     return 0;
-  /* set fingering array based on command line hole string */
+  /* set a bit for each open hole in the hole string */
   for (i = 0; i < numholes; i++) {
-    cell = (UnitCell)elementAt(w->cells, i);
     if (holestring[i] == 'O')
-      cell->hole->fingering = "OPEN";
-    if (holestring[i] == 'X')
-      cell->hole->fingering = "CLOSED";
+      *mask |= (uint64_t)1 << i;
     if ((holestring[i] != 'O') && (holestring[i] != 'X'))
       return 0;
   }
   return 1;
 }
-TransferMatrix boreSegmentMatrix(double f, BoreSegment s, double x) {
-  TransferMatrix m;
-  double length, radius1, radius2;
-  radius1 = s->radius1;
-  if (x >= s->length) {
-    length = s->length;
-    radius2 = s->radius2;
-  } else {
-    length = x;
-    radius2 =
-        (s->radius2 * length + s->radius1 * (s->length - length)) / (s->length);
-  }
-  m = (radius1 == radius2)
-          ? tubeMatrix(f, s->c, s->rho, length, radius1, 1)
-          : coneMatrix(f, s->c, s->rho, length, radius1, radius2, 1);
-  return m;
+int setFingering(Woodwind w, char *holestring) {
+  uint64_t mask;
+  if (!fingeringMask(w, holestring, &mask))
+    return 0;
+  w->fingering = mask;
+  return 1;
+}
+TransferMatrix boreSegmentMatrix(FrequencyContext fc, BoreTable t, int n,
+                                 double x) {
+  ProgramElement e = compileBoreSegment(t, n, x);
+  return elementMatrix(fc, &e, 0);
 }
-TransferMatrix boreMatrix(double f, Vector bore, double x) {
+TransferMatrix boreMatrix(FrequencyContext fc, BoreTable t, BoreRange bore,
+                          double x) {
   TransferMatrix m = identitym();
-  int n = 0;
-  BoreSegment s;
-  while ((x > 0) && (n < sizeVector(bore))) {
-    s = (BoreSegment)elementAt(bore, n);
-    rmultm(m, boreSegmentMatrix(f, s, x));
-    x -= s->length;
-    n++;
+  int n;
+  for (n = bore.first; (x > 0) && (n < bore.last); n++) {
+    m = multm(m, boreSegmentMatrix(fc, t, n, x));
+    x -= t->length[n];
   }
   return m;
 }
-TransferMatrix headMatrix(double f, Head h, double entryratio, double x) {
-  TransferMatrix m, branchMatrix;
+/* calculates the head matrix without reference to the caches */
+static TransferMatrix calcHeadMatrix(FrequencyContext fc, ConstWoodwind w,
+                                     double entryratio, double x) {
+  TransferMatrix m = identitym(), branchMatrix;
   complex branchZ, ZL;
-  BoreSegment lastSegment;
-  Map map = h->matrixMap;
-  if ((x >= boreLength(h->downstreamBore)) && containsKey(map, f))
-    m = (TransferMatrix)get(map, f);
-  else {
-    m = identitym();
-    if (h->embouchureHole != NULL) {
-      branchMatrix =
-          boreMatrix(f, h->upstreamBore, boreLength(h->upstreamBore));
-      lastSegment = (BoreSegment)elementAt(h->upstreamBore,
-                                           sizeVector(h->upstreamBore) - 1);
-      ZL = radiationZ(f, lastSegment->c, lastSegment->rho, lastSegment->radius2,
-                      h->upstreamFlange);
-      branchZ = calcZin(branchMatrix, ZL);
-      rmultm(m, embouchureMatrix(f, h->embouchureHole, entryratio, branchZ));
-    }
-    if (x > 0)
-      rmultm(m, boreMatrix(f, h->downstreamBore, x));
-    if (x >= boreLength(h->downstreamBore)) {
-      clear(map);
-      put(map, f, m);
-    }
+  Head h = w->head;
+  BoreTable t = w->table;
+  int last;
+  if ((w->program != NULL) && (x >= t->downstream.length))
+    return programHeadMatrix(fc, w->program, entryratio);
+  if (h->embouchureHole != NULL) {
+    branchMatrix = boreMatrix(fc, t, t->upstream, t->upstream.length);
+    last = t->upstream.last - 1;
+    ZL = radiationZ(fc, t->cOut[last], t->rhoOut[last], t->radius2[last],
+                    h->upstreamFlange);
+    branchZ = calcZin(branchMatrix, ZL);
+    m = multm(m, embouchureMatrix(fc, h->embouchureHole, entryratio, branchZ));
   }
+  if (x > 0)
+    m = multm(m, boreMatrix(fc, t, t->downstream, x));
   return m;
 }
-complex faceZ(double f, Head head, int midi) {
-  BoreSegment s = (BoreSegment)elementAt(head->downstreamBore, 0);
+/* calculates a unit cell matrix without reference to the caches */
+static TransferMatrix calcUnitCellMatrix(FrequencyContext fc,
+                                         ConstWoodwind w, int cell, int open,
+                                         double x) {
+  BoreTable t = w->table;
+  TransferMatrix m;
+  if ((w->program != NULL) && (x >= t->cellBore[cell].length))
+    return programCellMatrix(fc, w->program, cell, open);
+  m = traverseHoleMatrix(fc, t->cells[cell]->hole, open);
+  if (x > 0)
+    m = multm(m, boreMatrix(fc, t, t->cellBore[cell], x));
+  return m;
+}
+TransferMatrix headMatrix(FrequencyContext fc, Woodwind w, double entryratio,
+                          double x) {
+  TransferMatrix m;
+  Head h = w->head;
+  BoreTable t = w->table;
+  int bin = -1;
+  /* only the complete head is cached, and only on the grid */
+  if ((x >= t->downstream.length) && (w->grid != NULL))
+    bin = frequencyBin(w->grid, fc.f);
+  if ((bin >= 0) && (h->cacheEntryRatio != entryratio)) {
+    clearSpectralCache(h->cache);
+    h->cacheEntryRatio = entryratio;
+  }
+  if ((bin < 0) || !getCachedMatrix(h->cache, bin, &m)) {
+    m = calcHeadMatrix(fc, w, entryratio, x);
+    if (bin >= 0)
+      putCachedMatrix(h->cache, bin, m);
+  }
+  return m;
+}
+/* the air at the entry of a woodwind, which radiates to the face */
+static void faceAir(Woodwind w, double *c, double *rho) {
+  BoreTable t = w->table;
+  int first = t->downstream.first;
+  if (w->head->embouchureHole) {
+    *c = w->head->embouchureHole->c;
+    *rho = w->head->embouchureHole->rho;
+  } else {
+    *c = t->cIn[first];
+    *rho = t->rhoIn[first];
+  }
+}
+/* the empirical factor scaling the radiation impedance of the player's
+face for a played note */
+static double faceCorrection(int midi) {
+  return 2.9370 * log(midi) - 11.6284;
+}
+complex faceZ(double f, Woodwind w, int midi) {
   double c;
   double rho;
   double entryradius = WW_EMB_RADIUS;
-  double corr = 2.9370 * log(midi) - 11.6284;
-  if (head->embouchureHole) {
-    c = head->embouchureHole->c;
-    rho = head->embouchureHole->rho;
-  } else {
-    c = s->c;
-    rho = s->rho;
-  }
-  return multz(flangedZ(f, c, rho, entryradius), real(corr));
+  faceAir(w, &c, &rho);
+  return multz(flangedZ(frequencyContext(f), c, rho, entryradius),
+               real(faceCorrection(midi)));
 }
-TransferMatrix unitCellMatrix(double f, UnitCell c, double x) {
+TransferMatrix unitCellMatrix(FrequencyContext fc, Woodwind w, int cell,
+                              double x) {
   TransferMatrix m;
-  Map map = (strcmp(c->hole->fingering, "OPEN") == 0) ? c->openMatrixMap
-                                                      : c->closedMatrixMap;
-  if ((x >= boreLength(c->bore)) && containsKey(map, f))
-    m = (TransferMatrix)get(map, f);
-  else {
-    m = traverseHoleMatrix(f, c->hole);
-    if ((x > 0) && (c->bore != NULL))
-      rmultm(m, boreMatrix(f, c->bore, x));
-    if (x >= boreLength(c->bore)) {
-      clear(map);
-      put(map, f, m);
-    }
+  BoreTable t = w->table;
+  UnitCell c = t->cells[cell];
+  int open = HOLE_OPEN(w->fingering, cell);
+  SpectralCache cache = NULL;
+  int bin = -1;
+  /* only the complete cell is cached, and only on the grid */
+  if ((x >= t->cellBore[cell].length) && (w->grid != NULL)) {
+    bin = frequencyBin(w->grid, fc.f);
+    cache = open ? c->openCache : c->closedCache;
+  }
+  if ((bin < 0) || !getCachedMatrix(cache, bin, &m)) {
+    m = calcUnitCellMatrix(fc, w, cell, open, x);
+    if (bin >= 0)
+      putCachedMatrix(cache, bin, m);
   }
   return m;
 }
-TransferMatrix woodwindMatrix(double f, Woodwind w, double entryratio,
-                              double x) {
+TransferMatrix woodwindMatrix(FrequencyContext fc, Woodwind w,
+                              double entryratio, double x) {
   TransferMatrix m = identitym();
   Head h;
+  BoreTable t = w->table;
   complex branchZ;
-  UnitCell cell;
   int cellCount = 0;
   if (x >= 0) {
-    rmultm(m, headMatrix(f, w->head, entryratio, x));
-    x -= boreLength(w->head->downstreamBore);
-    while (x > 0 && cellCount < sizeVector(w->cells)) {
-      cell = (UnitCell)elementAt(w->cells, cellCount);
-      rmultm(m, unitCellMatrix(f, cell, x));
-      x -= boreLength(cell->bore);
+    m = multm(m, headMatrix(fc, w, entryratio, x));
+    x -= t->downstream.length;
+    while (x > 0 && cellCount < t->numCells) {
+      m = multm(m, unitCellMatrix(fc, w, cellCount, x));
+      x -= t->cellBore[cellCount].length;
       cellCount++;
     }
   } else {
     h = w->head;
     if (h->embouchureHole != NULL) {
-      branchZ = woodwindDownstreamZ(f, w);
-      rmultm(m, embouchureMatrix(f, h->embouchureHole, entryratio, branchZ));
+      branchZ = woodwindDownstreamZ(fc, w);
+      m = multm(m,
+                embouchureMatrix(fc, h->embouchureHole, entryratio, branchZ));
     }
-    rmultm(m, boreMatrix(f, h->upstreamBore, -x));
+    m = multm(m, boreMatrix(fc, t, t->upstream, -x));
   }
   return m;
 }
+void boreMatrixBatch(const double *f, int n, BoreTable t, BoreRange bore,
+                     TransferMatrixBatch m) {
+  TransferMatrixBatch segment = createTransferMatrixBatch(n);
+  ProgramElement e;
+  int i, k;
+  identityBatch(m);
+  for (k = bore.first; k < bore.last; k++) {
+    e = compileBoreSegment(t, k, t->length[k]);
+    if (e.type == ELEMENT_TUBE)
+      tubeElementBatch(f, n, &e.u.tube, segment);
+    else if (e.type == ELEMENT_CONE)
+      coneElementBatch(f, n, &e.u.cone, segment);
+    else
+      for (i = 0; i < n; i++)
+        setBatchMatrix(segment, i,
+                       elementMatrix(frequencyContext(f[i]), &e, 0));
+    multBatch(m, segment);
+  }
+  freeTransferMatrixBatch(segment);
+}
+void woodwindMatrixBatch(const double *f, int n, Woodwind w, double entryratio,
+                         TransferMatrixBatch m) {
+  TransferMatrixBatch element;
+  Head h = w->head;
+  BoreTable t = w->table;
+  FrequencyContext *fc;
+  complex branchZ, ZL;
+  int i, cellCount, last;
+  if (w->program != NULL) {
+    programMatrixBatch(f, n, w->program, w->fingering, entryratio, m);
+    return;
+  }
+  element = createTransferMatrixBatch(n);
+  fc = malloc(n * sizeof(FrequencyContext));
+  for (i = 0; i < n; i++)
+    fc[i] = frequencyContext(f[i]);
+  identityBatch(m);
+  /* head */
+  if (h->embouchureHole != NULL) {
+    boreMatrixBatch(f, n, t, t->upstream, element);
+    last = t->upstream.last - 1;
+    for (i = 0; i < n; i++) {
+      ZL = radiationZ(fc[i], t->cOut[last], t->rhoOut[last], t->radius2[last],
+                      h->upstreamFlange);
+      branchZ = calcZin(getBatchMatrix(element, i), ZL);
+      setBatchMatrix(element, i,
+                     embouchureMatrix(fc[i], h->embouchureHole, entryratio,
+                                      branchZ));
+    }
+    multBatch(m, element);
+  }
+  boreMatrixBatch(f, n, t, t->downstream, element);
+  multBatch(m, element);
+  /* unit cells */
+  for (cellCount = 0; cellCount < t->numCells; cellCount++) {
+    for (i = 0; i < n; i++)
+      setBatchMatrix(element, i,
+                     traverseHoleMatrix(fc[i], t->cells[cellCount]->hole,
+                                        HOLE_OPEN(w->fingering, cellCount)));
+    multBatch(m, element);
+    boreMatrixBatch(f, n, t, t->cellBore[cellCount], element);
+    multBatch(m, element);
+  }
+  freeTransferMatrixBatch(element);
+  free(fc);
+}
 int getZ0_c(Woodwind w, double x, complex *Z0, double *c) {
-  Vector bore;
-  int n = 0, cellCount = 0;
-  UnitCell cell;
-  BoreSegment s;
+  BoreTable t = w->table;
+  BoreRange bore = t->downstream;
+  int n, cellCount = 0;
+  UnitCell cell = NULL;
   double radius;
   if (x == 0) {
     *Z0 = charZ(w->head->embouchureHole->c, w->head->embouchureHole->rho,
@@ -327,17 +762,17 @@ int getZ0_c(Woodwind w, double x, complex *Z0, double *c) {
   }
   if (x > 0) {
     /* find the bore or hole at the point x */
-    bore = w->head->downstreamBore;
+    bore = t->downstream;
     /* if x is outside of the current bore, try the next one */
-    while (x >= boreLength(bore) && cellCount < sizeVector(w->cells)) {
+    while (x >= bore.length && cellCount < t->numCells) {
       /* subtract from x the length of the previous bore */
-      x -= boreLength(bore);
+      x -= bore.length;
       /* find the next bore */
-      cell = (UnitCell)elementAt(w->cells, cellCount++);
-      bore = cell->bore;
+      cell = t->cells[cellCount];
+      bore = t->cellBore[cellCount++];
     }
   } else if (x < 0) {
-    bore = w->head->upstreamBore;
+    bore = t->upstream;
     x = -x;
   }
   /* if we are at a hole */
@@ -346,295 +781,189 @@ int getZ0_c(Woodwind w, double x, complex *Z0, double *c) {
     *c = cell->hole->c;
     return 1;
   }
-  /* otherwise, find the correct BoreSegment */
+  /* otherwise, find the correct segment */
   else {
-    s = (BoreSegment)elementAt(bore, n);
-    while (x > s->length) {
+    n = bore.first;
+    while (x > t->length[n] && n < bore.last - 1) {
       /* subtract from x the length of the previous segment */
-      x -= s->length;
+      x -= t->length[n];
       /* get the next segment */
-      s = (BoreSegment)elementAt(bore, ++n);
+      n++;
     }
   }
-  /* if x is outside the BoreSegment, return 0 */
-  if (x > s->length)
+  /* if x is outside the segment, return 0 */
+  if (x > t->length[n])
     return 0;
   /* otherwise do a linear interpolation */
   else {
-    radius = (s->radius2 * x + s->radius1 * (s->length - x)) / (s->length);
+    radius = (t->radius2[n] * x + t->radius1[n] * (t->length[n] - x)) /
+             (t->length[n]);
   }
-  *Z0 = charZ(s->c, s->rho, radius);
-  *c = s->c;
+  *Z0 = charZ(t->c[n], t->rho[n], radius);
+  *c = t->c[n];
   return 1;
 }
-double boreLength(Vector bore) {
-  int n;
-  BoreSegment s;
-  double length = 0;
-  for (n = 0; n < sizeVector(bore); n++) {
-    s = (BoreSegment)elementAt(bore, n);
-    length += s->length;
-  }
-  return length;
-}
 double woodwindLengthPos(Woodwind w) {
+  BoreTable t = w->table;
   int cellCount;
-  UnitCell cell;
   double length = 0;
-  length += boreLength(w->head->downstreamBore);
-  for (cellCount = 0; cellCount < sizeVector(w->cells); cellCount++) {
-    cell = (UnitCell)elementAt(w->cells, cellCount);
-    length += boreLength(cell->bore);
-  }
+  length += t->downstream.length;
+  for (cellCount = 0; cellCount < t->numCells; cellCount++)
+    length += t->cellBore[cellCount].length;
   return length;
 }
-double woodwindLengthNeg(Woodwind w) {
-  return boreLength(w->head->upstreamBore);
-}
+double woodwindLengthNeg(Woodwind w) { return w->table->upstream.length; }
 complex impedance(double f, Woodwind w, double entryratio) {
+  FrequencyContext fc = frequencyContext(f);
   TransferMatrix matrix =
-      woodwindMatrix(f, w, entryratio, woodwindLengthPos(w));
-  return calcZin(matrix, woodwindLoadZ(f, w));
+      woodwindMatrix(fc, w, entryratio, woodwindLengthPos(w));
+  return calcZin(matrix, woodwindLoadZ(fc, w));
+}
+void impedanceBatch(const double *f, int n, Woodwind w, double entryratio,
+                    complex *Z) {
+  TransferMatrixBatch m = createTransferMatrixBatch(n);
+  int i;
+  woodwindMatrixBatch(f, n, w, entryratio, m);
+  for (i = 0; i < n; i++)
+    Z[i] = calcZin(getBatchMatrix(m, i),
+                   woodwindLoadZ(frequencyContext(f[i]), w));
+  freeTransferMatrixBatch(m);
+}
+complex impedanceFor(ConstWoodwind w, uint64_t fingeringMask, double f,
+                     double entryratio) {
+  FrequencyContext fc = frequencyContext(f);
+  BoreTable t = w->table;
+  TransferMatrix m = calcHeadMatrix(fc, w, entryratio, t->downstream.length);
+  int cellCount;
+  for (cellCount = 0; cellCount < t->numCells; cellCount++)
+    m = multm(m, calcUnitCellMatrix(fc, w, cellCount,
+                                    HOLE_OPEN(fingeringMask, cellCount),
+                                    t->cellBore[cellCount].length));
+  return calcZin(m, woodwindLoadZ(fc, w));
 }
 complex playedImpedance(double f, Woodwind w, int midi) {
   double entryradius = WW_EMB_RADIUS;
   complex Z = impedance(f, w, entryradius / woodwindEntryRadius(w));
-  Z = addz(Z, faceZ(f, w->head, midi));
+  Z = addz(Z, faceZ(f, w, midi));
   return Z;
 }
+complex impedanceDerivative(ConstWoodwind w, uint64_t fingeringMask,
+                            double f, double entryratio, complex *dZdf) {
+  FrequencyContext fc = frequencyContext(f);
+  RadiationElement r;
+  dualcomplex Z;
+  double h;
+  if (w->program == NULL) {
+    /* central differences */
+    h = f * WW_DERIVATIVE_STEP;
+    *dZdf = multz(subz(impedanceFor(w, fingeringMask, f + h, entryratio),
+                       impedanceFor(w, fingeringMask, f - h, entryratio)),
+                  real(0.5 / h));
+    return impedanceFor(w, fingeringMask, f, entryratio);
+  }
+  r = w->program->load;
+  Z = calcZinDual(programMatrixDual(fc, w->program, fingeringMask, entryratio),
+                  radiationZDual(fc, r.c, r.rho, r.a, r.flange));
+  *dZdf = Z.d;
+  return Z.v;
+}
+complex playedImpedanceDerivative(double f, Woodwind w, int midi,
+                                  complex *dZdf) {
+  double entryradius = WW_EMB_RADIUS;
+  double corr = faceCorrection(midi);
+  double c, rho;
+  complex Z = impedanceDerivative(w, w->fingering, f,
+                                  entryradius / woodwindEntryRadius(w), dZdf);
+  dualcomplex face;
+  faceAir(w, &c, &rho);
+  face = flangedZDual(frequencyContext(f), c, rho, entryradius);
+  *dZdf = addz(*dZdf, multz(face.d, real(corr)));
+  return addz(Z, multz(face.v, real(corr)));
+}
+complex richardsonExtrapolate(complex coarse, complex fine) {
+  double scale = 1.0 / (pow(2, WW_RICHARDSON_ORDER) - 1);
+  return addz(fine, multz(subz(fine, coarse), real(scale)));
+}
 double woodwindEntryRadius(Woodwind w) {
   double a;
-  BoreSegment s;
   if (w->head->embouchureHole != NULL)
     a = w->head->embouchureHole->radiusout;
-  else {
-    s = (BoreSegment)elementAt(w->head->downstreamBore, 0);
-    a = s->radius1;
-  }
+  else
+    a = w->table->radius1[w->table->downstream.first];
   return a;
 }
-complex woodwindLoadZ(double f, Woodwind w) {
-  Vector lastBore;
-  UnitCell lastCell;
-  BoreSegment s;
-  if (sizeVector(w->cells) == 0)
-    lastBore = w->head->downstreamBore;
-  else {
-    lastCell = (UnitCell)elementAt(w->cells, sizeVector(w->cells) - 1);
-    lastBore = lastCell->bore;
-  }
-  s = (BoreSegment)elementAt(lastBore, sizeVector(lastBore) - 1);
-  return radiationZ(f, s->c, s->rho, s->radius2, w->flange);
+complex woodwindLoadZ(FrequencyContext fc, ConstWoodwind w) {
+  BoreTable t = w->table;
+  BoreRange lastBore;
+  int last;
+  if (t->numCells == 0)
+    lastBore = t->downstream;
+  else
+    lastBore = t->cellBore[t->numCells - 1];
+  last = lastBore.last - 1;
+  return radiationZ(fc, t->cOut[last], t->rhoOut[last], t->radius2[last],
+                    w->flange);
 }
-complex woodwindDownstreamZ(double f, Woodwind w) {
+complex woodwindDownstreamZ(FrequencyContext fc, Woodwind w) {
   TransferMatrix m;
-  UnitCell cell;
+  BoreTable t = w->table;
   int cellCount;
-  m = boreMatrix(f, w->head->downstreamBore,
-                 boreLength(w->head->downstreamBore));
-  for (cellCount = 0; cellCount < sizeVector(w->cells); cellCount++) {
-    cell = (UnitCell)elementAt(w->cells, cellCount);
-    rmultm(m, unitCellMatrix(f, cell, boreLength(cell->bore)));
-  }
-  return calcZin(m, woodwindLoadZ(f, w));
+  m = boreMatrix(fc, t, t->downstream, t->downstream.length);
+  for (cellCount = 0; cellCount < t->numCells; cellCount++)
+    m = multm(m,
+              unitCellMatrix(fc, w, cellCount, t->cellBore[cellCount].length));
+  return calcZin(m, woodwindLoadZ(fc, w));
 }
-TransferMatrix traverseHoleMatrix(double f, Hole hole) {
-  TransferMatrix m = identitym();
-  complex Z_hole, Z_i, Z_a;
-  /* calculate the input impedance to the hole */
-  Z_hole = holeInputImpedance(f, hole);
-  /* calculate the inner radiation impedance */
-  Z_i = holeInnerRadiationImpedance(f, hole);
-  /* calculate the series impedance */
-  Z_a = holeSeriesImpedance(f, hole);
-  /* assign the impedances to the correct matrix element */
-  m->C = divz(one, addz(Z_i, Z_hole));
-  m->B = Z_a;
-  return m;
+TransferMatrix traverseHoleMatrix(FrequencyContext fc, Hole hole, int open) {
+  HoleElement e = compileHole(hole);
+  return holeElementMatrix(fc, &e, open);
 }
-complex holeInputImpedance(double f, Hole hole) {
-  TransferMatrix holeMatrix;
-  double t;
-  double a = hole->boreRadius;
-  double b = hole->radius;
-  complex Z_L;
-  /* calculate the length t (inluding the matching length
-  correction) */
-  t = hole->length + matchingLengthCorrection(a, b);
-  /* calculate the matrix (with losses) for the tube section
-  comprising the hole and matching length */
-  holeMatrix = tubeMatrix(f, hole->c, hole->rho, t, b, 1);
-  /* calculate the load (radiation) impedance of the hole */
-  if (strcmp(hole->fingering, "CLOSED") == 0)
-    Z_L = (hole->key == NULL) ? closedFingerHoleLoadZ(f, hole)
-                              : closedKeyedHoleLoadZ(f, hole);
-  else
-    Z_L = (hole->key == NULL) ? openFingerHoleLoadZ(f, hole)
-                              : openKeyedHoleLoadZ(f, hole);
-  return calcZin(holeMatrix, Z_L);
+complex holeInputImpedance(FrequencyContext fc, Hole hole, int open) {
+  HoleElement e = compileHole(hole);
+  return holeElementInputZ(fc, &e, open);
 }
-complex closedFingerHoleLoadZ(double f, Hole hole) {
-  double a = hole->boreRadius;
-  double b = hole->radius;
-  double delta = b / a;
-  double t_finger;
-  double Z0 = charZ(hole->c, hole->rho, hole->radius).Re;
-  double k = (2 * M_PI * f) / hole->c;
-  t_finger = CORR_CLOSED_FINGER_HOLE_LENGTH * delta * b;
-  return imaginary(-Z0 / tan(k * t_finger));
-}
-complex closedKeyedHoleLoadZ(double f, Hole hole) {
-  double b = hole->radius;
-  double t_keypad;
-  double Z0 = charZ(hole->c, hole->rho, hole->radius).Re;
-  double k = (2 * M_PI * f) / hole->c;
-  t_keypad = CORR_CLOSED_KEYED_HOLE_LENGTH * b;
-  if (t_keypad == 0)
-    return inf;
-  return imaginary(-Z0 / tan(k * t_keypad));
-}
-complex openFingerHoleLoadZ(double f, Hole hole) {
-  double a, b, k;
-  complex Z_flanged, Z0, d_flanged, d_cyl, Z;
-  /* a is the radius of the hole */
-  a = hole->radius;
-  /* b is the radius of the (cylindrical) flange */
-  b = hole->boreRadius + hole->length;
-  /* calculate the wavenumber */
-  k = (2 * M_PI * f) / hole->c;
-  /* calculate the characteristic impedance */
-  Z0 = charZ(hole->c, hole->rho, a);
-  /* calculate the impedance of the (infinitely) flanged hole */
-  Z_flanged = flangedZ(f, hole->c, hole->rho, a);
-  /* calculate complex end corrections */
-  d_flanged = divz(arctanz(divz(Z_flanged, multz(j, Z0))), real(k));
-  d_cyl = subz(d_flanged, real(0.47 * a * pow(a / b, 0.8)));
-  /* add empirical correction */
-  d_cyl = addz(d_cyl, real(CORR_OPEN_FINGER_HOLE_LENGTH * a));
-  Z = multz(j, multz(Z0, tanz(multz(real(k), d_cyl))));
-  return Z;
+complex closedFingerHoleLoadZ(FrequencyContext fc, Hole hole) {
+  HoleElement e = compileHole(hole);
+  return holeElementLoadZ(fc, &e, 0);
 }
-complex openKeyedHoleLoadZ(double f, Hole hole) {
-  double a, d, q, h, e, w;
-  double d_corr, d_e_on_a, k;
-  complex Z_circ, Z0, d_circ, d_disk, Z, R;
-  Key key = hole->key;
-  a = hole->radius;
-  d = key->radius;
-  q = key->holeRadius;
-  h = key->height;
-  e = key->thickness;
-  w = key->wallThickness;
-  /* hack for classical flutes since the keyed holes have no
-  chimneys */
-  if (key->chimneyHeight == 0)
-    w = DBL_MAX;
-  k = (2 * M_PI * f) / hole->c;
-  /* calculate the characteristic impedance */
-  Z0 = charZ(hole->c, hole->rho, a);
-  /* Dalmont et al. (2001) Radiation impedance of tubes with different
-  flanges: Numerical and experimental investigations, Journal of
-  Sound and Vibration 244(3), 505--534, eqs. (48, 51, 52) */
-  d_corr = a / (3.5 * pow(h / a, 0.8) * pow(h / a + 3 * w / a, -0.4) +
-                30 * pow(h / d, 2.6));
-  /* add empirical length correction */
-  d_corr = d_corr + CORR_OPEN_KEYED_HOLE_LENGTH * a;
-  if (q > 0) {
-    d_e_on_a = 1.64 * a / q - 0.15 * a / d - 1.1 + e * a / (q * q);
-    d_corr = d_corr / (1 + 5 * pow(d_e_on_a, -1.35) * pow(h / a, -0.2));
-  }
-  Z_circ = radiationZ(f, hole->c, hole->rho, a, w / a);
-  /* calculate complex end corrections */
-  d_circ = divz(arctanz(divz(Z_circ, multz(j, Z0))), real(k));
-  d_disk = addz(d_circ, real(d_corr));
-  Z = multz(j, multz(Z0, tanz(multz(real(k), d_disk))));
-  /* add empirical resistance */
-  R = multz(Z0, real(0.4 * pow(k * a, 2)));
-  Z = addz(Z, R);
-  return Z;
+complex closedKeyedHoleLoadZ(FrequencyContext fc, Hole hole) {
+  HoleElement e = compileHole(hole);
+  return holeElementLoadZ(fc, &e, 0);
 }
-complex holeInnerRadiationImpedance(double f, Hole hole) {
-  double t_i;
-  double Z0 = charZ(hole->c, hole->rho, hole->radius).Re;
-  double k = (2 * M_PI * f) / hole->c;
-  t_i = innerRadiationLengthCorrection(hole->boreRadius, hole->radius);
-  return imaginary(t_i * k * Z0);
+complex openFingerHoleLoadZ(FrequencyContext fc, Hole hole) {
+  HoleElement e = compileHole(hole);
+  return holeElementLoadZ(fc, &e, 1);
 }
-complex holeSeriesImpedance(double f, Hole hole) {
-  double a = hole->boreRadius;
-  double b = hole->radius;
-  double delta = b / a;
-  double t = hole->length, t_0 = 0, t_a;
-  double Z0 = charZ(hole->c, hole->rho, hole->boreRadius).Re;
-  double k = (2 * M_PI * f) / hole->c;
-  if (strcmp(hole->fingering, "CLOSED") == 0) {
-    if (hole->key == NULL)
-      t_0 = b * (0.55 - 0.15 / cosh(9 * t / a) +
-                 0.4 / cosh(6.5 * t / a) * (delta - 1));
-    t_a = closedHoleSeriesLengthCorrection(a, b, t - t_0);
-  } else
-    t_a = openHoleSeriesLengthCorrection(a, b);
-  return imaginary(t_a * k * Z0);
-}
-TransferMatrix embouchureMatrix(double f, EmbouchureHole h, double entryratio,
-                                complex branchZ) {
-  TransferMatrix m, riserMatrix, cornerMatrix, innerRadMatrix;
-  double t_m, t_i, t_a;
-  double radiusin, radiusout;
-  complex Z_i, Z_a;
-  double Z0_hole = charZ(h->c, h->rho, h->radiusin).Re;
-  double Z0_bore = charZ(h->c, h->rho, h->boreRadius).Re;
-  double k = (2 * M_PI * f) / h->c;
-  /* calculate the matching length correction */
-  t_m = matchingLengthCorrection(h->boreRadius, h->radiusin);
-  /* introduce lossy elements to account for the discontinuity */
-  m = identitym();
-  m->B = embouchureSeriesResistance(f, h, entryratio);
-  m->C = embouchureShuntConductance(f, h, entryratio);
-  /* calculate the matrix (with losses) for the tube section
-  comprising the hole and matching length */
-  radiusin = h->radiusin;
-  radiusout = entryratio * h->radiusout;
-  riserMatrix = (radiusin == radiusout)
-                    ? tubeMatrix(f, h->c, h->rho, h->length + t_m, radiusin, 1)
-                    : coneMatrix(f, h->c, h->rho, h->length + t_m, radiusout,
-                                 radiusin, 1);
-  rmultm(m, riserMatrix);
-  /* calculate the inner radiation impedance */
-  t_i = innerRadiationLengthCorrection(h->boreRadius, h->radiusin);
-  /* add extra length correction for the embouchure hole */
-  t_i = t_i + embouchureLengthCorrection(h->boreRadius, h->radiusin);
-  Z_i = imaginary(t_i * k * Z0_hole);
-  /* add the inner radiation impedance to the matrix m by
-  multiplication */
-  innerRadMatrix = identitym();
-  innerRadMatrix->B = Z_i;
-  rmultm(m, innerRadMatrix);
-  /* calculate the series impedance */
-  t_a = openHoleSeriesLengthCorrection(h->boreRadius, h->radiusin);
-  Z_a = imaginary(t_a * k * Z0_bore);
-  /* add half the series impedance to the branch impedance */
-  branchZ = addz(branchZ, divz(Z_a, real(2.0)));
-  /* multiply m by matrix representing the corner */
-  cornerMatrix = identitym();
-  cornerMatrix->C = divz(one, branchZ);
-  cornerMatrix->B = divz(Z_a, real(2.0));
-  rmultm(m, cornerMatrix);
-  return m;
+complex openKeyedHoleLoadZ(FrequencyContext fc, Hole hole) {
+  HoleElement e = compileHole(hole);
+  return holeElementLoadZ(fc, &e, 1);
+}
+complex holeInnerRadiationImpedance(FrequencyContext fc, Hole hole) {
+  HoleElement e = compileHole(hole);
+  return holeElementInnerZ(fc, &e);
+}
+complex holeSeriesImpedance(FrequencyContext fc, Hole hole, int open) {
+  HoleElement e = compileHole(hole);
+  return holeElementSeriesZ(fc, &e, open);
+}
+TransferMatrix embouchureMatrix(FrequencyContext fc, EmbouchureHole h,
+                                double entryratio, complex branchZ) {
+  EmbouchureElement e = compileEmbouchure(h, entryratio);
+  return embouchureElementMatrix(fc, &e, branchZ);
 }
 double embouchureLengthCorrection(double a, double b) {
   double delta = b / a;
   return b * 0.5 * pow(delta, 2);
 }
-complex embouchureSeriesResistance(double f, EmbouchureHole h,
+complex embouchureSeriesResistance(FrequencyContext fc, EmbouchureHole h,
                                    double entryratio) {
-  double Z0 = charZ(h->c, h->rho, entryratio * h->radiusout).Re;
-  return real(Z0 * 6.9e-6 * f);
+  EmbouchureElement e = compileEmbouchure(h, entryratio);
+  return real(e.seriesResistance * fc.f);
 }
-complex embouchureShuntConductance(double f, EmbouchureHole h,
+complex embouchureShuntConductance(FrequencyContext fc, EmbouchureHole h,
                                    double entryratio) {
-  double Z0 = charZ(h->c, h->rho, entryratio * h->radiusout).Re;
-  return real(1.3e-4 * f / Z0);
+  EmbouchureElement e = compileEmbouchure(h, entryratio);
+  return real(1.3e-4 * fc.f / e.Z0entry);
 }
 double matchingLengthCorrection(double a, double b) {
   /* Dalmont et al. (2002) Experimental Determination of the
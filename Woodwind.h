@@ -5,12 +5,27 @@ A woodwind instrument.
 */
 #ifndef WOODWIND_H_PROTECTOR
 #define WOODWIND_H_PROTECTOR
+#include "Acoustics.h"
 #include "Complex.h"
-#include "Map.h"
+#include "FrequencyGrid.h"
 #include "TransferMatrix.h"
 #include "Vector.h"
-/* Maximum length of bore elements */
+#include <stdint.h>
+#include <stdio.h>
+/* Maximum number of tone holes (one bit each in a fingering mask) */
+#define WW_MAX_HOLES 64
+/* Whether hole i is open in a fingering mask */
+#define HOLE_OPEN(mask, i) ((int)(((mask) >> (i)) & 1))
+/* Maximum length of bore elements (by default, of cones only) */
 #define WW_MAX_LENGTH 5.0e-3
+/* Minimum length of bore elements in adaptive discretisation */
+#define WW_MIN_LENGTH 2.5e-4
+/* Order of the discretisation error, for Richardson extrapolation */
+#define WW_RICHARDSON_ORDER 2
+/* Relative frequency step of a finite-difference derivative */
+#define WW_DERIVATIVE_STEP 1.0e-6
+/* Relative tolerance on equal tapers when merging cones */
+#define WW_TAPER_TOLERANCE 1.0e-9
 /* Temperature, humidity and CO2 */
 #define WW_T_0 30.3
 #define WW_T_AMB 21.0
@@ -29,8 +44,6 @@ typedef struct boresegment_str {
   double radius1;
   double radius2;
   double length;
-  double c;
-  double rho;
 } * BoreSegment;
 /* Key: */
 typedef struct key_str {
@@ -49,7 +62,6 @@ typedef struct hole_str {
   Key key;
   double c;
   double rho;
-  char *fingering;
 } * Hole;
 /* EmbouchureHole: */
 typedef struct embouchurehole_str {
@@ -66,21 +78,60 @@ typedef struct head_str {
   Vector upstreamBore;
   double upstreamFlange;
   Vector downstreamBore;
-  Map matrixMap;
+  SpectralCache cache;
+  double cacheEntryRatio;
 } * Head;
 /* UnitCell: */
 typedef struct unitcell_str {
   Hole hole;
   Vector bore;
-  Map openMatrixMap;
-  Map closedMatrixMap;
+  SpectralCache openCache;
+  SpectralCache closedCache;
 } * UnitCell;
+/* BoreRange: { first segment, one past the last segment, total
+length } of a contiguous run of segments in a BoreTable */
+typedef struct borerange_str {
+  int first;
+  int last;
+  double length;
+} BoreRange;
+/* BoreTable: the bore segments of a woodwind held as flat arrays, in
+the order upstream bore, downstream bore, then the bore of each unit
+cell, together with the unit cells and the range of each bore. The
+speed of sound and density are held at the middle of each segment
+(c, rho) and at its input and output ends (cIn, rhoIn, cOut,
+rhoOut). */
+typedef struct boretable_str {
+  int numSegments;
+  double *radius1;
+  double *radius2;
+  double *length;
+  double *c;
+  double *rho;
+  double *cIn;
+  double *rhoIn;
+  double *cOut;
+  double *rhoOut;
+  BoreRange upstream;
+  BoreRange downstream;
+  int numCells;
+  UnitCell *cells;
+  BoreRange *cellBore;
+} * BoreTable;
+/* WoodwindProgram: a compiled woodwind (see WoodwindProgram.h) */
+typedef struct woodwindprogram_str *WoodwindProgram;
 /* Woodwind: */
 typedef struct woodwind_str {
   Head head;
   Vector cells;
   double flange;
+  BoreTable table;
+  FrequencyGrid grid;
+  uint64_t fingering;
+  WoodwindProgram program;
 } * Woodwind;
+/* ConstWoodwind: a Woodwind which is only read */
+typedef const struct woodwind_str *ConstWoodwind;
 BoreSegment createBoreSegment(double radius1, double radius2, double length);
 /*
 Creates a new BoreSegment.
@@ -156,7 +207,7 @@ a new UnitCell with the given parameters
 */
 Woodwind createWoodwind(Head head, Vector cells, double flange);
 /*
-Creates a new Woodwind.
+Creates a new Woodwind and builds its BoreTable.
 Parameters:
 head: the Head of the woodwind
 cells: a vector of unit cells
@@ -164,10 +215,38 @@ flange: the termination condition at the end of the instrument
 Returns:
 a new Woodwind with the given parameters
 */
+void buildBoreTable(Woodwind w);
+/*
+(Re)builds the BoreTable of a Woodwind from its bore vectors. The
+speed of sound and density of every segment are reset to zero, so
+setAirProperties must be called afterwards. Any compiled program is
+discarded.
+Parameters:
+w: the instrument
+*/
+void setFrequencyGrid(Woodwind w, FrequencyGrid g);
+/*
+Attaches a FrequencyGrid to a Woodwind, giving the Head and each
+UnitCell a dense per-bin cache of its (open and closed) matrices.
+Matrices are then only recalculated at frequencies which lie on the
+grid the first time they are needed, whatever the fingering.
+Parameters:
+w: the instrument
+g: the FrequencyGrid (NULL to disable caching)
+*/
+void clearWoodwindCaches(Woodwind w);
+/*
+Discards all the matrices cached for a Woodwind. Called whenever the
+bore or air properties change.
+Parameters:
+w: the instrument
+*/
 void setAirProperties(Woodwind w, double t_0, double t_amb, double t_grad,
                       double humid, double x_CO2);
 /*
-Sets the speed of sound and density of air along the instrument.
+Sets the speed of sound and density of air along the instrument
+(stored in its BoreTable), interpolated from an AirTable over the
+temperatures of the profile. Any compiled program is discarded.
 Parameters:
 w: the instrument
 t_0: the temperature at x = 0 (embouchure hole) in deg C
@@ -176,13 +255,95 @@ t_grad: the temperature gradient (deg C / m)
 humid: the relative humidity (between 0 and 1)
 x_CO2: the molar fraction of carbon dioxide
 */
+void setAirPropertiesTable(Woodwind w, AirTable air, double t_0, double t_amb,
+                           double t_grad);
+/*
+Sets the speed of sound and density of air along the instrument from
+a table of air properties, which may be shared between calls (e.g.
+over a sweep of temperature profiles at one humidity). Any compiled
+program is discarded.
+Parameters:
+w: the instrument
+air: the AirTable (best covering all the temperatures of the profile)
+t_0: the temperature at x = 0 (embouchure hole) in deg C
+t_amb: the ambient temperature (deg C)
+t_grad: the temperature gradient (deg C / m)
+*/
 void discretiseWoodwind(Woodwind w, double maxLength);
 /*
-Cuts up instrument so that no segment is longer than maxLength.
+Cuts up instrument so that no segment is longer than maxLength and
+rebuilds its BoreTable.
 Parameters:
 w: the instrument
 maxLength: the maximum segment length
 */
+void discretiseWoodwindCones(Woodwind w, double maxLength);
+/*
+Cuts up the cones of instrument so that none is longer than maxLength,
+leaving the cylinders whole (their transfer matrices follow the
+temperature gradient without cutting; refer to
+gradientTubeElementMatrix), and rebuilds its BoreTable.
+Parameters:
+w: the instrument
+maxLength: the maximum cone length
+*/
+void halveWoodwind(Woodwind w);
+/*
+Cuts every bore segment of the instrument into two equal halves and
+rebuilds its BoreTable (e.g. for Richardson extrapolation between an
+instrument and its halved copy).
+Parameters:
+w: the instrument
+*/
+int discretiseWoodwindAdaptive(Woodwind w, double fhi, double tolerance,
+                               double t_0, double t_amb, double t_grad,
+                               double humid, double x_CO2);
+/*
+Cuts up each segment of the instrument into as many equal pieces as
+needed for a target error at the highest frequency, rebuilds its
+BoreTable and sets its air properties. A segment is split until
+halving its pieces changes its transfer matrix (with B and C scaled by
+the characteristic impedance) by no more than its share of the
+tolerance, in proportion to its length, so that segments with a
+steep temperature gradient, a strong taper or a short wavelength are
+cut finely and uniform cylinders are not cut at all. The pieces are
+no shorter than WW_MIN_LENGTH.
+Parameters:
+w: the instrument
+fhi: the highest frequency of interest in Hz
+tolerance: the target error of the whole instrument
+t_0: the temperature at x = 0 (embouchure hole) in deg C
+t_amb: the ambient temperature (deg C)
+t_grad: the temperature gradient (deg C / m)
+humid: the relative humidity (between 0 and 1)
+x_CO2: the molar fraction of carbon dioxide
+Returns:
+the number of segments of the instrument
+*/
+void fprintSegmentation(FILE *stream, Woodwind w);
+/*
+Prints the number of segments and the range of segment lengths of
+each bore of the instrument (upstream, downstream and each unit
+cell), one bore per line.
+Parameters:
+stream: the stream to print to
+w: the instrument
+*/
+int coalesceWoodwind(Woodwind w, double maxConeLength);
+/*
+Merges runs of adjacent segments within each bore of the BoreTable
+that are acoustically one piece: cylinders of equal radius, and cones
+of equal taper (as long as the merged cone is no longer than
+maxConeLength, since the wall losses of a cone are evaluated at its
+mean radius), in both cases with equal c and rho. Must be called
+after setAirProperties; the bore vectors are unchanged, so
+buildBoreTable undoes the merging. Any compiled program is discarded.
+Parameters:
+w: the instrument
+maxConeLength: the maximum length of a merged cone
+Returns:
+the number of segments removed
+*/
 void discretiseBore(Vector bore, double maxLength);
 /*
 Cuts up a bore so that no segment is longer than maxLength.
@@ -190,6 +351,18 @@ Parameters:
 w: the instrument
 maxLength: the maximum segment length
 */
+int fingeringMask(Woodwind w, char *holestring, uint64_t *mask);
+/*
+Converts a fingering string to a fingering mask, in which bit i is
+set if hole i is open.
+Parameters:
+w: the instrument
+holestring: a string of 'X's and 'O's representing the fingering
+mask: the return variable for the fingering mask
+Returns:
+1 if holestring is a valid fingering for the instrument
+0 otherwise
+*/
 int setFingering(Woodwind w, char *holestring);
 /*
 Sets the woodwind fingering to the given string.
@@ -200,64 +373,71 @@ Returns:
 1 if the operation was sucessful
 0 otherwise
 */
-TransferMatrix boreSegmentMatrix(double f, BoreSegment s, double x);
+TransferMatrix boreSegmentMatrix(FrequencyContext fc, BoreTable t, int n,
+                                 double x);
 /*
-Calculates the TransferMatrix for a BoreSegment.
+Calculates the TransferMatrix for a bore segment.
 Parameters:
-f: the frequency in Hz
-s: the BoreSegment
-x: distance along the BoreSegment to calculate
+fc: the FrequencyContext of the frequency
+t: the BoreTable
+n: the index of the segment in t
+x: distance along the segment to calculate
 Returns:
-the TransferMatrix for the BoreSegment
+the TransferMatrix for the segment
 */
-TransferMatrix boreMatrix(double f, Vector bore, double x);
+TransferMatrix boreMatrix(FrequencyContext fc, BoreTable t, BoreRange bore,
+                          double x);
 /*
 Calculates the TransferMatrix for a bore.
 Parameters:
-f: the frequency in Hz
-bore: the bore
+fc: the FrequencyContext of the frequency
+t: the BoreTable
+bore: the range of segments in t making up the bore
 x: distance along the bore to calculate
 Returns:
 the TransferMatrix for the bore
 */
-TransferMatrix headMatrix(double f, Head h, double entryratio, double x);
+TransferMatrix headMatrix(FrequencyContext fc, Woodwind w, double entryratio,
+                          double x);
 /*
-Calculates the TransferMatrix for a Head.
+Calculates the TransferMatrix for the Head of a Woodwind.
 Parameters:
-f: the frequency in Hz
-h: the Head
+fc: the FrequencyContext of the frequency
+w: the Woodwind
 entryratio: the ratio of the input side radius (impedance head or
 embouchure) to the entry radius of the instrument
 x: distance along the Head to calculate
 Returns:
 the TransferMatrix for the Head
 */
-complex faceZ(double f, Head head, int midi);
+complex faceZ(double f, Woodwind w, int midi);
 /*
 Calculates the radiation impeance of the player's face.
 Parameters:
 f: the frequency in Hz
-head: the Head
+w: the Woodwind
 midi: the MIDI number for the played note
 Returns:
 the radiation impedance
 */
-TransferMatrix unitCellMatrix(double f, UnitCell c, double x);
+TransferMatrix unitCellMatrix(FrequencyContext fc, Woodwind w, int cell,
+                              double x);
 /*
 Calculates the TransferMatrix for a UnitCell.
 Parameters:
-f: the frequency in Hz
-c: the UnitCell
+fc: the FrequencyContext of the frequency
+w: the Woodwind
+cell: the index of the UnitCell
 x: distance along the UnitCell to calculate
 Returns:
 the TransferMatrix for the UnitCell
 */
-TransferMatrix woodwindMatrix(double f, Woodwind w, double entryratio,
-                              double x);
+TransferMatrix woodwindMatrix(FrequencyContext fc, Woodwind w,
+                              double entryratio, double x);
 /*
 Calculates the TransferMatrix for a Woodwind.
 Parameters:
-f: the frequency in Hz
+fc: the FrequencyContext of the frequency
 w: the Woodwind
 entryratio: the ratio of the input side radius (impedance head or
 embouchure) to the entry radius of the instrument
@@ -265,6 +445,33 @@ x: distance along the Woodwind to calculate
 Returns:
 the TransferMatrix for the Woodwind
 */
+void boreMatrixBatch(const double *f, int n, BoreTable t, BoreRange bore,
+                     TransferMatrixBatch m);
+/*
+Calculates the TransferMatrix for a whole bore at n frequencies at
+once.
+Parameters:
+f: the frequencies in Hz
+n: the number of frequencies
+t: the BoreTable
+bore: the range of segments in t making up the bore
+m: the return batch (of n matrices)
+*/
+void woodwindMatrixBatch(const double *f, int n, Woodwind w, double entryratio,
+                         TransferMatrixBatch m);
+/*
+Calculates the TransferMatrix for a whole Woodwind at n frequencies
+at once. The bore segments are calculated by the batched kernels;
+the embouchure and tone holes one frequency at a time. No matrices
+are cached.
+Parameters:
+f: the frequencies in Hz
+n: the number of frequencies
+w: the Woodwind
+entryratio: the ratio of the input side radius (impedance head or
+embouchure) to the entry radius of the instrument
+m: the return batch (of n matrices)
+*/
 int getZ0_c(Woodwind w, double x, complex *Z0, double *c);
 /*
 Calculates the characteristic impedance and speed of sound at a
@@ -278,14 +485,6 @@ Returns:
 1 if x within range
 0 otherwise
 */
-double boreLength(Vector bore);
-/*
-Calculates the length of a bore.
-Parameters:
-bore: a vector of BoreSegments
-Returns:
-the total length of the bore
-*/
 double woodwindLengthPos(Woodwind w);
 /*
 Calculates the length of a Woodwind in the positive direction.
@@ -315,6 +514,35 @@ embouchure) to the entry radius of the instrument
 Returns:
 the input impedance of the woodwind
 */
+void impedanceBatch(const double *f, int n, Woodwind w, double entryratio,
+                    complex *Z);
+/*
+Calculates the input impedance of a Woodwind at n frequencies at
+once.
+Parameters:
+f: the frequencies in Hz
+n: the number of frequencies
+w: the Woodwind
+entryratio: the ratio of the input side radius (impedance head or
+embouchure) to the entry radius of the instrument
+Z: the return array for the input impedances (of length n)
+*/
+complex impedanceFor(ConstWoodwind w, uint64_t fingeringMask, double f,
+                     double entryratio);
+/*
+Calculates the input impedance of a Woodwind for the given fingering.
+Neither the fingering nor the caches of the instrument are read or
+written, so several threads may call this on one instrument at once
+(with different fingerings).
+Parameters:
+w: the Woodwind
+fingeringMask: the fingering (bit i set if hole i is open)
+f: the frequency in Hz
+entryratio: the ratio of the input side radius (impedance head or
+embouchure) to the entry radius of the instrument
+Returns:
+the input impedance of the woodwind
+*/
 complex playedImpedance(double f, Woodwind w, int midi);
 /*
 Calculates the input impedance of a Woodwind in combination with the
@@ -326,6 +554,51 @@ midi: the MIDI number of the played note
 Returns:
 the input impedance of the played woodwind
 */
+complex impedanceDerivative(ConstWoodwind w, uint64_t fingeringMask,
+                            double f, double entryratio, complex *dZdf);
+/*
+Calculates the input impedance of a Woodwind for the given fingering
+(as impedanceFor) together with its derivative with respect to
+frequency. A compiled woodwind carries the derivative through every
+element in the same pass as the impedance; otherwise it is estimated
+by central differences of relative step WW_DERIVATIVE_STEP.
+Parameters:
+w: the Woodwind
+fingeringMask: the fingering (bit i set if hole i is open)
+f: the frequency in Hz
+entryratio: the ratio of the input side radius (impedance head or
+embouchure) to the entry radius of the instrument
+dZdf: the return variable for dZ/df in ohms per Hz
+Returns:
+the input impedance of the woodwind
+*/
+complex playedImpedanceDerivative(double f, Woodwind w, int midi,
+                                  complex *dZdf);
+/*
+Calculates the played input impedance of a Woodwind (as
+playedImpedance) together with its derivative with respect to
+frequency.
+Parameters:
+f: the frequency in Hz
+w: the Woodwind
+midi: the MIDI number of the played note
+dZdf: the return variable for dZ/df in ohms per Hz
+Returns:
+the input impedance of the played woodwind
+*/
+complex richardsonExtrapolate(complex coarse, complex fine);
+/*
+Combines a value calculated from an instrument discretised with
+segment length h and from one with segment length h / 2 by Richardson
+extrapolation, assuming the discretisation error falls as h to the
+power WW_RICHARDSON_ORDER. The difference between the result and the
+fine value estimates the error of the fine value.
+Parameters:
+coarse: the value with segment length h
+fine: the value with segment length h / 2
+Returns:
+the extrapolated value
+*/
 double woodwindEntryRadius(Woodwind w);
 /*
 Calculates the radius of the woodwind at the entry.
@@ -335,63 +608,65 @@ Returns:
 the outside radius of the embouchure hole (if present)
 otherwise the input radius of the first BoreSegment
 */
-complex woodwindLoadZ(double f, Woodwind w);
+complex woodwindLoadZ(FrequencyContext fc, ConstWoodwind w);
 /*
 Calculates the load impedance at the end of a Woodwind.
 Parameters:
-f: the frequency in Hz
+fc: the FrequencyContext of the frequency
 w: the Woodwind
 Returns:
 the load impedance of the woodwind
 */
-complex woodwindDownstreamZ(double f, Woodwind w);
+complex woodwindDownstreamZ(FrequencyContext fc, Woodwind w);
 /*
 Calculates the input impedance of the section of the Woodwind
 downstream of the embouchure hole.
 Parameters:
-f: the frequency in Hz
+fc: the FrequencyContext of the frequency
 w: the Woodwind
 Returns:
 the downstream impedance of the Woodwind
 */
-TransferMatrix traverseHoleMatrix(double f, Hole h);
+TransferMatrix traverseHoleMatrix(FrequencyContext fc, Hole h, int open);
 /*
 Calculates the transfer matrix relating the acoustic parameters on
 each side of the hole.
 Parameters:
-f: the frequency.
+fc: the FrequencyContext of the frequency.
 h: the hole.
+open: 1 if the hole is open, 0 if closed.
 Returns:
 The transfer matrix for the hole.
 */
-complex holeInputImpedance(double f, Hole hole);
+complex holeInputImpedance(FrequencyContext fc, Hole hole, int open);
 /*
 Calculates the input impedance of a Hole.
 Parameters:
-f: the frequency.
+fc: the FrequencyContext of the frequency.
 h: the hole.
+open: 1 if the hole is open, 0 if closed.
 Returns:
 The input impedance of the hole.
 */
-complex closedFingerHoleLoadZ(double f, Hole hole);
+complex closedFingerHoleLoadZ(FrequencyContext fc, Hole hole);
 /*
 Calculates the load impedance of a closed finger hole.
 Parameters:
-f: the frequency.
+fc: the FrequencyContext of the frequency.
 h: the hole.
 Returns:
 The load impedance impedance of the hole.
 */
-complex closedKeyedHoleLoadZ(double f, Hole hole);
+complex closedKeyedHoleLoadZ(FrequencyContext fc, Hole hole);
 /*
 Calculates the load impedance of a closed keyed hole.
 Parameters:
-f: the frequency.
+fc: the FrequencyContext of the frequency.
 h: the hole.
 Returns:
 The load impedance impedance of the hole.
 */
-complex openFingerHoleLoadZ(double f, Hole hole);
+complex openFingerHoleLoadZ(FrequencyContext fc, Hole hole);
 /*
 Calculates the load (radiation) impedance of an open finger hole.
 Parameters:
@@ -400,7 +675,7 @@ h: the hole.
 Returns:
 The load (radiation) impedance impedance of the hole.
 */
-complex openKeyedHoleLoadZ(double f, Hole hole);
+complex openKeyedHoleLoadZ(FrequencyContext fc, Hole hole);
 /*
 Calculates the load (radiation) impedance of an open keyed hole.
 Parameters:
@@ -409,30 +684,31 @@ h: the hole.
 Returns:
 The load (radiation) impedance impedance of the hole.
 */
-complex holeInnerRadiationImpedance(double f, Hole hole);
+complex holeInnerRadiationImpedance(FrequencyContext fc, Hole hole);
 /*
 Calculates the inner radiation impedance of a hole.
 Parameters:
-f: the frequency.
+fc: the FrequencyContext of the frequency.
 h: the hole.
 Returns:
 The inner radiation impedance impedance of the hole.
 */
-complex holeSeriesImpedance(double f, Hole hole);
+complex holeSeriesImpedance(FrequencyContext fc, Hole hole, int open);
 /*
 Calculates the series impedance of a hole.
 Parameters:
-f: the frequency.
+fc: the FrequencyContext of the frequency.
 h: the hole.
+open: 1 if the hole is open, 0 if closed.
 Returns:
 The series impedance impedance of the hole.
 */
-TransferMatrix embouchureMatrix(double f, EmbouchureHole h, double entryratio,
-                                complex branchZ);
+TransferMatrix embouchureMatrix(FrequencyContext fc, EmbouchureHole h,
+                                double entryratio, complex branchZ);
 /*
 Calculates the TransferMatrix for an EmbouchureHole.
 Parameters:
-f: the frequency in Hz
+fc: the FrequencyContext of the frequency
 h: the EmbouchureHole
 entryratio: the ratio of the input side radius (impedance head or
 embouchure) to the outside radius of the embouchure hole
@@ -452,13 +728,13 @@ b: the inside radius of the embouchure hole
 Returns:
 the length correction
 */
-complex embouchureSeriesResistance(double f, EmbouchureHole h,
+complex embouchureSeriesResistance(FrequencyContext fc, EmbouchureHole h,
                                    double entryratio);
 /*
 Returns the empirically-determined embouchure series resistance
 correction.
 Parameters:
-f: the frequency in Hz
+fc: the FrequencyContext of the frequency
 h: the EmbouchureHole
 entryratio: the ratio of the input side radius (impedance head or
 embouchure) to the outside radius of the embouchure hole
@@ -467,13 +743,13 @@ downstream section)
 Returns:
 the series resistance
 */
-complex embouchureShuntConductance(double f, EmbouchureHole h,
+complex embouchureShuntConductance(FrequencyContext fc, EmbouchureHole h,
                                    double entryratio);
 /*
 Returns the empirically-determined embouchure shunt conductance
 correction.
 Parameters:
-f: the frequency in Hz
+fc: the FrequencyContext of the frequency
 h: the EmbouchureHole
 entryratio: the ratio of the input side radius (impedance head or
 embouchure) to the outside radius of the embouchure hole
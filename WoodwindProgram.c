@@ -0,0 +1,563 @@
+/*
+WoodwindProgram.c
+A woodwind compiled into a flat program of typed element records.
+Refer to WoodwindProgram.h for interface details.
+*/
+#include "WoodwindProgram.h"
+#include "AcousticsBatch.h"
+#include <float.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+/* compiles the bore segments of a range of the bore table into
+elements from index n, recording their range, and returns the index
+following the bore */
+static int compileBore(WoodwindProgram p, BoreTable t, BoreRange bore, int n,
+                       BoreRange *range) {
+  int k;
+  range->first = n;
+  range->length = bore.length;
+  for (k = bore.first; k < bore.last; k++, n++)
+    p->element[n] = compileBoreSegment(t, k, t->length[k]);
+  range->last = n;
+  return n;
+}
+/* the radiating end of the last segment of a range of the bore table */
+static RadiationElement compileLoad(BoreTable t, BoreRange bore,
+                                    double flange) {
+  RadiationElement r;
+  int last = bore.last - 1;
+  r.c = t->cOut[last];
+  r.rho = t->rhoOut[last];
+  r.a = t->radius2[last];
+  r.flange = flange;
+  return r;
+}
+void compileWoodwind(Woodwind w, double entryratio) {
+  WoodwindProgram p = (WoodwindProgram)malloc(sizeof(*p));
+  BoreTable t = w->table;
+  Head h = w->head;
+  int i, n;
+  freeWoodwindProgram(w->program);
+  /* one element per bore segment, and one per hole */
+  p->numCells = t->numCells;
+  p->numElements = t->numSegments + t->numCells;
+  p->element = (ProgramElement *)malloc(
+      (p->numElements > 0 ? p->numElements : 1) * sizeof(ProgramElement));
+  p->cell = (BoreRange *)malloc((p->numCells > 0 ? p->numCells : 1) *
+                                sizeof(BoreRange));
+  n = compileBore(p, t, t->upstream, 0, &p->upstream);
+  n = compileBore(p, t, t->downstream, n, &p->downstream);
+  for (i = 0; i < t->numCells; i++) {
+    p->element[n].type = ELEMENT_HOLE;
+    p->element[n].cell = i;
+    p->element[n].u.hole = compileHole(t->cells[i]->hole);
+    n = compileBore(p, t, t->cellBore[i], n + 1, &p->cell[i]);
+    p->cell[i].first--;
+  }
+  p->embouchureHole = h->embouchureHole;
+  if (h->embouchureHole != NULL) {
+    p->embouchure = compileEmbouchure(h->embouchureHole, entryratio);
+    p->branchLoad = compileLoad(t, t->upstream, h->upstreamFlange);
+  } else {
+    /* no embouchure hole: the head constants are copied but unused */
+    memset(&p->embouchure, 0, sizeof(p->embouchure));
+    memset(&p->branchLoad, 0, sizeof(p->branchLoad));
+  }
+  p->load = compileLoad(
+      t, (t->numCells == 0) ? t->downstream : t->cellBore[t->numCells - 1],
+      w->flange);
+  w->program = p;
+}
+/* the value at fraction s along a segment of a property varying
+quadratically through v1, vm and v2 at its input, middle and output */
+static double quadraticAir(double v1, double vm, double v2, double s) {
+  if (s <= 0.0)
+    return v1;
+  if (s >= 1.0)
+    return v2;
+  if (s == 0.5)
+    return vm;
+  return v1 + s * ((4 * vm - 3 * v1 - v2) + s * 2 * (v1 + v2 - 2 * vm));
+}
+ProgramElement compileBoreSegment(BoreTable t, int n, double x) {
+  return compileBorePiece(t, n, 0, x);
+}
+ProgramElement compileBorePiece(BoreTable t, int n, double x1, double x2) {
+  ProgramElement e;
+  double length, radius1, radius2, s1, s2, sm, c1, cm, c2, rho1, rhom, rho2;
+  int cylinder;
+  if (x2 > t->length[n])
+    x2 = t->length[n];
+  length = x2 - x1;
+  radius1 = t->radius1[n];
+  radius2 = t->radius2[n];
+  if (x1 > 0)
+    radius1 = (t->radius2[n] * x1 + t->radius1[n] * (t->length[n] - x1)) /
+              (t->length[n]);
+  if (x2 < t->length[n])
+    radius2 = (t->radius2[n] * x2 + t->radius1[n] * (t->length[n] - x2)) /
+              (t->length[n]);
+  /* a piece of a cylinder is a cylinder, whatever the rounding of the
+  interpolated radii */
+  cylinder = (t->radius1[n] == t->radius2[n]);
+  e.cell = -1;
+  if ((t->cIn[n] == t->c[n]) && (t->cOut[n] == t->c[n]) &&
+      (t->rhoIn[n] == t->rho[n]) && (t->rhoOut[n] == t->rho[n])) {
+    /* the air is uniform along the segment */
+    if (cylinder) {
+      e.type = ELEMENT_TUBE;
+      e.u.tube = compileTube(t->c[n], t->rho[n], length, radius1, 1);
+    } else {
+      e.type = ELEMENT_CONE;
+      e.u.cone =
+          compileCone(t->c[n], t->rho[n], length, radius1, radius2, 1);
+    }
+    return e;
+  }
+  /* the air at the input, middle and output of the piece, interpolated
+  quadratically along the segment */
+  s1 = x1 / t->length[n];
+  s2 = x2 / t->length[n];
+  sm = (s1 + s2) / 2;
+  c1 = quadraticAir(t->cIn[n], t->c[n], t->cOut[n], s1);
+  cm = quadraticAir(t->cIn[n], t->c[n], t->cOut[n], sm);
+  c2 = quadraticAir(t->cIn[n], t->c[n], t->cOut[n], s2);
+  rho1 = quadraticAir(t->rhoIn[n], t->rho[n], t->rhoOut[n], s1);
+  rhom = quadraticAir(t->rhoIn[n], t->rho[n], t->rhoOut[n], sm);
+  rho2 = quadraticAir(t->rhoIn[n], t->rho[n], t->rhoOut[n], s2);
+  if (cylinder) {
+    e.type = ELEMENT_GRADIENT_TUBE;
+    e.u.gradientTube =
+        compileGradientTube(c1, cm, c2, rho1, rho2, length, radius1, 1);
+  } else {
+    e.type = ELEMENT_CONE;
+    e.u.cone = compileGradientCone(c1, cm, c2, rho1, rhom, rho2, length,
+                                   radius1, radius2, 1);
+  }
+  return e;
+}
+void freeWoodwindProgram(WoodwindProgram p) {
+  if (p == NULL)
+    return;
+  free(p->element);
+  free(p->cell);
+  free(p);
+}
+HoleElement compileHole(Hole hole) {
+  HoleElement e;
+  Key key = hole->key;
+  double a = hole->boreRadius;
+  double b = hole->radius;
+  double delta = b / a;
+  double t = hole->length, t_0 = 0;
+  double d, q, h, th, w;
+  e.c = hole->c;
+  e.rho = hole->rho;
+  e.radius = b;
+  e.keyed = (key != NULL);
+  /* the tube section comprising the hole and matching length */
+  e.chimney =
+      compileTube(hole->c, hole->rho, t + matchingLengthCorrection(a, b), b, 1);
+  e.Z0 = charZ(hole->c, hole->rho, b).Re;
+  e.Z0bore = charZ(hole->c, hole->rho, a).Re;
+  e.t_i = innerRadiationLengthCorrection(a, b);
+  /* series length corrections */
+  e.t_aOpen = openHoleSeriesLengthCorrection(a, b);
+  if (key == NULL)
+    t_0 = b * (0.55 - 0.15 / cosh(9 * t / a) +
+               0.4 / cosh(6.5 * t / a) * (delta - 1));
+  e.t_aClosed = closedHoleSeriesLengthCorrection(a, b, t - t_0);
+  e.flangeCorrection = 0;
+  e.keyFlange = 0;
+  if (key == NULL) {
+    /* the closed load is the finger */
+    e.t_closed = CORR_CLOSED_FINGER_HOLE_LENGTH * delta * b;
+    /* the radius of the (cylindrical) flange is the outside of the
+    bore */
+    e.flangeCorrection = 0.47 * b * pow(b / (a + t), 0.8);
+    /* empirical correction */
+    e.openCorrection = CORR_OPEN_FINGER_HOLE_LENGTH * b;
+  } else {
+    /* the closed load is the key pad */
+    e.t_closed = CORR_CLOSED_KEYED_HOLE_LENGTH * b;
+    d = key->radius;
+    q = key->holeRadius;
+    h = key->height;
+    th = key->thickness;
+    w = key->wallThickness;
+    /* hack for classical flutes since the keyed holes have no
+    chimneys */
+    if (key->chimneyHeight == 0)
+      w = DBL_MAX;
+    e.keyFlange = w / b;
+    /* Dalmont et al. (2001) Radiation impedance of tubes with different
+    flanges: Numerical and experimental investigations, Journal of
+    Sound and Vibration 244(3), 505--534, eqs. (48, 51, 52) */
+    e.openCorrection =
+        b / (3.5 * pow(h / b, 0.8) * pow(h / b + 3 * w / b, -0.4) +
+             30 * pow(h / d, 2.6));
+    /* add empirical length correction */
+    e.openCorrection = e.openCorrection + CORR_OPEN_KEYED_HOLE_LENGTH * b;
+    if (q > 0)
+      e.openCorrection =
+          e.openCorrection /
+          (1 + 5 * pow(1.64 * b / q - 0.15 * b / d - 1.1 + th * b / (q * q),
+                       -1.35) *
+                   pow(h / b, -0.2));
+  }
+  return e;
+}
+TransferMatrix holeElementMatrix(FrequencyContext fc, const HoleElement *e,
+                                 int open) {
+  TransferMatrix m = identitym();
+  complex Z_hole, Z_i, Z_a;
+  /* calculate the input impedance to the hole */
+  Z_hole = holeElementInputZ(fc, e, open);
+  /* calculate the inner radiation impedance */
+  Z_i = holeElementInnerZ(fc, e);
+  /* calculate the series impedance */
+  Z_a = holeElementSeriesZ(fc, e, open);
+  /* assign the impedances to the correct matrix element */
+  m.C = divz(one, addz(Z_i, Z_hole));
+  m.B = Z_a;
+  return m;
+}
+complex holeElementInputZ(FrequencyContext fc, const HoleElement *e,
+                          int open) {
+  return calcZin(tubeElementMatrix(fc, &e->chimney),
+                 holeElementLoadZ(fc, e, open));
+}
+complex holeElementLoadZ(FrequencyContext fc, const HoleElement *e,
+                         int open) {
+  double k = fc.omega / e->c;
+  double a = e->radius;
+  complex Z_end, Z0 = real(e->Z0), d, Z;
+  if (!open) {
+    if (e->keyed && (e->t_closed == 0))
+      return inf;
+    return imaginary(-e->Z0 / tan(k * e->t_closed));
+  }
+  /* calculate the impedance of the (infinitely) flanged finger hole,
+  or of the key disk */
+  Z_end = e->keyed ? radiationZ(fc, e->c, e->rho, a, e->keyFlange)
+                   : flangedZ(fc, e->c, e->rho, a);
+  /* calculate complex end corrections */
+  d = divz(arctanz(divz(Z_end, multz(j, Z0))), real(k));
+  if (!e->keyed)
+    d = subz(d, real(e->flangeCorrection));
+  d = addz(d, real(e->openCorrection));
+  Z = multz(j, multz(Z0, tanz(multz(real(k), d))));
+  /* add empirical resistance */
+  if (e->keyed)
+    Z = addz(Z, multz(Z0, real(0.4 * pow(k * a, 2))));
+  return Z;
+}
+complex holeElementInnerZ(FrequencyContext fc, const HoleElement *e) {
+  double k = fc.omega / e->c;
+  return imaginary(e->t_i * k * e->Z0);
+}
+complex holeElementSeriesZ(FrequencyContext fc, const HoleElement *e,
+                           int open) {
+  double k = fc.omega / e->c;
+  return imaginary((open ? e->t_aOpen : e->t_aClosed) * k * e->Z0bore);
+}
+/* the wave number in the air of an element, omega / c, with its
+derivative */
+static dualcomplex elementWaveNumDual(FrequencyContext fc, double c) {
+  return dualz(real(fc.omega / c), real(2 * M_PI / c));
+}
+DualTransferMatrix holeElementMatrixDual(FrequencyContext fc,
+                                         const HoleElement *e, int open) {
+  DualTransferMatrix m = identitydm();
+  dualcomplex Z_hole, Z_i;
+  Z_hole = holeElementInputZDual(fc, e, open);
+  Z_i = holeElementInnerZDual(fc, e);
+  m.C = divdz(constdz(one), adddz(Z_i, Z_hole));
+  m.B = holeElementSeriesZDual(fc, e, open);
+  return m;
+}
+dualcomplex holeElementInputZDual(FrequencyContext fc, const HoleElement *e,
+                                  int open) {
+  return calcZinDual(tubeElementMatrixDual(fc, &e->chimney),
+                     holeElementLoadZDual(fc, e, open));
+}
+dualcomplex holeElementLoadZDual(FrequencyContext fc, const HoleElement *e,
+                                 int open) {
+  dualcomplex k = elementWaveNumDual(fc, e->c), Z_end, d, Z;
+  double a = e->radius, kt, sinkt;
+  complex Z0 = real(e->Z0);
+  if (!open) {
+    if (e->keyed && (e->t_closed == 0))
+      return constdz(inf);
+    /* d/df (-Z0 cot(k t)) = Z0 t k' / sin^2(k t) */
+    kt = k.v.Re * e->t_closed;
+    sinkt = sin(kt);
+    return dualz(imaginary(-e->Z0 / tan(kt)),
+                 imaginary(e->Z0 * e->t_closed * k.d.Re / (sinkt * sinkt)));
+  }
+  Z_end = e->keyed ? radiationZDual(fc, e->c, e->rho, a, e->keyFlange)
+                   : flangedZDual(fc, e->c, e->rho, a);
+  /* complex end corrections */
+  d = divdz(arctandz(scaledz(divz(one, multz(j, Z0)), Z_end)), k);
+  if (!e->keyed)
+    d = subdz(d, constdz(real(e->flangeCorrection)));
+  d = adddz(d, constdz(real(e->openCorrection)));
+  Z = scaledz(multz(j, Z0), tandz(multdz(k, d)));
+  /* empirical resistance */
+  if (e->keyed)
+    Z = adddz(Z, scaledz(real(0.4 * e->Z0 * a * a), multdz(k, k)));
+  return Z;
+}
+dualcomplex holeElementInnerZDual(FrequencyContext fc, const HoleElement *e) {
+  return scaledz(imaginary(e->t_i * e->Z0), elementWaveNumDual(fc, e->c));
+}
+dualcomplex holeElementSeriesZDual(FrequencyContext fc, const HoleElement *e,
+                                   int open) {
+  return scaledz(imaginary((open ? e->t_aOpen : e->t_aClosed) * e->Z0bore),
+                 elementWaveNumDual(fc, e->c));
+}
+EmbouchureElement compileEmbouchure(EmbouchureHole h, double entryratio) {
+  EmbouchureElement e;
+  double t_m, radiusin, radiusout;
+  e.c = h->c;
+  e.entryratio = entryratio;
+  /* the tube or cone comprising the hole and matching length */
+  t_m = matchingLengthCorrection(h->boreRadius, h->radiusin);
+  radiusin = h->radiusin;
+  radiusout = entryratio * h->radiusout;
+  e.riser.cell = -1;
+  if (radiusin == radiusout) {
+    e.riser.type = ELEMENT_TUBE;
+    e.riser.u.tube = compileTube(h->c, h->rho, h->length + t_m, radiusin, 1);
+  } else {
+    e.riser.type = ELEMENT_CONE;
+    e.riser.u.cone = compileCone(h->c, h->rho, h->length + t_m, radiusout,
+                                 radiusin, 1);
+  }
+  /* lossy elements to account for the discontinuity */
+  e.Z0entry = charZ(h->c, h->rho, radiusout).Re;
+  e.seriesResistance = e.Z0entry * 6.9e-6;
+  e.Z0hole = charZ(h->c, h->rho, h->radiusin).Re;
+  e.Z0bore = charZ(h->c, h->rho, h->boreRadius).Re;
+  /* inner radiation plus the extra embouchure length correction */
+  e.t_i = innerRadiationLengthCorrection(h->boreRadius, h->radiusin);
+  e.t_i = e.t_i + embouchureLengthCorrection(h->boreRadius, h->radiusin);
+  e.t_a = openHoleSeriesLengthCorrection(h->boreRadius, h->radiusin);
+  return e;
+}
+TransferMatrix embouchureElementMatrix(FrequencyContext fc,
+                                       const EmbouchureElement *e,
+                                       complex branchZ) {
+  TransferMatrix m, innerRadMatrix, cornerMatrix;
+  complex Z_i, Z_a;
+  double k = fc.omega / e->c;
+  /* introduce lossy elements to account for the discontinuity */
+  m = identitym();
+  m.B = real(e->seriesResistance * fc.f);
+  m.C = real(1.3e-4 * fc.f / e->Z0entry);
+  m = multm(m, elementMatrix(fc, &e->riser, 0));
+  /* add the inner radiation impedance to the matrix m by
+  multiplication */
+  Z_i = imaginary(e->t_i * k * e->Z0hole);
+  innerRadMatrix = identitym();
+  innerRadMatrix.B = Z_i;
+  m = multm(m, innerRadMatrix);
+  /* add half the series impedance to the branch impedance */
+  Z_a = imaginary(e->t_a * k * e->Z0bore);
+  branchZ = addz(branchZ, divz(Z_a, real(2.0)));
+  /* multiply m by matrix representing the corner */
+  cornerMatrix = identitym();
+  cornerMatrix.C = divz(one, branchZ);
+  cornerMatrix.B = divz(Z_a, real(2.0));
+  m = multm(m, cornerMatrix);
+  return m;
+}
+DualTransferMatrix embouchureElementMatrixDual(FrequencyContext fc,
+                                               const EmbouchureElement *e,
+                                               dualcomplex branchZ) {
+  DualTransferMatrix m, innerRadMatrix, cornerMatrix;
+  dualcomplex k = elementWaveNumDual(fc, e->c), Z_a;
+  /* the lossy elements are proportional to f */
+  m = identitydm();
+  m.B = dualz(real(e->seriesResistance * fc.f), real(e->seriesResistance));
+  m.C = dualz(real(1.3e-4 * fc.f / e->Z0entry), real(1.3e-4 / e->Z0entry));
+  m = multdm(m, elementMatrixDual(fc, &e->riser, 0));
+  innerRadMatrix = identitydm();
+  innerRadMatrix.B = scaledz(imaginary(e->t_i * e->Z0hole), k);
+  m = multdm(m, innerRadMatrix);
+  /* half the series impedance each side of the corner */
+  Z_a = scaledz(imaginary(0.5 * e->t_a * e->Z0bore), k);
+  cornerMatrix = identitydm();
+  cornerMatrix.C = divdz(constdz(one), adddz(branchZ, Z_a));
+  cornerMatrix.B = Z_a;
+  return multdm(m, cornerMatrix);
+}
+TransferMatrix elementMatrix(FrequencyContext fc, const ProgramElement *e,
+                             uint64_t fingering) {
+  switch (e->type) {
+  case ELEMENT_TUBE:
+    return tubeElementMatrix(fc, &e->u.tube);
+  case ELEMENT_GRADIENT_TUBE:
+    return gradientTubeElementMatrix(fc, &e->u.gradientTube);
+  case ELEMENT_CONE:
+    return coneElementMatrix(fc, &e->u.cone);
+  default:
+    return holeElementMatrix(fc, &e->u.hole, HOLE_OPEN(fingering, e->cell));
+  }
+}
+DualTransferMatrix elementMatrixDual(FrequencyContext fc,
+                                     const ProgramElement *e,
+                                     uint64_t fingering) {
+  switch (e->type) {
+  case ELEMENT_TUBE:
+    return tubeElementMatrixDual(fc, &e->u.tube);
+  case ELEMENT_GRADIENT_TUBE:
+    return gradientTubeElementMatrixDual(fc, &e->u.gradientTube);
+  case ELEMENT_CONE:
+    return coneElementMatrixDual(fc, &e->u.cone);
+  default:
+    return holeElementMatrixDual(fc, &e->u.hole,
+                                 HOLE_OPEN(fingering, e->cell));
+  }
+}
+TransferMatrix programRangeMatrix(FrequencyContext fc, WoodwindProgram p,
+                                  BoreRange range, uint64_t fingering) {
+  TransferMatrix m = identitym();
+  int n;
+  for (n = range.first; n < range.last; n++)
+    m = multm(m, elementMatrix(fc, &p->element[n], fingering));
+  return m;
+}
+DualTransferMatrix programRangeMatrixDual(FrequencyContext fc,
+                                          WoodwindProgram p, BoreRange range,
+                                          uint64_t fingering) {
+  DualTransferMatrix m = identitydm();
+  int n;
+  for (n = range.first; n < range.last; n++)
+    m = multdm(m, elementMatrixDual(fc, &p->element[n], fingering));
+  return m;
+}
+/* the embouchure constants for an entry ratio, from the program when
+it was compiled for that ratio */
+static EmbouchureElement programEmbouchure(WoodwindProgram p,
+                                           double entryratio) {
+  if (p->embouchure.entryratio == entryratio)
+    return p->embouchure;
+  return compileEmbouchure(p->embouchureHole, entryratio);
+}
+/* the impedance of the upstream branch of the embouchure hole */
+static complex programBranchZ(FrequencyContext fc, WoodwindProgram p) {
+  RadiationElement r = p->branchLoad;
+  return calcZin(programRangeMatrix(fc, p, p->upstream, 0),
+                 radiationZ(fc, r.c, r.rho, r.a, r.flange));
+}
+TransferMatrix programHeadMatrix(FrequencyContext fc, WoodwindProgram p,
+                                 double entryratio) {
+  TransferMatrix m = identitym();
+  EmbouchureElement e;
+  if (p->embouchureHole != NULL) {
+    e = programEmbouchure(p, entryratio);
+    m = multm(m, embouchureElementMatrix(fc, &e, programBranchZ(fc, p)));
+  }
+  if (p->downstream.length > 0)
+    m = multm(m, programRangeMatrix(fc, p, p->downstream, 0));
+  return m;
+}
+TransferMatrix programCellMatrix(FrequencyContext fc, WoodwindProgram p,
+                                 int cell, int open) {
+  BoreRange range = p->cell[cell];
+  TransferMatrix m =
+      holeElementMatrix(fc, &p->element[range.first].u.hole, open);
+  /* the bore follows the hole */
+  range.first++;
+  if (range.length > 0)
+    m = multm(m, programRangeMatrix(fc, p, range, 0));
+  return m;
+}
+DualTransferMatrix programMatrixDual(FrequencyContext fc, WoodwindProgram p,
+                                     uint64_t fingering, double entryratio) {
+  DualTransferMatrix m = identitydm();
+  RadiationElement r = p->branchLoad;
+  EmbouchureElement e;
+  dualcomplex branchZ;
+  BoreRange range;
+  int cell;
+  if (p->embouchureHole != NULL) {
+    e = programEmbouchure(p, entryratio);
+    branchZ = calcZinDual(programRangeMatrixDual(fc, p, p->upstream, 0),
+                          radiationZDual(fc, r.c, r.rho, r.a, r.flange));
+    m = multdm(m, embouchureElementMatrixDual(fc, &e, branchZ));
+  }
+  m = multdm(m, programRangeMatrixDual(fc, p, p->downstream, 0));
+  /* unit cells: the hole, then the bore */
+  for (cell = 0; cell < p->numCells; cell++) {
+    range = p->cell[cell];
+    m = multdm(m, programRangeMatrixDual(fc, p, range, fingering));
+  }
+  return m;
+}
+/* calculates the product of the matrices of a range of elements at n
+frequencies, using segment as scratch space */
+static void programRangeBatch(const double *f, const FrequencyContext *fc,
+                              int n, WoodwindProgram p, BoreRange range,
+                              uint64_t fingering, TransferMatrixBatch m,
+                              TransferMatrixBatch segment) {
+  ProgramElement *e;
+  int i, k;
+  identityBatch(m);
+  for (k = range.first; k < range.last; k++) {
+    e = &p->element[k];
+    if (e->type == ELEMENT_TUBE)
+      tubeElementBatch(f, n, &e->u.tube, segment);
+    else if (e->type == ELEMENT_CONE)
+      coneElementBatch(f, n, &e->u.cone, segment);
+    else
+      for (i = 0; i < n; i++)
+        setBatchMatrix(segment, i, elementMatrix(fc[i], e, fingering));
+    multBatch(m, segment);
+  }
+}
+void programMatrixBatch(const double *f, int n, WoodwindProgram p,
+                        uint64_t fingering, double entryratio,
+                        TransferMatrixBatch m) {
+  TransferMatrixBatch element = createTransferMatrixBatch(n);
+  TransferMatrixBatch segment = createTransferMatrixBatch(n);
+  FrequencyContext *fc = malloc(n * sizeof(FrequencyContext));
+  RadiationElement r = p->branchLoad;
+  EmbouchureElement e;
+  BoreRange range;
+  complex branchZ, ZL;
+  int i, cell;
+  for (i = 0; i < n; i++)
+    fc[i] = frequencyContext(f[i]);
+  identityBatch(m);
+  /* head */
+  if (p->embouchureHole != NULL) {
+    e = programEmbouchure(p, entryratio);
+    programRangeBatch(f, fc, n, p, p->upstream, 0, element, segment);
+    for (i = 0; i < n; i++) {
+      ZL = radiationZ(fc[i], r.c, r.rho, r.a, r.flange);
+      branchZ = calcZin(getBatchMatrix(element, i), ZL);
+      setBatchMatrix(element, i, embouchureElementMatrix(fc[i], &e, branchZ));
+    }
+    multBatch(m, element);
+  }
+  programRangeBatch(f, fc, n, p, p->downstream, 0, element, segment);
+  multBatch(m, element);
+  /* unit cells: the hole, then the bore */
+  for (cell = 0; cell < p->numCells; cell++) {
+    range = p->cell[cell];
+    for (i = 0; i < n; i++)
+      setBatchMatrix(element, i,
+                     elementMatrix(fc[i], &p->element[range.first],
+                                   fingering));
+    multBatch(m, element);
+    range.first++;
+    programRangeBatch(f, fc, n, p, range, 0, element, segment);
+    multBatch(m, element);
+  }
+  freeTransferMatrixBatch(element);
+  freeTransferMatrixBatch(segment);
+  free(fc);
+}
@@ -0,0 +1,403 @@
+/*
+WoodwindProgram.h
+A woodwind compiled into a flat program of typed element records.
+Compiling moves every frequency-independent term (characteristic
+impedances, cone apex distances, hole length corrections and the
+empirical key terms) out of the per-frequency calculation, so that
+evaluating the program only does the frequency-dependent math.
+A program is only valid for the geometry and air properties it was
+compiled from.
+*/
+#ifndef WOODWINDPROGRAM_H_PROTECTOR
+#define WOODWINDPROGRAM_H_PROTECTOR
+#include "Acoustics.h"
+#include "Complex.h"
+#include "TransferMatrix.h"
+#include "Woodwind.h"
+#include <stdint.h>
+/* HoleElement: the frequency-independent constants of a tone hole:
+{ speed of sound, density, hole radius, whether the hole is keyed,
+the chimney (hole length plus matching length) as a tube,
+characteristic impedance of the hole and of the bore, inner radiation
+length correction, series length corrections when open and closed,
+length of the closed load (finger or key pad), flange correction of
+an open finger hole, length correction of the open hole, flange of
+an open keyed hole } */
+typedef struct holeelement_str {
+  double c;
+  double rho;
+  double radius;
+  int keyed;
+  TubeElement chimney;
+  double Z0;
+  double Z0bore;
+  double t_i;
+  double t_aOpen;
+  double t_aClosed;
+  double t_closed;
+  double flangeCorrection;
+  double openCorrection;
+  double keyFlange;
+} HoleElement;
+/* ElementType: the kind of a ProgramElement */
+typedef enum {
+  ELEMENT_TUBE,
+  ELEMENT_GRADIENT_TUBE,
+  ELEMENT_CONE,
+  ELEMENT_HOLE
+} ElementType;
+/* ProgramElement: { kind, index of the unit cell (holes only), the
+constants of the element } */
+typedef struct programelement_str {
+  ElementType type;
+  int cell;
+  union {
+    TubeElement tube;
+    GradientTubeElement gradientTube;
+    ConeElement cone;
+    HoleElement hole;
+  } u;
+} ProgramElement;
+/* EmbouchureElement: the frequency-independent constants of an
+embouchure hole for one entry ratio: { speed of sound, entry ratio,
+the riser (hole length plus matching length) as a tube or cone,
+series resistance per Hz, characteristic impedance at the entry,
+characteristic impedance of the hole and of the bore, inner radiation
+and embouchure length correction, series length correction } */
+typedef struct embouchureelement_str {
+  double c;
+  double entryratio;
+  ProgramElement riser;
+  double seriesResistance;
+  double Z0entry;
+  double Z0hole;
+  double Z0bore;
+  double t_i;
+  double t_a;
+} EmbouchureElement;
+/* RadiationElement: { speed of sound, density, radius, flange } of a
+radiating open end */
+typedef struct radiationelement_str {
+  double c;
+  double rho;
+  double a;
+  double flange;
+} RadiationElement;
+/* WoodwindProgram: the elements of a woodwind in instrument order
+(upstream bore, downstream bore, then the hole and bore of each unit
+cell), the range of each part of the instrument within the elements,
+the embouchure hole and its compiled constants, and the radiating
+ends of the upstream branch and of the instrument. */
+struct woodwindprogram_str {
+  int numElements;
+  ProgramElement *element;
+  BoreRange upstream;
+  BoreRange downstream;
+  int numCells;
+  BoreRange *cell;
+  EmbouchureHole embouchureHole;
+  EmbouchureElement embouchure;
+  RadiationElement branchLoad;
+  RadiationElement load;
+};
+void compileWoodwind(Woodwind w, double entryratio);
+/*
+Compiles a woodwind and attaches the program to it, replacing any
+previous program. Must be called after discretiseWoodwind and
+setAirProperties (both of which discard the program).
+Parameters:
+w: the Woodwind
+entryratio: the ratio of the input side radius (impedance head or
+embouchure) to the outside radius of the embouchure hole (other
+ratios are still evaluated correctly, but more slowly)
+*/
+void freeWoodwindProgram(WoodwindProgram p);
+/*
+Frees a WoodwindProgram.
+Parameters:
+p: the WoodwindProgram (may be NULL)
+*/
+ProgramElement compileBoreSegment(BoreTable t, int n, double x);
+/*
+Compiles a bore segment, or its first part, as a tube or cone: with
+uniform air if the speed of sound and density are the same throughout
+the segment, otherwise following their variation (see
+compileGradientTube).
+Parameters:
+t: the BoreTable (with the air properties set)
+n: the index of the segment
+x: the length of the part of the segment (all of it if x is at least
+the segment length)
+Returns:
+the ProgramElement of the segment
+*/
+ProgramElement compileBorePiece(BoreTable t, int n, double x1, double x2);
+/*
+Compiles the piece of a bore segment between two positions along it,
+as for compileBoreSegment.
+Parameters:
+t: the BoreTable (with the air properties set)
+n: the index of the segment
+x1: the position of the start of the piece along the segment
+x2: the position of the end of the piece (clamped to the segment
+length)
+Returns:
+the ProgramElement of the piece
+*/
+HoleElement compileHole(Hole hole);
+/*
+Calculates the frequency-independent constants of a tone hole.
+Parameters:
+hole: the Hole (with c and rho set)
+Returns:
+the HoleElement of the hole
+*/
+TransferMatrix holeElementMatrix(FrequencyContext fc, const HoleElement *e,
+                                 int open);
+/*
+Calculates the TransferMatrix for traversing a compiled tone hole.
+Equivalent to traverseHoleMatrix.
+Parameters:
+fc: the FrequencyContext of the frequency
+e: the HoleElement
+open: whether the hole is open
+Returns:
+the TransferMatrix of the hole
+*/
+complex holeElementInputZ(FrequencyContext fc, const HoleElement *e,
+                          int open);
+/*
+Calculates the input impedance of a compiled tone hole, looking into
+the hole from the bore.
+Parameters:
+fc: the FrequencyContext of the frequency
+e: the HoleElement
+open: whether the hole is open
+Returns:
+the input impedance of the hole
+*/
+complex holeElementLoadZ(FrequencyContext fc, const HoleElement *e, int open);
+/*
+Calculates the load (radiation) impedance at the top of a compiled
+tone hole, by finger or key pad when closed.
+Parameters:
+fc: the FrequencyContext of the frequency
+e: the HoleElement
+open: whether the hole is open
+Returns:
+the load impedance of the hole
+*/
+complex holeElementInnerZ(FrequencyContext fc, const HoleElement *e);
+/*
+Calculates the inner radiation impedance of a compiled tone hole.
+Parameters:
+fc: the FrequencyContext of the frequency
+e: the HoleElement
+Returns:
+the inner radiation impedance of the hole
+*/
+complex holeElementSeriesZ(FrequencyContext fc, const HoleElement *e,
+                           int open);
+/*
+Calculates the series impedance of a compiled tone hole.
+Parameters:
+fc: the FrequencyContext of the frequency
+e: the HoleElement
+open: whether the hole is open
+Returns:
+the series impedance of the hole
+*/
+DualTransferMatrix holeElementMatrixDual(FrequencyContext fc,
+                                         const HoleElement *e, int open);
+/*
+Calculates the TransferMatrix for traversing a compiled tone hole
+together with its derivative with respect to frequency.
+Parameters:
+as holeElementMatrix
+Returns:
+the TransferMatrix of the hole and its derivative
+*/
+dualcomplex holeElementInputZDual(FrequencyContext fc, const HoleElement *e,
+                                  int open);
+/*
+Calculates the input impedance of a compiled tone hole (as
+holeElementInputZ) together with its derivative with respect to
+frequency.
+Parameters:
+as holeElementInputZ
+Returns:
+the input impedance of the hole and its derivative
+*/
+dualcomplex holeElementLoadZDual(FrequencyContext fc, const HoleElement *e,
+                                 int open);
+/*
+Calculates the load impedance at the top of a compiled tone hole (as
+holeElementLoadZ) together with its derivative with respect to
+frequency.
+Parameters:
+as holeElementLoadZ
+Returns:
+the load impedance of the hole and its derivative
+*/
+dualcomplex holeElementInnerZDual(FrequencyContext fc, const HoleElement *e);
+/*
+Calculates the inner radiation impedance of a compiled tone hole (as
+holeElementInnerZ) together with its derivative with respect to
+frequency.
+Parameters:
+as holeElementInnerZ
+Returns:
+the inner radiation impedance of the hole and its derivative
+*/
+dualcomplex holeElementSeriesZDual(FrequencyContext fc, const HoleElement *e,
+                                   int open);
+/*
+Calculates the series impedance of a compiled tone hole (as
+holeElementSeriesZ) together with its derivative with respect to
+frequency.
+Parameters:
+as holeElementSeriesZ
+Returns:
+the series impedance of the hole and its derivative
+*/
+EmbouchureElement compileEmbouchure(EmbouchureHole h, double entryratio);
+/*
+Calculates the frequency-independent constants of an embouchure hole.
+Parameters:
+h: the EmbouchureHole (with c and rho set)
+entryratio: the ratio of the input side radius (impedance head or
+embouchure) to the outside radius of the embouchure hole
+Returns:
+the EmbouchureElement of the hole
+*/
+TransferMatrix embouchureElementMatrix(FrequencyContext fc,
+                                       const EmbouchureElement *e,
+                                       complex branchZ);
+/*
+Calculates the TransferMatrix for a compiled embouchure hole.
+Equivalent to embouchureMatrix.
+Parameters:
+fc: the FrequencyContext of the frequency
+e: the EmbouchureElement
+branchZ: the impedance of the impedance branch (upstream or
+downstream section)
+Returns:
+the TransferMatrix of the embouchure hole
+*/
+DualTransferMatrix embouchureElementMatrixDual(FrequencyContext fc,
+                                               const EmbouchureElement *e,
+                                               dualcomplex branchZ);
+/*
+Calculates the TransferMatrix for a compiled embouchure hole together
+with its derivative with respect to frequency.
+Parameters:
+fc: the FrequencyContext of the frequency
+e: the EmbouchureElement
+branchZ: the impedance of the impedance branch and its derivative
+Returns:
+the TransferMatrix of the embouchure hole and its derivative
+*/
+TransferMatrix elementMatrix(FrequencyContext fc, const ProgramElement *e,
+                             uint64_t fingering);
+/*
+Calculates the TransferMatrix of a single program element.
+Parameters:
+fc: the FrequencyContext of the frequency
+e: the ProgramElement
+fingering: the fingering (bit i set if hole i is open)
+Returns:
+the TransferMatrix of the element
+*/
+DualTransferMatrix elementMatrixDual(FrequencyContext fc,
+                                     const ProgramElement *e,
+                                     uint64_t fingering);
+/*
+Calculates the TransferMatrix of a single program element together
+with its derivative with respect to frequency.
+Parameters:
+as elementMatrix
+Returns:
+the TransferMatrix of the element and its derivative
+*/
+TransferMatrix programRangeMatrix(FrequencyContext fc, WoodwindProgram p,
+                                  BoreRange range, uint64_t fingering);
+/*
+Calculates the product of the TransferMatrices of a range of program
+elements.
+Parameters:
+fc: the FrequencyContext of the frequency
+p: the WoodwindProgram
+range: the range of elements
+fingering: the fingering (bit i set if hole i is open)
+Returns:
+the TransferMatrix of the range
+*/
+DualTransferMatrix programRangeMatrixDual(FrequencyContext fc,
+                                          WoodwindProgram p, BoreRange range,
+                                          uint64_t fingering);
+/*
+Calculates the product of the TransferMatrices of a range of program
+elements together with its derivative with respect to frequency.
+Parameters:
+as programRangeMatrix
+Returns:
+the TransferMatrix of the range and its derivative
+*/
+TransferMatrix programHeadMatrix(FrequencyContext fc, WoodwindProgram p,
+                                 double entryratio);
+/*
+Calculates the TransferMatrix of the complete head (embouchure hole
+and downstream bore). Equivalent to headMatrix.
+Parameters:
+fc: the FrequencyContext of the frequency
+p: the WoodwindProgram
+entryratio: the ratio of the input side radius (impedance head or
+embouchure) to the outside radius of the embouchure hole
+Returns:
+the TransferMatrix of the head
+*/
+TransferMatrix programCellMatrix(FrequencyContext fc, WoodwindProgram p,
+                                 int cell, int open);
+/*
+Calculates the TransferMatrix of a complete unit cell (hole and
+bore). Equivalent to unitCellMatrix.
+Parameters:
+fc: the FrequencyContext of the frequency
+p: the WoodwindProgram
+cell: the index of the unit cell
+open: whether the hole of the unit cell is open
+Returns:
+the TransferMatrix of the unit cell
+*/
+DualTransferMatrix programMatrixDual(FrequencyContext fc, WoodwindProgram p,
+                                     uint64_t fingering, double entryratio);
+/*
+Calculates the TransferMatrix of the whole instrument together with
+its derivative with respect to frequency, in one pass over the
+elements.
+Parameters:
+fc: the FrequencyContext of the frequency
+p: the WoodwindProgram
+fingering: the fingering (bit i set if hole i is open)
+entryratio: the ratio of the input side radius (impedance head or
+embouchure) to the outside radius of the embouchure hole
+Returns:
+the TransferMatrix of the instrument and its derivative
+*/
+void programMatrixBatch(const double *f, int n, WoodwindProgram p,
+                        uint64_t fingering, double entryratio,
+                        TransferMatrixBatch m);
+/*
+Calculates the TransferMatrices of the whole instrument at n
+frequencies, the bore elements several frequencies at a time.
+Equivalent to woodwindMatrixBatch.
+Parameters:
+f: the frequencies in Hz
+n: the number of frequencies
+p: the WoodwindProgram
+fingering: the fingering (bit i set if hole i is open)
+entryratio: the ratio of the input side radius (impedance head or
+embouchure) to the outside radius of the embouchure hole
+m: the return batch (of n matrices)
+*/
+#endif